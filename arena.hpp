@@ -0,0 +1,115 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator backing one parse. Objects are never freed individually;
+// everything goes away together on reset() or destruction. Only trivially
+// destructible types may be placed in it (no destructors are ever run).
+class Arena {
+public:
+    explicit Arena(size_t first_block_size = 64 * 1024) : nextBlockSize(first_block_size) {}
+    ~Arena() { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur) + (align - 1)) & ~static_cast<uintptr_t>(align - 1);
+        if (cur == nullptr || p + bytes > reinterpret_cast<uintptr_t>(end)) {
+            return allocateSlow(bytes, align);
+        }
+        cur = reinterpret_cast<char*>(p + bytes);
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* makeArray(size_t n) {
+        return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+    }
+
+    // Copies [data, data + len) into the arena; used when the source bytes
+    // do not outlive the parse.
+    const char* copy(const char* data, size_t len) {
+        char* dst = static_cast<char*>(allocate(len ? len : 1, 1));
+        for (size_t i = 0; i < len; ++i) dst[i] = data[i];
+        return dst;
+    }
+
+    // Hands the tail of the most recent allocation, from `tail` on, back to
+    // the arena; for buffers sized by an upper bound before being filled.
+    void trim(const char* tail) {
+        if (!blocks.empty() && tail >= blocks.back().data && tail <= cur) cur = const_cast<char*>(tail);
+    }
+
+    // Drops every allocation but keeps the largest block for reuse, so a
+    // parser that is reset between files stops hitting malloc.
+    void reset() {
+        if (blocks.empty()) return;
+        size_t keep = 0;
+        for (size_t b = 1; b < blocks.size(); ++b) {
+            if (blocks[b].size > blocks[keep].size) keep = b;
+        }
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            if (b != keep) std::free(blocks[b].data);
+        }
+        Block kept = blocks[keep];
+        blocks.clear();
+        blocks.push_back(kept);
+        cur = kept.data;
+        end = kept.data + kept.size;
+    }
+
+    size_t bytesReserved() const {
+        size_t total = 0;
+        for (const Block& b : blocks) total += b.size;
+        return total;
+    }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    static constexpr size_t kMaxBlockSize = 16 * 1024 * 1024;
+
+    void* allocateSlow(size_t bytes, size_t align) {
+        size_t want = bytes + align;
+        size_t block_size = nextBlockSize;
+        if (want > block_size) {
+            block_size = want;
+        } else if (nextBlockSize < kMaxBlockSize) {
+            nextBlockSize *= 2;
+        }
+        char* data = static_cast<char*>(std::malloc(block_size));
+        if (!data) throw std::bad_alloc();
+        blocks.push_back({data, block_size});
+        cur = data;
+        end = data + block_size;
+        return allocate(bytes, align);
+    }
+
+    void release() {
+        for (Block& b : blocks) std::free(b.data);
+        blocks.clear();
+        cur = end = nullptr;
+    }
+
+    std::vector<Block> blocks;
+    char* cur = nullptr;
+    char* end = nullptr;
+    size_t nextBlockSize;
+};
+
+#endif // ARENA_HPP
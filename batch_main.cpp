@@ -0,0 +1,77 @@
+#include "pickle_batch.hpp"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Validates (or decodes, or indexes) many pickles at once on a thread pool.
+static void usage() {
+    std::cerr << "Usage: libpickle-batch [-j N] [--mode validate|tree|tape] [--mmap] [--stats] [-v] PATH...\n"
+              << "Directories are searched recursively for *.pkl, *.pickle and *.pt files.\n";
+}
+
+int main(int argc, char* argv[]) {
+    PickleBatchOptions options;
+    std::vector<std::string> paths;
+    bool verbose = false;
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "-j" && a + 1 < argc) { // worker threads (default: one per hardware thread)
+            options.jobs = std::stoul(argv[++a]);
+        } else if (arg == "--mode" && a + 1 < argc) {
+            std::string mode = argv[++a];
+            if (mode == "validate") {
+                options.mode = PickleBatchOptions::Mode::Validate;
+            } else if (mode == "tree") {
+                options.mode = PickleBatchOptions::Mode::Tree;
+            } else if (mode == "tape") {
+                options.mode = PickleBatchOptions::Mode::Tape;
+            } else {
+                usage();
+                return 2;
+            }
+        } else if (arg == "--mmap") {
+            options.input = PickleParser::InputMode::Mmap;
+        } else if (arg == "--stats") { // print the merged per-opcode profile as JSON
+            options.stats = true;
+        } else if (arg == "-v") { // one line per file, not only failures
+            verbose = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        usage();
+        return 2;
+    }
+    if (options.stats && !PickleParser::kStatsCompiled) {
+        std::cerr << "Error: --stats needs a build with PICKLE_STATS" << std::endl;
+        return 2;
+    }
+
+    PickleBatchSummary summary = parseBatch(findPickles(paths), options);
+    // Keep stdout pure JSON under --stats.
+    std::ostream& log = options.stats ? std::cerr : std::cout;
+    for (const PickleBatchFile& file : summary.files) {
+        if (!file.ok) {
+            log << "FAIL " << file.path << ": " << file.message << '\n';
+        } else if (verbose) {
+            char line[64];
+            std::snprintf(line, sizeof(line), "  %llu bytes, protocol %d, %.3f ms",
+                          static_cast<unsigned long long>(file.bytes), file.protocol, file.seconds * 1e3);
+            log << "ok   " << file.path << line << (file.message.empty() ? "" : "  (" + file.message + ")") << '\n';
+        }
+    }
+    double mb = static_cast<double>(summary.bytes) / (1 << 20);
+    char totals[160];
+    std::snprintf(totals, sizeof(totals), "%zu files, %zu failed, %.1f MB in %.3f s (%.1f MB/s, %.0f files/s)",
+                  summary.files.size(), summary.failed, mb, summary.seconds, mb / summary.seconds,
+                  static_cast<double>(summary.files.size()) / summary.seconds);
+    log << totals << std::endl;
+    if (options.stats) summary.stats.writeJson(std::cout);
+    return summary.failed ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+
+namespace {
+std::atomic<size_t> allocations{0};
+}
+
+#ifdef __GLIBC__
+// Interpose the C allocator for this executable; glibc exports the real
+// implementations under __libc_*.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+
+bool allocationCountingSupported() { return true; }
+#else
+bool allocationCountingSupported() { return false; }
+#endif
+
+size_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+size_t peakRss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::stoul(line.substr(6)) * 1024;
+    }
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+}
+
+void resetPeakRss() {
+    std::ofstream clear("/proc/self/clear_refs");
+    if (clear) clear << "5";
+}
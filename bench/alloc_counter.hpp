@@ -0,0 +1,18 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+// Heap calls made by this process so far (malloc, calloc and realloc,
+// which operator new goes through as well). Only available where
+// allocationCountingSupported() says so (glibc); elsewhere it stays 0.
+size_t allocationCount();
+bool allocationCountingSupported();
+
+// Peak resident set size in bytes since the last resetPeakRss(). Linux
+// resets the high-water mark through /proc/self/clear_refs; elsewhere the
+// peak covers the whole process lifetime.
+size_t peakRss();
+void resetPeakRss();
+
+#endif // ALLOC_COUNTER_HPP
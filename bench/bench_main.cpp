@@ -0,0 +1,138 @@
+#include "alloc_counter.hpp"
+#include "pickle.hpp"
+#include "pickle_gen.hpp"
+#include "pickle_tape.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+void usage() {
+    std::cerr << "Usage: libpickle-bench [--scale S] [--iterations N] [--null | --tape] [--intern] [--write DIR] [--file PATH]... [workload]...\n"
+              << "Workloads:";
+    for (const std::string& name : generatorNames()) std::cerr << ' ' << name;
+    std::cerr << " (default: all)\n";
+}
+
+struct Result {
+    double bestSeconds;
+    size_t peakRssBytes;
+    double allocationsPerParse;
+};
+
+enum class Mode {
+    Tree, // build the PickleValue tree
+    Null, // only decode the stream (PickleNullVisitor)
+    Tape, // only index opcode boundaries (PickleTape)
+};
+
+void parseOnce(PickleParser& parser, PickleTape& tape, Mode mode) {
+    if (mode == Mode::Null) {
+        PickleNullVisitor visitor;
+        parser.parsePickle(visitor);
+    } else if (mode == Mode::Tape) {
+        tape.build(parser.input());
+    } else {
+        parser.parsePickle();
+    }
+}
+
+Result run(const std::string& bytes, int iterations, Mode mode, bool intern) {
+    PickleParser parser(bytes.data(), bytes.size());
+    parser.pickleOpener();
+    parser.setInterning(intern);
+    PickleTape tape;
+    parseOnce(parser, tape, mode); // warm-up: grows the arena, the VM vectors and the tape once
+
+    resetPeakRss();
+    size_t allocsBefore = allocationCount();
+    double best = 1e30;
+    for (int it = 0; it < iterations; ++it) {
+        auto start = std::chrono::steady_clock::now();
+        parseOnce(parser, tape, mode);
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    size_t allocs = allocationCount() - allocsBefore;
+    return {best, peakRss(), static_cast<double>(allocs) / iterations};
+}
+
+void report(const std::string& name, size_t bytes, size_t opcodes, const Result& r) {
+    double mb = static_cast<double>(bytes) / (1 << 20);
+    char allocs[32];
+    if (allocationCountingSupported()) {
+        std::snprintf(allocs, sizeof(allocs), "%.1f", r.allocationsPerParse);
+    } else {
+        std::snprintf(allocs, sizeof(allocs), "n/a");
+    }
+    std::printf("%-14s %10.1f %12zu %10.1f %10.2f %10.1f %12s\n", name.c_str(), mb, opcodes,
+                mb / r.bestSeconds, opcodes / r.bestSeconds / 1e6,
+                static_cast<double>(r.peakRssBytes) / (1 << 20), allocs);
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double scale = 1.0;
+    int iterations = 5;
+    Mode mode = Mode::Tree;
+    bool intern = false;
+    std::string write_dir;
+    std::vector<std::string> files;
+    std::vector<std::string> workloads;
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--scale" && a + 1 < argc) {
+            scale = std::stod(argv[++a]);
+        } else if (arg == "--iterations" && a + 1 < argc) {
+            iterations = std::max(1, std::stoi(argv[++a]));
+        } else if (arg == "--null") { // decode with PickleNullVisitor instead of building the tree
+            mode = Mode::Null;
+        } else if (arg == "--tape") { // only build the opcode tape
+            mode = Mode::Tape;
+        } else if (arg == "--intern") { // intern names and short strings while building the tree
+            intern = true;
+        } else if (arg == "--write" && a + 1 < argc) { // also save each generated pickle as DIR/<name>.pkl
+            write_dir = argv[++a];
+        } else if (arg == "--file" && a + 1 < argc) {
+            files.push_back(argv[++a]);
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else {
+            workloads.push_back(arg);
+        }
+    }
+    if (workloads.empty() && files.empty()) workloads = generatorNames();
+
+    std::printf("%-14s %10s %12s %10s %10s %10s %12s\n", "workload", "MB", "opcodes", "MB/s", "Mops/s",
+                "peakRSS MB", "allocs/parse");
+    try {
+        for (const std::string& name : workloads) {
+            GeneratedPickle p = generate(name, scale);
+            if (!write_dir.empty()) {
+                std::ofstream out(write_dir + "/" + p.name + ".pkl", std::ios::binary);
+                out.write(p.bytes.data(), static_cast<std::streamsize>(p.bytes.size()));
+            }
+            report(p.name, p.bytes.size(), p.opcodes, run(p.bytes, iterations, mode, intern));
+        }
+        for (const std::string& path : files) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) throw std::runtime_error("Cannot open " + path);
+            std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            report(path, bytes.size(), PickleTape(bytes).size(), run(bytes, iterations, mode, intern));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include "pickle_gen.hpp"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+PickleWriter::PickleWriter(unsigned char protocol) {
+    op(0x80); // PROTO
+    out.push_back(static_cast<char>(protocol));
+}
+
+void PickleWriter::le(uint64_t value, size_t len) {
+    for (size_t b = 0; b < len; ++b) out.push_back(static_cast<char>((value >> (8 * b)) & 0xff));
+}
+
+void PickleWriter::op(unsigned char opcode) {
+    out.push_back(static_cast<char>(opcode));
+    ++count;
+}
+
+void PickleWriter::integer(int64_t value) {
+    if (value >= 0 && value < 0x100) {
+        op('K'); // BININT1
+        le(static_cast<uint64_t>(value), 1);
+    } else if (value >= 0 && value < 0x10000) {
+        op('M'); // BININT2
+        le(static_cast<uint64_t>(value), 2);
+    } else if (value >= INT32_MIN && value <= INT32_MAX) {
+        op('J'); // BININT
+        le(static_cast<uint64_t>(value), 4);
+    } else {
+        op(0x8a); // LONG1
+        out.push_back(8);
+        le(static_cast<uint64_t>(value), 8);
+    }
+}
+
+void PickleWriter::unicode(std::string_view text) {
+    op('X'); // BINUNICODE
+    le(text.size(), 4);
+    raw(text.data(), text.size());
+}
+
+void PickleWriter::unicode8(std::string_view text) {
+    op(0x8d); // BINUNICODE8
+    le(text.size(), 8);
+    raw(text.data(), text.size());
+}
+
+void PickleWriter::bytes(std::string_view data) {
+    op('B'); // BINBYTES
+    le(data.size(), 4);
+    raw(data.data(), data.size());
+}
+
+void PickleWriter::global(std::string_view module, std::string_view name) {
+    op('c'); // GLOBAL
+    raw(module.data(), module.size());
+    out.push_back('\n');
+    raw(name.data(), name.size());
+    out.push_back('\n');
+}
+
+void PickleWriter::put(uint32_t index) {
+    if (index < 0x100) {
+        op('q'); // BINPUT
+        le(index, 1);
+    } else {
+        op('r'); // LONG_BINPUT
+        le(index, 4);
+    }
+}
+
+void PickleWriter::get(uint32_t index) {
+    if (index < 0x100) {
+        op('h'); // BINGET
+        le(index, 1);
+    } else {
+        op('j'); // LONG_BINGET
+        le(index, 4);
+    }
+}
+
+std::string PickleWriter::finish() {
+    op('.'); // STOP
+    return std::move(out);
+}
+
+namespace {
+
+size_t scaled(double scale, size_t base) {
+    return std::max<size_t>(1, static_cast<size_t>(static_cast<double>(base) * scale));
+}
+
+// std::mt19937_64 is fully specified by the standard, unlike the
+// distributions, so values are drawn from it directly to keep the output
+// identical across standard libraries.
+uint64_t draw(std::mt19937_64& rng, uint64_t bound) {
+    return rng() % bound;
+}
+
+} // namespace
+
+GeneratedPickle generateInts(double scale) {
+    std::mt19937_64 rng(0x1257);
+    size_t n = scaled(scale, 2'000'000);
+    PickleWriter w;
+    uint32_t memo = 0;
+    w.op(']'); // EMPTY_LIST
+    w.put(memo++);
+    for (size_t i = 0; i < n; i += 1000) {
+        w.mark();
+        for (size_t k = i; k < std::min(n, i + 1000); ++k) {
+            // Mostly small values, like the shape and index lists real
+            // pickles are full of, with the odd wide one.
+            uint64_t r = rng();
+            int64_t value = (r & 7) == 0 ? static_cast<int64_t>(r >> 8) - (int64_t{1} << 54)
+                                         : static_cast<int64_t>(r >> 48);
+            w.integer(value);
+            w.put(memo++);
+        }
+        w.op('e'); // APPENDS
+    }
+    size_t ops = w.opcodes() + 1;
+    return {"ints", w.finish(), ops};
+}
+
+GeneratedPickle generateNested(double scale) {
+    size_t depth = scaled(scale, 200'000);
+    PickleWriter w;
+    uint32_t memo = 0;
+    w.mark();
+    // [[[...]]]: every list is pushed first, then folded inwards-out.
+    for (size_t d = 0; d < depth; ++d) {
+        w.op(']'); // EMPTY_LIST
+        w.put(memo++);
+    }
+    for (size_t d = 1; d < depth; ++d) w.op('a'); // APPEND
+    // {"k": {"k": ...}}: one open MARK per level.
+    for (size_t d = 0; d < depth; ++d) {
+        w.op('}'); // EMPTY_DICT
+        w.put(memo++);
+        w.mark();
+        w.unicode("k");
+    }
+    w.op('}');
+    for (size_t d = 0; d < depth; ++d) w.op('u'); // SETITEMS
+    w.op('t'); // TUPLE
+    size_t ops = w.opcodes() + 1;
+    return {"nested", w.finish(), ops};
+}
+
+GeneratedPickle generateStrings(double scale) {
+    std::mt19937_64 rng(0x57);
+    size_t payload = scaled(scale, 16 << 20);
+    PickleWriter w;
+    w.op(']');
+    w.put(0);
+    w.mark();
+    std::string chunk(payload, '\0');
+    for (char& c : chunk) c = static_cast<char>('a' + draw(rng, 26));
+    for (int k = 0; k < 8; ++k) {
+        std::rotate(chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(payload / 8), chunk.end());
+        if (k % 2) {
+            w.bytes(chunk);
+        } else {
+            w.unicode8(chunk);
+        }
+    }
+    w.op('e');
+    size_t ops = w.opcodes() + 1;
+    return {"strings", w.finish(), ops};
+}
+
+GeneratedPickle generateMemo(double scale) {
+    std::mt19937_64 rng(0x3e30);
+    size_t words = 4096;
+    size_t tuples = scaled(scale, 1'000'000);
+    PickleWriter w;
+    uint32_t memo = 0;
+    w.mark();
+    // A vocabulary, then tuples that mostly point back into it...
+    for (size_t i = 0; i < words; ++i) {
+        w.unicode("word_" + std::to_string(i));
+        w.put(memo++);
+    }
+    w.op('t');
+    w.put(memo++);
+    w.op(']');
+    w.put(memo++);
+    uint32_t firstTuple = memo;
+    for (size_t i = 0; i < tuples; i += 1000) {
+        w.mark();
+        for (size_t k = i; k < std::min(tuples, i + 1000); ++k) {
+            w.get(static_cast<uint32_t>(draw(rng, words)));
+            w.get(static_cast<uint32_t>(draw(rng, words)));
+            w.integer(static_cast<int64_t>(k));
+            w.op(0x87); // TUPLE3
+            w.put(memo++);
+        }
+        w.op('e');
+    }
+    // ...and a second list made only of references to those tuples.
+    w.op(']');
+    w.put(memo++);
+    for (size_t i = 0; i < tuples; i += 1000) {
+        w.mark();
+        for (size_t k = i; k < std::min(tuples, i + 1000); ++k) {
+            w.get(firstTuple + static_cast<uint32_t>(draw(rng, tuples)));
+        }
+        w.op('e');
+    }
+    w.op(0x87); // (vocabulary, tuples, references)
+    size_t ops = w.opcodes() + 1;
+    return {"memo", w.finish(), ops};
+}
+
+GeneratedPickle generateStateDict(double scale) {
+    std::mt19937_64 rng(0x5d);
+    size_t layers = scaled(scale, 4000);
+    static const char* const parts[] = {"attn.query", "attn.key", "attn.value", "attn.out", "mlp.0", "mlp.2"};
+    static const char* const storages[] = {"HalfStorage", "FloatStorage", "BFloat16Storage"};
+
+    PickleWriter w;
+    uint32_t memo = 0;
+    w.op('}');
+    w.put(memo++);
+    w.mark();
+    w.unicode("dims");
+    w.put(memo++);
+    w.op('}');
+    w.put(memo++);
+    w.mark();
+    for (const char* dim : {"n_state", "n_head", "n_layer", "n_vocab"}) {
+        w.unicode(dim);
+        w.put(memo++);
+        w.integer(static_cast<int64_t>(64 + draw(rng, 4096)));
+    }
+    w.op('u');
+    w.unicode("model_state_dict");
+    w.put(memo++);
+    w.op('}');
+    w.put(memo++);
+
+    // Memo slots torch.save() fills on first use and then only refers to.
+    uint32_t rebuild = 0, storageTag = 0, cpu = 0, orderedDict = 0;
+    uint32_t storageClass[3] = {0, 0, 0};
+    auto globalOnce = [&](uint32_t& slot, std::string_view module, std::string_view name) {
+        if (slot) {
+            w.get(slot);
+        } else {
+            w.global(module, name);
+            w.put(slot = memo++);
+        }
+    };
+    auto stringOnce = [&](uint32_t& slot, std::string_view text) {
+        if (slot) {
+            w.get(slot);
+        } else {
+            w.unicode(text);
+            w.put(slot = memo++);
+        }
+    };
+
+    size_t key = 0;
+    for (size_t i = 0; i < layers; i += 1000 / (2 * std::size(parts))) {
+        w.mark();
+        for (size_t l = i; l < std::min(layers, i + 1000 / (2 * std::size(parts))); ++l) {
+            for (const char* part : parts) {
+                for (const char* leaf : {"weight", "bias"}) {
+                    bool bias = leaf[0] == 'b';
+                    int64_t rows = static_cast<int64_t>(64 * (1 + draw(rng, 24)));
+                    int64_t cols = static_cast<int64_t>(64 * (1 + draw(rng, 24)));
+                    size_t dtype = draw(rng, 3);
+                    w.unicode("blocks." + std::to_string(l) + "." + part + "." + leaf);
+                    w.put(memo++);
+
+                    // _rebuild_tensor_v2(storage pid, offset, shape, stride, requires_grad, hooks)
+                    globalOnce(rebuild, "torch._utils", "_rebuild_tensor_v2");
+                    w.mark();
+                    w.mark();
+                    stringOnce(storageTag, "storage");
+                    globalOnce(storageClass[dtype], "torch", storages[dtype]);
+                    w.unicode(std::to_string(key++));
+                    w.put(memo++);
+                    stringOnce(cpu, "cpu");
+                    w.integer(bias ? rows : rows * cols);
+                    w.op('t');
+                    w.put(memo++);
+                    w.op('Q'); // BINPERSID
+                    w.integer(0);
+                    if (bias) {
+                        w.integer(rows);
+                        w.op(0x85); // TUPLE1
+                        w.put(memo++);
+                        w.integer(1);
+                        w.op(0x85);
+                    } else {
+                        w.integer(rows);
+                        w.integer(cols);
+                        w.op(0x86); // TUPLE2
+                        w.put(memo++);
+                        w.integer(cols);
+                        w.integer(1);
+                        w.op(0x86);
+                    }
+                    w.put(memo++);
+                    w.op(0x89); // NEWFALSE
+                    globalOnce(orderedDict, "collections", "OrderedDict");
+                    w.op(')'); // EMPTY_TUPLE
+                    w.op('R'); // REDUCE
+                    w.put(memo++);
+                    w.op('t');
+                    w.put(memo++);
+                    w.op('R');
+                    w.put(memo++);
+                }
+            }
+        }
+        w.op('u');
+    }
+    w.op('u');
+    size_t ops = w.opcodes() + 1;
+    return {"state_dict", w.finish(), ops};
+}
+
+const std::vector<std::string>& generatorNames() {
+    static const std::vector<std::string> names = {"ints", "nested", "strings", "memo", "state_dict"};
+    return names;
+}
+
+GeneratedPickle generate(std::string_view name, double scale) {
+    if (name == "ints") return generateInts(scale);
+    if (name == "nested") return generateNested(scale);
+    if (name == "strings") return generateStrings(scale);
+    if (name == "memo") return generateMemo(scale);
+    if (name == "state_dict") return generateStateDict(scale);
+    throw std::invalid_argument("Unknown workload: " + std::string(name));
+}
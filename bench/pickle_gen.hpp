@@ -0,0 +1,56 @@
+#ifndef PICKLE_GEN_HPP
+#define PICKLE_GEN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Appends opcodes to an in-memory pickle, counting them as it goes. Only
+// opcodes PickleParser understands are emitted.
+class PickleWriter {
+public:
+    explicit PickleWriter(unsigned char protocol = 2);
+
+    void op(unsigned char opcode);
+    void mark() { op('('); }
+    void integer(int64_t value); // smallest of BININT1/BININT2/BININT/LONG1
+    void unicode(std::string_view text);
+    void unicode8(std::string_view text); // BINUNICODE8, for payloads past 4 GiB
+    void bytes(std::string_view data);
+    void global(std::string_view module, std::string_view name);
+    void put(uint32_t index); // BINPUT or LONG_BINPUT
+    void get(uint32_t index); // BINGET or LONG_BINGET
+
+    // Appends STOP and hands over the finished stream.
+    std::string finish();
+    size_t opcodes() const { return count; }
+
+private:
+    void raw(const void* data, size_t len) { out.append(static_cast<const char*>(data), len); }
+    void le(uint64_t value, size_t len);
+
+    std::string out;
+    size_t count = 0;
+};
+
+struct GeneratedPickle {
+    std::string name;
+    std::string bytes;
+    size_t opcodes;
+};
+
+// Deterministic synthetic workloads: the same scale always produces the
+// same bytes. scale 1 gives streams of roughly 10-130 MB.
+GeneratedPickle generateInts(double scale);       // one list of BININT/BINPUT pairs, APPENDS in batches
+GeneratedPickle generateNested(double scale);     // lists and dicts nested hundreds of thousands deep
+GeneratedPickle generateStrings(double scale);    // a few huge BINUNICODE8/BINBYTES payloads
+GeneratedPickle generateMemo(double scale);       // tuples built mostly from BINGET/LONG_BINGET
+GeneratedPickle generateStateDict(double scale);  // torch.save()-style state_dict of tensor reductions
+
+const std::vector<std::string>& generatorNames();
+// Throws std::invalid_argument for a name not in generatorNames().
+GeneratedPickle generate(std::string_view name, double scale);
+
+#endif // PICKLE_GEN_HPP
@@ -0,0 +1,71 @@
+#include "safetensors.hpp"
+#include "torch_checkpoint.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Converts a torch checkpoint into a safetensors file, once, so consumers
+// can mmap it instead of running the pickle VM at every start.
+static void usage() {
+    std::cerr << "Usage: libpickle-convert [--dtype float16|bfloat16|float32] [--select PATH]... [--skip-missing] "
+                 "CHECKPOINT OUT.safetensors\n"
+              << "CHECKPOINT is a .pt file or an extracted archive directory.\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> positional;
+    std::vector<std::string> select_paths;
+    SafetensorsOptions options;
+    bool skip_missing = false;
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--dtype" && a + 1 < argc) { // convert floating tensors while copying
+            std::string name = argv[++a];
+            for (TorchDType dtype : {TorchDType::Float16, TorchDType::BFloat16, TorchDType::Float32}) {
+                if (name == dtypeName(dtype)) options.convertTo = dtype;
+            }
+            if (!options.convertTo) {
+                usage();
+                return 2;
+            }
+        } else if (arg == "--select" && a + 1 < argc) { // convert only this dotted path (repeatable)
+            select_paths.push_back(argv[++a]);
+        } else if (arg == "--skip-missing") { // leave out tensors whose storage is absent from the archive
+            skip_missing = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2) {
+        usage();
+        return 2;
+    }
+
+    try {
+        TorchCheckpoint checkpoint(positional[0]);
+        checkpoint.select(select_paths);
+        checkpoint.load();
+        std::vector<TorchTensor> tensors;
+        for (const TorchTensor& t : checkpoint.tensors()) {
+            if (t.numel() > 0 && !t.data()) {
+                if (!skip_missing) {
+                    throw std::runtime_error("tensor '" + t.name + "': storage '" + t.storage->key +
+                                             "' is missing from the archive (see --skip-missing)");
+                }
+                std::cerr << "Skipping " << t.name << ": storage " << t.storage->key << " missing" << std::endl;
+                continue;
+            }
+            tensors.push_back(t);
+        }
+        uint64_t size = writeSafetensors(tensors, positional[1], options);
+        std::cout << tensors.size() << " tensors, " << size << " bytes -> " << positional[1] << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
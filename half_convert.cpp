@@ -0,0 +1,317 @@
+#include "half_convert.hpp"
+#include "torch_checkpoint.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HALF_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline uint32_t float_bits(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// ---- Portable scalar kernels ------------------------------------------------
+
+inline float half_to_float(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1fu;
+    uint32_t mant = h & 0x3ffu;
+    if (exp == 0x1f) { // inf, or NaN returned quiet as the F16C instructions do
+        return bits_float(sign | 0x7f800000u | (mant << 13) | (mant ? 0x400000u : 0u));
+    }
+    if (exp != 0) return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+    if (mant == 0) return bits_float(sign);
+    // Subnormal half: renormalise into a float exponent.
+    exp = 113;
+    while (!(mant & 0x400u)) {
+        mant <<= 1;
+        --exp;
+    }
+    return bits_float(sign | (exp << 23) | ((mant & 0x3ffu) << 13));
+}
+
+inline uint16_t float_to_half(float f) {
+    uint32_t x = float_bits(f);
+    uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000u);
+    uint32_t absx = x & 0x7fffffffu;
+    if (absx > 0x7f800000u) return sign | 0x7e00u | ((absx >> 13) & 0x3ffu); // quiet NaN
+    if (absx >= 0x477ff000u) return sign | 0x7c00u; // rounds to >= 65520: inf
+    if (absx >= 0x38800000u) {
+        // Normal half: rebias, then round the 13 dropped bits to nearest even.
+        uint32_t v = absx - 0x38000000u;
+        v += 0xfffu + ((v >> 13) & 1u);
+        return sign | static_cast<uint16_t>(v >> 13);
+    }
+    if (absx < 0x33000000u) return sign; // below half the smallest subnormal
+    // Subnormal half: shift the full significand into place with rounding.
+    uint32_t exp = absx >> 23;
+    uint32_t mant = (absx & 0x7fffffu) | 0x800000u;
+    uint32_t shift = 126 - exp;
+    uint32_t half = 1u << (shift - 1);
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t v = mant >> shift;
+    if (rem > half || (rem == half && (v & 1u))) ++v;
+    return sign | static_cast<uint16_t>(v);
+}
+
+inline float bfloat16_to_float(uint16_t b) {
+    return bits_float(static_cast<uint32_t>(b) << 16);
+}
+
+inline uint16_t float_to_bfloat16(float f) {
+    uint32_t x = float_bits(f);
+    if ((x & 0x7fffffffu) > 0x7f800000u) return static_cast<uint16_t>((x >> 16) | 0x40u); // quiet NaN
+    x += 0x7fffu + ((x >> 16) & 1u);
+    return static_cast<uint16_t>(x >> 16);
+}
+
+void half_to_float_scalar(const uint16_t* src, float* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) dst[i] = half_to_float(src[i]);
+}
+
+void bfloat16_to_float_scalar(const uint16_t* src, float* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) dst[i] = bfloat16_to_float(src[i]);
+}
+
+void float_to_half_scalar(const float* src, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) dst[i] = float_to_half(src[i]);
+}
+
+void float_to_bfloat16_scalar(const float* src, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) dst[i] = float_to_bfloat16(src[i]);
+}
+
+#ifdef HALF_CONVERT_X86
+
+// ---- AVX2 + F16C kernels: 8 lanes, scalar tail -----------------------------
+
+__attribute__((target("avx2,f16c"))) void half_to_float_avx2(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    half_to_float_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2,f16c"))) void float_to_half_avx2(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    float_to_half_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) void bfloat16_to_float_avx2(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256i w = _mm256_slli_epi32(_mm256_cvtepu16_epi32(b), 16);
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(w));
+    }
+    bfloat16_to_float_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) void float_to_bfloat16_avx2(const float* src, uint16_t* dst, size_t n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i round = _mm256_set1_epi32(0x7fff);
+    const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+    const __m256i inf = _mm256_set1_epi32(0x7f800000);
+    const __m256i quiet = _mm256_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+        __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(round, lsb)), 16);
+        __m256i nan = _mm256_or_si256(_mm256_srli_epi32(x, 16), quiet);
+        __m256i is_nan = _mm256_cmpgt_epi32(_mm256_and_si256(x, abs_mask), inf);
+        __m256i r = _mm256_blendv_epi8(rounded, nan, is_nan);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+    float_to_bfloat16_scalar(src + i, dst + i, n - i);
+}
+
+// ---- AVX-512 kernels: 16 lanes, scalar tail --------------------------------
+
+__attribute__((target("avx512f"))) void half_to_float_avx512(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+    }
+    half_to_float_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void float_to_half_avx512(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+    }
+    float_to_half_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void bfloat16_to_float_avx512(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m512i w = _mm512_slli_epi32(_mm512_cvtepu16_epi32(b), 16);
+        _mm512_storeu_ps(dst + i, _mm512_castsi512_ps(w));
+    }
+    bfloat16_to_float_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void float_to_bfloat16_avx512(const float* src, uint16_t* dst, size_t n) {
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i round = _mm512_set1_epi32(0x7fff);
+    const __m512i abs_mask = _mm512_set1_epi32(0x7fffffff);
+    const __m512i inf = _mm512_set1_epi32(0x7f800000);
+    const __m512i quiet = _mm512_set1_epi32(0x40);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512(src + i);
+        __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(x, 16), one);
+        __m512i rounded = _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_add_epi32(round, lsb)), 16);
+        __m512i nan = _mm512_or_si512(_mm512_srli_epi32(x, 16), quiet);
+        __mmask16 is_nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(x, abs_mask), inf);
+        __m512i r = _mm512_mask_blend_epi32(is_nan, rounded, nan);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtepi32_epi16(r));
+    }
+    float_to_bfloat16_scalar(src + i, dst + i, n - i);
+}
+
+#endif // HALF_CONVERT_X86
+
+struct Kernels {
+    void (*halfToFloat)(const uint16_t*, float*, size_t);
+    void (*bfloat16ToFloat)(const uint16_t*, float*, size_t);
+    void (*floatToHalf)(const float*, uint16_t*, size_t);
+    void (*floatToBFloat16)(const float*, uint16_t*, size_t);
+    const char* name;
+};
+
+// Every kernel set this CPU can run, widest first.
+std::vector<Kernels> supported_kernels() {
+    std::vector<Kernels> sets;
+#ifdef HALF_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        sets.push_back({half_to_float_avx512, bfloat16_to_float_avx512, float_to_half_avx512,
+                        float_to_bfloat16_avx512, "avx512"});
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        sets.push_back({half_to_float_avx2, bfloat16_to_float_avx2, float_to_half_avx2, float_to_bfloat16_avx2,
+                        "avx2"});
+    }
+#endif
+    sets.push_back({half_to_float_scalar, bfloat16_to_float_scalar, float_to_half_scalar, float_to_bfloat16_scalar,
+                    "scalar"});
+    return sets;
+}
+
+Kernels& kernels() {
+    static Kernels selected = supported_kernels().front();
+    return selected;
+}
+
+// Converts n elements of a 2- or 4-byte float type at src into dst.
+void convert_run(TorchDType dtype, const char* src, float* dst, size_t n) {
+    switch (dtype) {
+    case TorchDType::Float16:
+        kernels().halfToFloat(reinterpret_cast<const uint16_t*>(src), dst, n);
+        return;
+    case TorchDType::BFloat16:
+        kernels().bfloat16ToFloat(reinterpret_cast<const uint16_t*>(src), dst, n);
+        return;
+    case TorchDType::Float32:
+        std::memcpy(dst, src, n * sizeof(float));
+        return;
+    default:
+        throw std::runtime_error(std::string("convertToFloat32: unsupported dtype ") + dtypeName(dtype));
+    }
+}
+
+} // namespace
+
+void halfToFloat(const uint16_t* src, float* dst, size_t n) { kernels().halfToFloat(src, dst, n); }
+void bfloat16ToFloat(const uint16_t* src, float* dst, size_t n) { kernels().bfloat16ToFloat(src, dst, n); }
+void floatToHalf(const float* src, uint16_t* dst, size_t n) { kernels().floatToHalf(src, dst, n); }
+void floatToBFloat16(const float* src, uint16_t* dst, size_t n) { kernels().floatToBFloat16(src, dst, n); }
+const char* halfConvertKernel() { return kernels().name; }
+
+bool useHalfConvertKernel(const char* name) {
+    for (const Kernels& set : supported_kernels()) {
+        if (std::strcmp(set.name, name) == 0) {
+            kernels() = set;
+            return true;
+        }
+    }
+    return false;
+}
+
+void convertToFloat32(const TorchStorage& storage, float* dst) {
+    if (storage.bytes.empty() && storage.numel) {
+        throw std::runtime_error("convertToFloat32: storage '" + storage.key + "' is not loaded");
+    }
+    convert_run(storage.dtype, storage.bytes.data(), dst, storage.numel);
+}
+
+void convertToFloat32(const TorchTensor& tensor, float* dst) {
+    size_t n = tensor.numel();
+    if (n == 0) return;
+    const char* base = static_cast<const char*>(tensor.data());
+    if (!base) throw std::runtime_error("convertToFloat32: tensor '" + tensor.name + "' has no data");
+    size_t rank = tensor.shape.size();
+    size_t elem = dtypeSize(tensor.dtype);
+
+    // Collapse to rows along the innermost dimension; a contiguous tensor
+    // is then a single run converted straight out of the mapping.
+    bool contiguous = true;
+    int64_t expect = 1;
+    for (size_t d = rank; d-- > 0;) {
+        if (tensor.shape[d] != 1 && tensor.stride[d] != expect) contiguous = false;
+        expect *= tensor.shape[d];
+    }
+    if (contiguous || rank == 0) {
+        convert_run(tensor.dtype, base, dst, n);
+        return;
+    }
+
+    size_t inner = static_cast<size_t>(tensor.shape[rank - 1]);
+    int64_t inner_stride = tensor.stride[rank - 1];
+    std::vector<int64_t> index(rank - 1, 0);
+    size_t rows = n / inner;
+    for (size_t r = 0; r < rows; ++r) {
+        int64_t offset = 0;
+        for (size_t d = 0; d + 1 < rank; ++d) offset += index[d] * tensor.stride[d];
+        const char* row = base + offset * static_cast<int64_t>(elem);
+        float* out = dst + r * inner;
+        if (inner_stride == 1) {
+            convert_run(tensor.dtype, row, out, inner);
+        } else {
+            for (size_t k = 0; k < inner; ++k) {
+                convert_run(tensor.dtype, row + static_cast<int64_t>(k) * inner_stride * static_cast<int64_t>(elem),
+                            out + k, 1);
+            }
+        }
+        for (size_t d = rank - 1; d-- > 0;) { // odometer over the outer dims
+            if (++index[d] < tensor.shape[d]) break;
+            index[d] = 0;
+        }
+    }
+}
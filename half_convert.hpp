@@ -0,0 +1,32 @@
+#ifndef HALF_CONVERT_HPP
+#define HALF_CONVERT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+struct TorchStorage;
+struct TorchTensor;
+
+// Bulk conversions between 16-bit floats and float32. Each call picks the
+// widest kernel the running CPU supports (AVX-512, AVX2+F16C, or portable
+// scalar code) on first use; all paths give bit-identical results, with
+// round-to-nearest-even when narrowing and NaNs kept quiet.
+void halfToFloat(const uint16_t* src, float* dst, size_t n);
+void bfloat16ToFloat(const uint16_t* src, float* dst, size_t n);
+void floatToHalf(const float* src, uint16_t* dst, size_t n);
+void floatToBFloat16(const float* src, uint16_t* dst, size_t n);
+
+// Name of the kernel set selected for this CPU ("avx512", "avx2", "scalar").
+const char* halfConvertKernel();
+// Switches every conversion to the named kernel set, to compare them or to
+// pin the portable one. Returns false, changing nothing, if this CPU cannot
+// run it. Not safe while conversions run on other threads.
+bool useHalfConvertKernel(const char* name);
+
+// Converts a Float16/BFloat16/Float32 tensor straight from its storage
+// mapping into dst (numel() floats, row-major). Strided views are gathered.
+void convertToFloat32(const TorchTensor& tensor, float* dst);
+// Converts a whole Float16/BFloat16/Float32 storage into dst (numel floats).
+void convertToFloat32(const TorchStorage& storage, float* dst);
+
+#endif // HALF_CONVERT_HPP
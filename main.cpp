@@ -1,21 +1,240 @@
 #include "pickle.hpp"
+#include "pickle_opcodes.hpp"
+#include "pickle_stats.hpp"
+#include "pickle_tape.hpp"
+#include "thread_pool.hpp"
+#include "torch_checkpoint.hpp"
+#include "torch_loader.hpp"
+#include "zip_archive.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string> // Required for std::string
+#include <vector>
+
+static void printValue(std::ostream& out, const PickleValue* v, int indent);
+
+// The items of a list, tuple or set, comma-separated.
+static void printItems(std::ostream& out, const PickleValue* v, int indent) {
+    for (size_t k = 0; k < v->size(); ++k) {
+        if (k) out << ", ";
+        printValue(out, (*v)[k], indent);
+    }
+}
+
+// Python-like rendering of a decoded value; dict entries go one per line.
+static void printValue(std::ostream& out, const PickleValue* v, int indent) {
+    switch (v->type) {
+    case PickleType::None: out << "None"; break;
+    case PickleType::Bool: out << (v->b ? "True" : "False"); break;
+    case PickleType::Int: out << v->i; break;
+    case PickleType::Float: out << pythonFloatRepr(v->f); break;
+    case PickleType::Str: out << "'" << v->string().substr(0, 80) << (v->str.len > 80 ? "...'" : "'"); break;
+    case PickleType::Bytes: out << "<" << v->str.len << " bytes>"; break;
+    case PickleType::ByteArray: out << "bytearray(<" << v->str.len << " bytes>)"; break;
+    case PickleType::Buffer: out << "<out-of-band buffer, " << v->str.len << " bytes>"; break;
+    case PickleType::Global: out << v->module() << "." << v->name(); break;
+    case PickleType::PersId: out << "persid"; printValue(out, v->pid, indent); break;
+    case PickleType::Reduce:
+        printValue(out, v->reduce.callable, indent);
+        if (v->reduce.args->type == PickleType::Tuple) { // a call: f(x), not f(x,)
+            out << "(";
+            printItems(out, v->reduce.args, indent);
+            out << ")";
+        } else {
+            printValue(out, v->reduce.args, indent);
+        }
+        break;
+    case PickleType::List:
+        out << "[";
+        printItems(out, v, indent);
+        out << "]";
+        break;
+    case PickleType::Tuple:
+        out << "(";
+        printItems(out, v, indent);
+        out << (v->size() == 1 ? ",)" : ")"); // (x,): without the comma it is just x
+        break;
+    case PickleType::Set:
+    case PickleType::FrozenSet:
+        out << (v->type == PickleType::Set ? "{" : "frozenset({");
+        printItems(out, v, indent);
+        out << (v->type == PickleType::Set ? "}" : "})");
+        break;
+    case PickleType::Dict:
+        out << "{";
+        for (uint32_t e = 0; e < v->dict.size; ++e) {
+            out << "\n" << std::string(indent + 2, ' ');
+            printValue(out, v->dict.entries[e].key, indent + 2);
+            out << ": ";
+            printValue(out, v->dict.entries[e].value, indent + 2);
+            if (e + 1 < v->dict.size) out << ",";
+        }
+        out << (v->dict.size ? "\n" + std::string(indent, ' ') : "") << "}";
+        break;
+    }
+}
+
+static void printTensor(std::ostream& out, const TorchTensor& t) {
+    out << t.name << ": " << dtypeName(t.dtype) << " [";
+    for (size_t d = 0; d < t.shape.size(); ++d) out << (d ? ", " : "") << t.shape[d];
+    out << "] storage " << t.storage->key << " +" << t.storageOffset << (t.data() ? "" : " (missing)");
+}
+
+// Prints one tensor as soon as its bytes are in, with the time since the
+// load started.
+static TorchTask printWhenLoaded(TorchLoader& loader, std::string name, std::mutex& out_lock,
+                                 std::chrono::steady_clock::time_point start) {
+    const TorchTensor& t = co_await loader.tensor(name);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> guard(out_lock);
+    printTensor(std::cout, t);
+    std::cout << " after " << std::fixed << std::setprecision(1) << ms << " ms" << std::endl;
+}
 
 int main(int argc, char* argv[]) { // Added argc, argv for flexibility
     std::string pickle_file_path = "archive/data.pkl"; // Default path
+    PickleParser::InputMode mode = PickleParser::InputMode::Read;
+    bool list_tensors = false;
+    bool print_tree = false;
+    bool print_tape = false;
+    bool use_index = false;
+    bool print_stats = false;
+    size_t jobs = 1;
+    std::vector<std::string> select_paths;
+    std::vector<std::string> buffer_paths;
+    std::vector<std::string> await_names;
 
-    if (argc > 1) { // Allow specifying file path via command line
-        pickle_file_path = argv[1];
+    for (int a = 1; a < argc; ++a) { // Allow specifying file path via command line
+        std::string arg = argv[a];
+        if (arg == "--mmap") {
+            mode = PickleParser::InputMode::Mmap;
+        } else if (arg == "--tensors") { // treat the path as a torch checkpoint (.pt or extracted data.pkl)
+            list_tensors = true;
+        } else if (arg == "--index") { // with --tensors: reuse or write the sidecar .idx next to the checkpoint
+            use_index = true;
+        } else if (arg == "-j" && a + 1 < argc) { // load storages on a pool of this many threads
+            jobs = std::stoul(argv[++a]);
+        } else if (arg == "--await" && a + 1 < argc) { // with --tensors: print this tensor once loaded (repeatable)
+            await_names.push_back(argv[++a]);
+        } else if (arg == "--tree") { // print the decoded object instead of disassembling
+            print_tree = true;
+        } else if (arg == "--tape") { // print the opcode tape: index, offset, opcode, argument bytes, match
+            print_tape = true;
+        } else if (arg == "--stats") { // decode the tree and print a per-opcode profile as JSON
+            print_stats = true;
+        } else if (arg == "--select" && a + 1 < argc) { // decode only this dotted path (repeatable)
+            select_paths.push_back(argv[++a]);
+        } else if (arg == "--buffer" && a + 1 < argc) { // next protocol 5 out-of-band buffer (repeatable)
+            buffer_paths.push_back(argv[++a]);
+        } else {
+            pickle_file_path = arg;
+        }
     }
-    std::cout << "Attempting to parse: " << pickle_file_path << std::endl;
+    // Keep stdout pure JSON under --stats.
+    std::ostream& log = print_stats ? std::cerr : std::cout;
+    log << "Attempting to parse: " << pickle_file_path << std::endl;
 
     try {
-        PickleParser parser(pickle_file_path);
-        parser.pickleOpener();
+        if (list_tensors) {
+            std::string checkpoint_path = pickle_file_path;
+            size_t slash = pickle_file_path.find_last_of('/');
+            if (pickle_file_path.compare(slash == std::string::npos ? 0 : slash + 1, std::string::npos, "data.pkl") == 0) {
+                checkpoint_path = slash == std::string::npos ? "." : pickle_file_path.substr(0, slash);
+            }
+            TorchCheckpoint checkpoint(checkpoint_path);
+            checkpoint.select(select_paths);
+            if (use_index) checkpoint.useIndex();
+            if (!await_names.empty()) {
+                ThreadPool pool(jobs);
+                std::mutex out_lock;
+                auto start = std::chrono::steady_clock::now();
+                TorchLoader loader(checkpoint, pool);
+                std::vector<TorchTask> tasks;
+                for (const std::string& name : await_names) {
+                    tasks.push_back(printWhenLoaded(loader, name, out_lock, start));
+                }
+                for (TorchTask& task : tasks) task.get();
+                return 0;
+            }
+            if (jobs > 1) {
+                ThreadPool pool(jobs);
+                checkpoint.load(pool);
+                checkpoint.wait();
+            } else {
+                checkpoint.load();
+            }
+            for (const TorchTensor& t : checkpoint.tensors()) {
+                printTensor(std::cout, t);
+                std::cout << std::endl;
+            }
+            return 0;
+        }
+        // A .pt file is a zip; look at the data.pkl inside it.
+        char magic[4] = {};
+        std::ifstream(pickle_file_path, std::ios::binary).read(magic, sizeof(magic));
+        std::unique_ptr<ZipArchive> zip;
+        std::vector<char> inflated;
+        std::unique_ptr<PickleParser> opened;
+        if (std::string_view(magic, sizeof(magic)) == std::string_view("PK\x03\x04", 4)) {
+            zip = std::make_unique<ZipArchive>(pickle_file_path);
+            const ZipEntry* pkl = nullptr;
+            for (const ZipEntry& e : zip->entries()) {
+                if (e.name.size() >= 9 && e.name.compare(e.name.size() - 9, 9, "/data.pkl") == 0) pkl = &e;
+            }
+            if (!pkl) throw std::runtime_error("no data.pkl in " + pickle_file_path);
+            std::string_view bytes;
+            if (pkl->stored()) {
+                bytes = zip->view(*pkl);
+            } else {
+                inflated = zip->extract(*pkl);
+                bytes = std::string_view(inflated.data(), inflated.size());
+            }
+            opened = std::make_unique<PickleParser>(bytes.data(), bytes.size());
+        } else {
+            opened = std::make_unique<PickleParser>(pickle_file_path);
+        }
+        PickleParser& parser = *opened;
+        std::vector<MappedFile> buffer_files;
+        std::vector<std::string_view> buffers;
+        for (const std::string& path : buffer_paths) {
+            buffer_files.emplace_back(path);
+            buffers.emplace_back(buffer_files.back().data(), buffer_files.back().size());
+        }
+        parser.setBuffers(std::move(buffers));
+        parser.pickleOpener(mode);
         parser.setParsers();
-        parser.parsePickle();
-        std::cout << "Pickle parsing finished." << std::endl;
+        log << "Pickle version: " << parser.protocol() << std::endl;
+        if (print_stats) {
+            if (!PickleParser::kStatsCompiled) throw std::runtime_error("--stats needs a build with PICKLE_STATS");
+            PickleStats stats;
+            parser.selectPaths(select_paths);
+            parser.setStats(&stats);
+            parser.parsePickle();
+            parser.setStats(nullptr);
+            stats.writeJson(std::cout);
+        } else if (print_tape) {
+            PickleTape tape(parser.input());
+            for (size_t k = 0; k < tape.size(); ++k) {
+                std::cout << std::setw(8) << k << std::setw(10) << tape[k].offset << "  " << std::left
+                          << std::setw(16) << kPickleOps[tape[k].opcode].name << std::right << tape.argLength(k);
+                if (tape[k].match != PickleTape::kNoMatch) std::cout << " -> " << tape[k].match;
+                std::cout << '\n';
+            }
+            std::cout << tape.size() << " opcodes, MARK depth " << tape.maxDepth() << std::endl;
+        } else if (print_tree || !select_paths.empty()) {
+            parser.selectPaths(select_paths);
+            parser.parsePickle();
+            printValue(std::cout, parser.root(), 0);
+            std::cout << std::endl;
+        } else {
+            PickleDisassembler disassembler(std::cout);
+            parser.parsePickle(disassembler);
+        }
+        log << "Pickle parsing finished." << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,85 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path, unsigned advice) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + path + ": " + std::strerror(err));
+    }
+    mapSize = static_cast<size_t>(st.st_size);
+    if (mapSize > 0) {
+        void* p = ::mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            int err = errno;
+            ::close(fd);
+            mapSize = 0;
+            throw std::runtime_error("Failed to mmap file: " + path + ": " + std::strerror(err));
+        }
+        mapData = static_cast<const char*>(p);
+    }
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    advise(advice);
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : mapData(other.mapData), mapSize(other.mapSize) {
+    other.mapData = nullptr;
+    other.mapSize = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        mapData = other.mapData;
+        mapSize = other.mapSize;
+        other.mapData = nullptr;
+        other.mapSize = 0;
+    }
+    return *this;
+}
+
+void MappedFile::advise(unsigned advice, size_t offset, size_t len) const {
+    if (mapData == nullptr || offset >= mapSize || advice == AdviseNone) return;
+    // madvise() wants a page-aligned start; widen the range down to one.
+    static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t start = offset & ~(page - 1);
+    size_t end = (len > mapSize - offset) ? mapSize : offset + len;
+    void* addr = const_cast<char*>(mapData) + start;
+    // Hints only: a kernel that rejects them still serves the mapping.
+    if (advice & AdviseSequential) ::madvise(addr, end - start, MADV_SEQUENTIAL);
+    if (advice & AdviseWillNeed) ::madvise(addr, end - start, MADV_WILLNEED);
+}
+
+void MappedFile::prefault(size_t offset, size_t len) const {
+    if (mapData == nullptr || offset >= mapSize) return;
+    static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t end = (len > mapSize - offset) ? mapSize : offset + len;
+    const volatile char* bytes = mapData;
+    char sink = 0;
+    for (size_t p = offset; p < end; p += page) sink ^= bytes[p];
+    (void)sink;
+}
+
+void MappedFile::unmap() {
+    if (mapData != nullptr) {
+        ::munmap(const_cast<char*>(mapData), mapSize);
+        mapData = nullptr;
+        mapSize = 0;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+// Read-only mmap of a whole file. Move-only; unmaps on destruction.
+class MappedFile {
+public:
+    enum Advice : unsigned {
+        AdviseNone = 0,
+        AdviseSequential = 1 << 0, // MADV_SEQUENTIAL: aggressive read-ahead, early reclaim
+        AdviseWillNeed = 1 << 1,   // MADV_WILLNEED: start paging the file in now
+    };
+
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path, unsigned advice = AdviseNone);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return mapData; }
+    size_t size() const { return mapSize; }
+    bool empty() const { return mapSize == 0; }
+
+    // Applies madvise() hints to [offset, offset + len) of the mapping.
+    void advise(unsigned advice, size_t offset = 0, size_t len = static_cast<size_t>(-1)) const;
+    // Touches one byte per page of [offset, offset + len) so the range is
+    // resident when this returns.
+    void prefault(size_t offset = 0, size_t len = static_cast<size_t>(-1)) const;
+
+private:
+    void unmap();
+
+    const char* mapData = nullptr;
+    size_t mapSize = 0;
+};
+
+#endif // MAPPED_FILE_HPP
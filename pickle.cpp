@@ -1,11 +1,140 @@
 #include "pickle.hpp"
+#include "pickle_opcodes.hpp"
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm> // For std::min (not directly used currently but good include for parsers)
 #include <iomanip>   // For std::hex in error messages
+#include <sstream>
 
-PickleParser::PickleParser(const std::string& fname) : sPickleFileName(fname), cPickleVersion(0), size(0) {}
+namespace {
+
+// Decimal integer as the text opcodes write it: optional sign, digits,
+// nothing else.
+std::errc parse_decimal(std::string_view text, int64_t& value) {
+    if (text.size() > 1 && text.front() == '+' && text[1] != '-') text.remove_prefix(1);
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec == std::errc() && end != text.data() + text.size()) return std::errc::invalid_argument;
+    return ec;
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// True if text holds a backslash or a byte >= 0x80, i.e. anything a
+// raw-unicode-escape decode would change. Eight bytes per step: a
+// backslash is a zero byte of w ^ 0x5c5c..., whose high bit the borrow of
+// the subtraction sets; a false positive can only follow a true one.
+bool has_escape_or_high(const char* p, size_t n) {
+    constexpr uint64_t kOnes = 0x0101010101010101ULL;
+    constexpr uint64_t kHigh = 0x8080808080808080ULL;
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + k, 8);
+        uint64_t x = w ^ (kOnes * '\\');
+        if ((w | ((x - kOnes) & ~x)) & kHigh) return true;
+    }
+    for (; k < n; ++k) {
+        if (p[k] == '\\' || static_cast<unsigned char>(p[k]) >= 0x80) return true;
+    }
+    return false;
+}
+
+char* put_utf8(char* out, uint32_t cp) {
+    if (cp < 0x80) {
+        *out++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<char>(0xc0 | cp >> 6);
+        *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<char>(0xe0 | cp >> 12);
+        *out++ = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        *out++ = static_cast<char>(0xf0 | cp >> 18);
+        *out++ = static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+        *out++ = static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+    }
+    return out;
+}
+
+// Bytes at the front of `data` that complete the opcode carried in `tail`
+// (its opcode byte and whatever argument bytes came with it), or
+// kPickleArgIncomplete if all `len` of them are still not enough. An
+// unknown opcode needs none: running it reports the error.
+size_t bytes_to_complete(std::string_view tail, const char* data, size_t len) {
+    const PickleOpInfo& op = kPickleOps[static_cast<unsigned char>(tail[0])];
+    if (!op.name) return 0;
+    size_t have = tail.size() - 1;
+    if (op.arg == PickleArg::Line || op.arg == PickleArg::Line2) {
+        size_t lines = (op.arg == PickleArg::Line2 ? 2 : 1) -
+                       static_cast<size_t>(std::count(tail.begin() + 1, tail.end(), '\n'));
+        size_t n = 0;
+        for (; lines > 0; --lines) {
+            const void* nl = std::memchr(data + n, '\n', len - n);
+            if (!nl) return kPickleArgIncomplete;
+            n = static_cast<size_t>(static_cast<const char*>(nl) - data) + 1;
+        }
+        return n;
+    }
+    // Fixed width or length-prefixed: only the first (up to) eight argument
+    // bytes decide the length, so those are stitched together and measured
+    // as if the whole of tail + data were contiguous.
+    char head[8] = {};
+    size_t from_tail = std::min(have, sizeof(head));
+    std::memcpy(head, tail.data() + 1, from_tail);
+    std::memcpy(head + from_tail, data, std::min(len, sizeof(head) - from_tail));
+    size_t arg = pickleArgLength(head, have + len, op.arg);
+    if (arg == kPickleArgIncomplete) return kPickleArgIncomplete;
+    return arg > have ? arg - have : 0;
+}
+
+// Hash of a key, consistent with PickleValue::sameKey() (True and 1 hash
+// alike); never 0. Keys it only matches by identity hash their address.
+uint64_t key_hash(const PickleValue* key) {
+    uint64_t h;
+    switch (key->type) {
+    case PickleType::Str:
+    case PickleType::Bytes:
+        h = PickleInternTable::hashOf(key->string());
+        break;
+    case PickleType::Int:
+    case PickleType::Bool: {
+        int64_t x = key->type == PickleType::Int ? key->i : key->b;
+        h = PickleInternTable::hashOf(std::string_view(reinterpret_cast<const char*>(&x), sizeof(x)));
+        break;
+    }
+    case PickleType::None:
+        h = 1;
+        break;
+    default:
+        h = PickleInternTable::hashOf(std::string_view(reinterpret_cast<const char*>(&key), sizeof(key)));
+        break;
+    }
+    return h ? h : 1;
+}
+
+} // namespace
+
+PickleParser::PickleParser()
+    : externalBuff(true), cPickleVersion(0), size(0), rootValue(nullptr), stopped(false) {}
+
+PickleParser::PickleParser(const std::string& fname)
+    : externalBuff(false), cPickleVersion(0), sPickleFileName(fname), size(0), rootValue(nullptr), stopped(false) {}
+
+PickleParser::PickleParser(const char* data, size_t len)
+    : buff(data, len), externalBuff(true), cPickleVersion(0), size(static_cast<std::streamsize>(len)),
+      rootValue(nullptr), stopped(false) {}
 
 uint32_t PickleParser::read_le32(const char* data) const {
     const unsigned char* udata = reinterpret_cast<const unsigned char*>(data);
@@ -21,17 +150,24 @@ uint16_t PickleParser::read_le16(const char* data) const {
            (static_cast<uint16_t>(udata[1]) << 8);
 }
 
-int64_t PickleParser::decode_signed_long(const unsigned char* bytes, size_t len) const {
+uint64_t PickleParser::read_le64(const char* data) const {
+    return static_cast<uint64_t>(read_le32(data)) | (static_cast<uint64_t>(read_le32(data + 4)) << 32);
+}
+
+// Little-endian two's complement, as LONG1/LONG4 store it. Encodings
+// longer than 8 bytes are fine as long as the extra bytes only extend the
+// sign; a value that really needs them throws, like an oversized text LONG.
+int64_t PickleParser::decode_signed_long(const unsigned char* bytes, size_t len, const char* op) const {
     if (len == 0) {
         return 0LL;
     }
-    
-    size_t readable_len = len;
-    if (len > sizeof(int64_t)) {
-         std::cerr << "Warning: LONG integer with original length " << len 
-                   << " exceeds int64_t capacity. Processing max " << sizeof(int64_t) 
-                   << " bytes. Potential truncation/misinterpretation." << std::endl;
-         readable_len = sizeof(int64_t); 
+    size_t readable_len = std::min(len, sizeof(int64_t));
+    unsigned char fill = (bytes[readable_len - 1] & 0x80) ? 0xff : 0x00;
+    for (size_t i = readable_len; i < len; ++i) {
+        if (bytes[i] != fill) {
+            throw std::runtime_error(std::string(op) + ": integer out of int64 range (" + std::to_string(len) +
+                                     " bytes)");
+        }
     }
 
     uint64_t u_val = 0;
@@ -40,430 +176,1036 @@ int64_t PickleParser::decode_signed_long(const unsigned char* bytes, size_t len)
     }
 
     // Sign extension if the most significant bit of the actual 'readable_len'-byte number is set
-    if (readable_len > 0 && (bytes[readable_len - 1] & 0x80)) {
-        if (readable_len < sizeof(int64_t)) {
-            // Create a mask to set all bits from (readable_len * 8) upwards to 1
-            uint64_t sign_extension_mask = ~((1ULL << (readable_len * 8)) - 1);
-            u_val |= sign_extension_mask;
-        }
-        // If readable_len == sizeof(int64_t) and MSB is set, u_val (when cast to int64_t) will be negative.
+    if (fill && readable_len < sizeof(int64_t)) {
+        // Create a mask to set all bits from (readable_len * 8) upwards to 1
+        uint64_t sign_extension_mask = ~((1ULL << (readable_len * 8)) - 1);
+        u_val |= sign_extension_mask;
     }
     return static_cast<int64_t>(u_val);
 }
 
+// The argument line at data, without its '\n'.
+std::string_view PickleParser::textLine(const char* data, const char* op) const {
+    size_t offset = data - buff.data();
+    const void* nl = offset < buff.size() ? std::memchr(data, '\n', buff.size() - offset) : nullptr;
+    if (!nl) throw PickleTruncated(std::string(op) + ": No newline or buffer exhausted");
+    return std::string_view(data, static_cast<const char*>(nl) - data);
+}
 
-void PickleParser::pickleOpener() {
-    std::ifstream file(sPickleFileName, std::ios_base::binary | std::ios_base::ate);
-    if (!file) {
-        throw std::runtime_error("Cannot open file: " + sPickleFileName);
+int64_t PickleParser::parseTextInt(std::string_view text, const char* op) const {
+    int64_t value = 0;
+    std::errc ec = parse_decimal(text, value);
+    if (ec == std::errc::result_out_of_range) {
+        throw std::runtime_error(std::string(op) + ": integer out of int64 range '" + std::string(text) + "'");
     }
-    size = file.tellg();
-    if (size < 0) { 
-        file.close();
-        throw std::runtime_error("Failed to get file size or empty file: " + sPickleFileName);
+    if (ec != std::errc()) throw std::runtime_error(std::string(op) + ": invalid integer '" + std::string(text) + "'");
+    return value;
+}
+
+size_t PickleParser::parseTextIndex(std::string_view text, const char* op) const {
+    int64_t value = 0;
+    if (parse_decimal(text, value) != std::errc() || value < 0) {
+        throw std::runtime_error(std::string(op) + ": invalid memo index '" + std::string(text) + "'");
+    }
+    return static_cast<size_t>(value);
+}
+
+double PickleParser::parseTextFloat(std::string_view text, const char* op) const {
+    std::string_view digits = text;
+    if (!digits.empty() && digits.front() == '+') digits.remove_prefix(1);
+    double value = 0;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    // Out of range still rounds the way Python's float() does: to 0 or inf.
+    if ((ec != std::errc() && ec != std::errc::result_out_of_range) || end != digits.data() + digits.size() ||
+        digits.empty()) {
+        throw std::runtime_error(std::string(op) + ": invalid float '" + std::string(text) + "'");
+    }
+    if (ec == std::errc::result_out_of_range) value = std::strtod(std::string(digits).c_str(), nullptr);
+    return value;
+}
+
+// STRING's quoted text with Python's string escapes resolved (\n, \x7f,
+// \177, ...). Text without a backslash is returned as is, viewing the
+// input; otherwise it is decoded into the arena.
+std::string_view PickleParser::unescapeString(std::string_view text, const char* op) {
+    if (!std::memchr(text.data(), '\\', text.size())) return text;
+    char* out = static_cast<char*>(arena.allocate(text.size(), 1));
+    char* o = out;
+    for (size_t k = 0; k < text.size(); ++k) {
+        char c = text[k];
+        if (c != '\\') {
+            *o++ = c;
+            continue;
+        }
+        if (++k == text.size()) throw std::runtime_error(std::string(op) + ": trailing \\ in string");
+        c = text[k];
+        switch (c) {
+        case 'a': *o++ = '\a'; break;
+        case 'b': *o++ = '\b'; break;
+        case 'f': *o++ = '\f'; break;
+        case 'n': *o++ = '\n'; break;
+        case 'r': *o++ = '\r'; break;
+        case 't': *o++ = '\t'; break;
+        case 'v': *o++ = '\v'; break;
+        case '\\': case '\'': case '"': *o++ = c; break;
+        case 'x': {
+            int hi = k + 2 < text.size() ? hex_digit(text[k + 1]) : -1;
+            int lo = hi >= 0 ? hex_digit(text[k + 2]) : -1;
+            if (lo < 0) throw std::runtime_error(std::string(op) + ": invalid \\x escape");
+            *o++ = static_cast<char>(hi << 4 | lo);
+            k += 2;
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7') {
+                unsigned value = static_cast<unsigned>(c - '0');
+                for (int d = 0; d < 2 && k + 1 < text.size() && text[k + 1] >= '0' && text[k + 1] <= '7'; ++d) {
+                    value = value * 8 + static_cast<unsigned>(text[++k] - '0');
+                }
+                *o++ = static_cast<char>(value & 0xff);
+            } else { // not an escape: both characters are kept
+                *o++ = '\\';
+                *o++ = c;
+            }
+        }
+    }
+    arena.trim(o);
+    return std::string_view(out, o - out);
+}
+
+// UNICODE's raw-unicode-escape text as UTF-8: bytes are Latin-1, and
+// \uXXXX / \UXXXXXXXX after an odd run of backslashes are code points.
+// Plain ASCII without a backslash, the common case, is returned as is.
+std::string_view PickleParser::unescapeRawUnicode(std::string_view text, const char* op) {
+    if (!has_escape_or_high(text.data(), text.size())) return text;
+    // Each input byte makes at most two output bytes; escapes make fewer.
+    char* out = static_cast<char*>(arena.allocate(2 * text.size(), 1));
+    char* o = out;
+    size_t k = 0;
+    while (k < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[k]);
+        if (c != '\\') {
+            o = put_utf8(o, c);
+            ++k;
+            continue;
+        }
+        size_t run = 0;
+        while (k + run < text.size() && text[k + run] == '\\') ++run;
+        char kind = k + run < text.size() ? text[k + run] : 0;
+        if (run % 2 == 0 || (kind != 'u' && kind != 'U')) {
+            o = std::fill_n(o, run, '\\');
+            k += run;
+            continue;
+        }
+        o = std::fill_n(o, run - 1, '\\');
+        k += run + 1;
+        size_t width = kind == 'u' ? 4 : 8;
+        if (k + width > text.size()) throw std::runtime_error(std::string(op) + ": truncated \\" + kind + " escape");
+        uint32_t cp = 0;
+        for (size_t d = 0; d < width; ++d) {
+            int h = hex_digit(text[k + d]);
+            if (h < 0) throw std::runtime_error(std::string(op) + ": truncated \\" + kind + " escape");
+            cp = cp << 4 | static_cast<uint32_t>(h);
+        }
+        if (cp > 0x10ffff) throw std::runtime_error(std::string(op) + ": \\U escape out of range");
+        o = put_utf8(o, cp);
+        k += width;
+    }
+    arena.trim(o);
+    return std::string_view(out, o - out);
+}
+
+PickleValue* PickleParser::newValue(PickleType type) {
+    return arena.make<PickleValue>(type);
+}
+
+PickleValue* PickleParser::newString(PickleType type, const char* data, size_t len) {
+    PickleValue* v = arena.make<PickleValue>(type);
+    v->str.data = copyStrings ? arena.copy(data, len) : data;
+    v->str.len = len;
+    return v;
+}
+
+// A Str node. With interning on, strings short enough to be names share
+// one node per distinct text for the rest of the parse.
+PickleValue* PickleParser::newStr(const char* data, size_t len) {
+    if (!interning || len > PickleInternTable::kMaxLength) return newString(PickleType::Str, data, len);
+    uint32_t id = interning->intern(std::string_view(data, len));
+    if (id >= internedStrs.size()) internedStrs.resize(id + 1, nullptr);
+    PickleValue*& v = internedStrs[id];
+    if (!v) {
+        std::string_view text = interning->str(id);
+        v = newValue(PickleType::Str);
+        v->str.data = text.data();
+        v->str.len = text.size();
+        v->interned = id;
+    }
+    return v;
+}
+
+// This parse's Global node for the interned pair `id`.
+PickleValue* PickleParser::internedGlobal(uint32_t id) {
+    if (id >= internedGlobals.size()) internedGlobals.resize(id + 1, nullptr);
+    PickleValue*& v = internedGlobals[id];
+    if (!v) {
+        std::string_view module = interning->str(interning->globalModule(id));
+        std::string_view name = interning->str(interning->globalName(id));
+        v = newValue(PickleType::Global);
+        v->global.module = module.data();
+        v->global.name = name.data();
+        v->global.moduleLen = static_cast<uint32_t>(module.size());
+        v->global.nameLen = static_cast<uint32_t>(name.size());
+        v->interned = id;
+    }
+    return v;
+}
+
+// Python's rule for a key SETITEM repeats: the entry keeps its first
+// position and takes the last value. setItem() applies it to small dicts
+// as they are built. The ones that grew past its scan limit had each key
+// hashed as it went in, while still in cache, and are merged here from
+// those hashes alone; entries are only touched when a key repeats.
+void PickleParser::mergeDuplicateKeys() {
+    constexpr uint64_t kTag = ~uint64_t(0xffffffff);
+    for (size_t b = 0; b < bigDicts.size(); ++b) {
+        PickleValue* d = bigDicts[b];
+        const std::vector<uint64_t>& hashes = keyHashes[b];
+        size_t cap = 64;
+        while (cap < 2 * static_cast<size_t>(d->dict.size)) cap *= 2;
+        keySlots.assign(cap, 0); // hash's high half | entry index + 1; 0 when empty
+        PickleDictEntry* entries = d->dict.entries;
+        uint32_t kept = 0;
+        for (uint32_t e = 0; e < d->dict.size; ++e) {
+            uint64_t h = hashes[e];
+            size_t s = h & (cap - 1);
+            for (; keySlots[s]; s = (s + 1) & (cap - 1)) {
+                if ((keySlots[s] & kTag) == (h & kTag) &&
+                    PickleValue::sameKey(entries[(keySlots[s] & ~kTag) - 1].key, entries[e].key)) {
+                    break;
+                }
+            }
+            if (keySlots[s]) {
+                entries[(keySlots[s] & ~kTag) - 1].value = entries[e].value;
+                continue;
+            }
+            keySlots[s] = (h & kTag) | (kept + 1);
+            if (kept != e) entries[kept] = entries[e];
+            ++kept;
+        }
+        d->dict.size = kept;
+    }
+    bigDicts.clear();
+}
+
+PickleValue* PickleParser::pop(const char* op) {
+    if (stack.empty() || (!marks.empty() && marks.back() == stack.size())) {
+        throw std::runtime_error(std::string(op) + ": stack underflow");
+    }
+    PickleValue* v = stack.back();
+    stack.pop_back();
+    return v;
+}
+
+PickleValue* PickleParser::top(const char* op) {
+    if (stack.empty() || (!marks.empty() && marks.back() == stack.size())) {
+        throw std::runtime_error(std::string(op) + ": stack underflow");
+    }
+    return stack.back();
+}
+
+size_t PickleParser::popMark(const char* op) {
+    if (marks.empty()) {
+        throw std::runtime_error(std::string(op) + ": no MARK on the stack");
+    }
+    size_t first = marks.back();
+    marks.pop_back();
+    return first;
+}
+
+// Collapses stack[first..] into a tuple and leaves it on the stack.
+PickleValue* PickleParser::makeTuple(size_t first, const char* op) {
+    if (first > stack.size() || (!marks.empty() && marks.back() > first)) {
+        throw std::runtime_error(std::string(op) + ": stack underflow");
+    }
+    size_t n = stack.size() - first;
+    PickleValue* t = newValue(PickleType::Tuple);
+    t->seq.items = arena.makeArray<PickleValue*>(n ? n : 1);
+    t->seq.size = t->seq.capacity = static_cast<uint32_t>(n);
+    std::copy(stack.begin() + first, stack.end(), t->seq.items);
+    stack.resize(first);
+    stack.push_back(t);
+    return t;
+}
+
+void PickleParser::memoPut(size_t index, const char* op) {
+    PickleValue* v = top(op);
+    // Picklers number memo entries densely from 0; anything past the stream
+    // length can only be a corrupt or hostile index.
+    if (index > streamOffset + buff.size()) {
+        throw std::runtime_error(std::string(op) + ": memo index " + std::to_string(index) + " out of range");
     }
-    file.seekg(0, std::ios_base::beg);
-    buff.resize(static_cast<size_t>(size)); 
-    file.read(buff.data(), size);
-    if (file.gcount() != size) {
+    if (index >= memo.size()) memo.resize(index + 1, nullptr);
+    memo[index] = v;
+}
+
+PickleValue* PickleParser::memoGet(size_t index, const char* op) {
+    if (index < memo.size() && memo[index] == nullptr && index < memoLazy.size() && memoLazy[index].end) {
+        return materialize(index);
+    }
+    if (index >= memo.size() || memo[index] == nullptr) {
+        throw std::runtime_error(std::string(op) + ": memo index " + std::to_string(index) + " not found");
+    }
+    return memo[index];
+}
+
+
+void PickleParser::setInterning(bool on, PickleInternTable* table) {
+    if (!on) {
+        interning = nullptr;
+    } else if (table) {
+        interning = table;
+    } else {
+        if (!ownInterned) ownInterned = std::make_unique<PickleInternTable>();
+        interning = ownInterned.get();
+    }
+}
+
+void PickleParser::setInput(const std::string& fname) {
+    sPickleFileName = fname;
+    externalBuff = false;
+    buff = std::string_view();
+    size = 0;
+    cPickleVersion = 0;
+    rootValue = nullptr;
+    mappedBuff = MappedFile();
+}
+
+void PickleParser::setInput(const char* data, size_t len) {
+    sPickleFileName.clear();
+    externalBuff = true;
+    buff = std::string_view(data, len);
+    size = static_cast<std::streamsize>(len);
+    cPickleVersion = 0;
+    rootValue = nullptr;
+    mappedBuff = MappedFile();
+}
+
+void PickleParser::pickleOpener(InputMode mode, unsigned advice) {
+    if (externalBuff) {
+        // Caller-owned span: nothing to load, only the header to check.
+    } else if (mode == InputMode::Mmap) {
+        mappedBuff = MappedFile(sPickleFileName, advice);
+        mappedAdvice = advice;
+        ownedBuff.clear();
+        buff = std::string_view(mappedBuff.data(), mappedBuff.size());
+        size = static_cast<std::streamsize>(mappedBuff.size());
+    } else {
+        std::ifstream file(sPickleFileName, std::ios_base::binary | std::ios_base::ate);
+        if (!file) {
+            throw std::runtime_error("Cannot open file: " + sPickleFileName);
+        }
+        size = file.tellg();
+        if (size < 0) {
+            file.close();
+            throw std::runtime_error("Failed to get file size or empty file: " + sPickleFileName);
+        }
+        file.seekg(0, std::ios_base::beg);
+        ownedBuff.resize(static_cast<size_t>(size));
+        file.read(ownedBuff.data(), size);
+        if (file.gcount() != size) {
+            file.close();
+            throw std::runtime_error("Failed to read the full file content: " + sPickleFileName);
+        }
         file.close();
-        throw std::runtime_error("Failed to read the full file content: " + sPickleFileName);
+        mappedBuff = MappedFile();
+        buff = std::string_view(ownedBuff.data(), ownedBuff.size());
     }
-    file.close();
 
-    if (static_cast<size_t>(size) < 2 || static_cast<unsigned char>(buff[0]) != 0x80) { // PROTO opcode
+    // Protocols 0 and 1 have no PROTO; their first byte is just the first
+    // opcode.
+    if (static_cast<size_t>(size) < 2 || !kPickleOps[static_cast<unsigned char>(buff[0])].name) {
         throw std::runtime_error("Invalid pickle format: Missing PROTO or incorrect start byte.");
     }
-    cPickleVersion = static_cast<unsigned char>(buff[1]);
-    std::cout << "Pickle version: " << static_cast<int>(cPickleVersion) << std::endl;
+    cPickleVersion = static_cast<unsigned char>(buff[0]) == 0x80 ? static_cast<unsigned char>(buff[1]) : 0;
 }
 
-void PickleParser::setParsers() {
-    // STOP (0x2e '.')
-    parserMap[0x2e] = [](const char* ) -> size_t { // data not used for 0-arg
-        std::cout << "STOP: parsing complete" << std::endl;
-        return 0;
-    };
+// Visitor behind parsePickle() and feed(): turns events into PickleValue
+// nodes on the parser's own stack, marks and memo. Errors name the opcode
+// being executed.
+class PickleParser::Builder : public PickleNullVisitor {
+public:
+    explicit Builder(PickleParser& parser) : p(parser) {}
 
-    // MARK (0x28 '(')
-    parserMap[0x28] = [](const char* ) -> size_t {
-        std::cout << "MARK: pushing mark" << std::endl;
-        return 0;
-    };
+    void on_stop() {
+        p.rootValue = p.pop("STOP");
+        p.mergeDuplicateKeys();
+    }
+    void on_mark() { p.marks.push_back(p.stack.size()); }
 
-    // EMPTY_DICT (0x7d '}')
-    parserMap[0x7d] = [](const char* ) -> size_t {
-        std::cout << "EMPTY_DICT: creating empty dictionary" << std::endl;
-        return 0;
-    };
+    void on_pop() {
+        if (!p.marks.empty() && p.marks.back() == p.stack.size()) {
+            p.marks.pop_back(); // POP discards a bare MARK as well
+        } else {
+            p.pop("POP");
+        }
+    }
 
-    // EMPTY_LIST (0x5d ']')
-    parserMap[0x5d] = [](const char* ) -> size_t {
-        std::cout << "EMPTY_LIST: creating empty list" << std::endl;
-        return 0;
-    };
+    void on_pop_mark() { p.stack.resize(p.popMark("POP_MARK")); }
+    void on_dup() { p.push(p.top("DUP")); }
+    void on_none() { p.push(p.newValue(PickleType::None)); }
 
-    // BININT1 (0x4b 'K')
-    parserMap[0x4b] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 1 > buff.size()) {
-            throw std::runtime_error("BININT1: Not enough bytes for value");
-        }
-        uint8_t val = static_cast<uint8_t>(data[0]);
-        std::cout << "BININT1: " << static_cast<int>(val) << std::endl;
-        return 1;
-    };
+    void on_bool(bool value) {
+        PickleValue* v = p.newValue(PickleType::Bool);
+        v->b = value;
+        p.push(v);
+    }
+
+    void on_int(int64_t value) {
+        PickleValue* v = p.newValue(PickleType::Int);
+        v->i = value;
+        p.push(v);
+    }
 
-    // BININT2 (0x4d 'M')
-    parserMap[0x4d] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 2 > buff.size()) { 
-            throw std::runtime_error("BININT2: Not enough bytes for value");
+    void on_float(double value) {
+        PickleValue* v = p.newValue(PickleType::Float);
+        v->f = value;
+        p.push(v);
+    }
+
+    void on_str(std::string_view text) { p.push(p.newStr(text.data(), text.size())); }
+    void on_bytes(std::string_view data) { p.push(p.newString(PickleType::Bytes, data.data(), data.size())); }
+
+    void on_bytearray(std::string_view data) {
+        p.push(p.newString(PickleType::ByteArray, data.data(), data.size()));
+    }
+
+    // Out-of-band data is never copied, not even when streaming.
+    void on_buffer(std::string_view data) {
+        PickleValue* v = p.newValue(PickleType::Buffer);
+        v->str.data = data.data();
+        v->str.len = data.size();
+        p.push(v);
+    }
+
+    // Every bytes-like node is a read-only view already.
+    void on_readonly_buffer() {
+        PickleType type = p.top("READONLY_BUFFER")->type;
+        if (type != PickleType::Buffer && type != PickleType::Bytes && type != PickleType::ByteArray) {
+            throw std::runtime_error("READONLY_BUFFER: top of stack is not a buffer");
         }
-        uint16_t val = read_le16(data);
-        std::cout << "BININT2: " << val << std::endl;
-        return 2;
-    };
+    }
+
+    void on_global(std::string_view module, std::string_view name) { p.push(global(module, name)); }
 
-    // BININT (0x4a 'J')
-    parserMap[0x4a] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 4 > buff.size()) { 
-            throw std::runtime_error("BININT: Not enough bytes for value");
+    // The strings are already views (or arena copies when streaming).
+    void on_stack_global() {
+        PickleValue* name = p.pop("STACK_GLOBAL");
+        PickleValue* module = p.pop("STACK_GLOBAL");
+        if (!module->isStr() || !name->isStr()) {
+            throw std::runtime_error("STACK_GLOBAL: module and name must be strings");
         }
-        uint32_t val = read_le32(data);
-        std::cout << "BININT: " << val << std::endl;
-        return 4;
-    };
+        if (p.interning) {
+            uint32_t id = module->interned && name->interned
+                              ? p.interning->internGlobal(module->interned, name->interned)
+                              : p.interning->internGlobal(module->string(), name->string());
+            p.push(p.internedGlobal(id));
+            return;
+        }
+        PickleValue* v = p.newValue(PickleType::Global);
+        v->global.module = module->str.data;
+        v->global.name = name->str.data;
+        v->global.moduleLen = static_cast<uint32_t>(module->str.len);
+        v->global.nameLen = static_cast<uint32_t>(name->str.len);
+        p.push(v);
+    }
 
-    // LONG (0x4c 'L')
-    parserMap[0x4c] = [this](const char* data) -> size_t {
-        size_t pos = 0;
-        std::string num_str;
-        size_t initial_arg_offset = data - buff.data();
-        while (initial_arg_offset + pos < buff.size() && buff[initial_arg_offset + pos] != '\n') {
-            num_str += buff[initial_arg_offset + pos];
-            pos++;
-        }
-        if (initial_arg_offset + pos >= buff.size() || buff[initial_arg_offset + pos] != '\n') {
-            throw std::runtime_error("LONG: No newline or buffer exhausted");
-        }
-        pos++; // Consume newline
-        try {
-            long long val = std::stoll(num_str);
-            std::cout << "LONG: " << val << " (parsed as '" << num_str << "')" << std::endl;
-        } catch (const std::exception& e) {
-            throw std::runtime_error("LONG: Invalid number '" + num_str + "': " + e.what());
-        }
-        return pos;
-    };
+    void setItem(PickleValue* dict, PickleValue* key, PickleValue* value) {
+        if (dict->dict.hashed) p.keyHashes[dict->dict.hashed - 1].push_back(key_hash(key));
+        if (!dict->setItem(p.arena, key, value)) return;
+        // Past the scan limit: hash the keys so far, and from now on each
+        // one as it arrives, for mergeDuplicateKeys() at STOP.
+        size_t b = p.bigDicts.size();
+        p.bigDicts.push_back(dict);
+        if (p.keyHashes.size() == b) p.keyHashes.emplace_back();
+        std::vector<uint64_t>& hashes = p.keyHashes[b];
+        hashes.clear();
+        for (uint32_t e = 0; e < dict->dict.size; ++e) hashes.push_back(key_hash(dict->dict.entries[e].key));
+        dict->dict.hashed = static_cast<uint32_t>(b + 1);
+    }
 
-    // LONG1 (0x8a)
-    parserMap[0x8a] = [this](const char* d) -> size_t {
-        size_t arg_offset = d - buff.data();
-        if (arg_offset + 1 > buff.size()) throw std::runtime_error("LONG1: Not enough bytes for length");
-        uint8_t len = static_cast<uint8_t>(d[0]);
-        if (arg_offset + 1 + len > buff.size()) {
-             throw std::runtime_error("LONG1: Insufficient data for value. Need " + std::to_string(len) + " value bytes.");
-        }
-        int64_t val = decode_signed_long(reinterpret_cast<const unsigned char*>(d + 1), len);
-        std::cout << "LONG1: " << val << std::endl;
-        return 1 + len; 
-    };
+    void on_list() { p.push(p.newValue(PickleType::List)); }
+    void on_dict() { p.push(p.newValue(PickleType::Dict)); }
+    void on_set() { p.push(p.newValue(PickleType::Set)); }
 
-    // LONG4 (0x8b)
-    parserMap[0x8b] = [this](const char* d) -> size_t {
-        size_t arg_offset = d - buff.data();
-        if (arg_offset + 4 > buff.size()) throw std::runtime_error("LONG4: Not enough bytes for length");
-        uint32_t len_val = read_le32(d);
-        size_t len = static_cast<size_t>(len_val);
-        if (arg_offset + 4 + len > buff.size()) {
-            throw std::runtime_error("LONG4: Insufficient data for value. Need " + std::to_string(len) + " value bytes.");
-        }
-        if (len_val > 0xFFFFFFF0 && len_val != 0) { // Basic sanity check for very large lengths
-             std::cerr << "Warning: LONG4 potentially very large length " << len_val << std::endl;
-        }
-        int64_t val = decode_signed_long(reinterpret_cast<const unsigned char*>(d + 4), len);
-        std::cout << "LONG4: " << val << std::endl;
-        return 4 + len; 
-    };
+    void on_marked_list() { p.makeTuple(p.popMark("LIST"), "LIST")->type = PickleType::List; }
 
-    // BINUNICODE (0x58 'X')
-    parserMap[0x58] = [this](const char* data) -> size_t {
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 4 > buff.size()) throw std::runtime_error("BINUNICODE: Not enough bytes for length");
-        uint32_t len_val = read_le32(data);
-        size_t len = static_cast<size_t>(len_val);
-        if (arg_offset + 4 + len > buff.size()) throw std::runtime_error("BINUNICODE: Not enough bytes for string (len: " + std::to_string(len) + ")");
-        std::string str(data + 4, len);
-        std::cout << "BINUNICODE: '" << str << "'" << std::endl;
-        return 4 + len;
-    };
+    void on_marked_dict() {
+        size_t first = p.popMark("DICT");
+        if ((p.stack.size() - first) % 2 != 0) {
+            throw std::runtime_error("DICT: odd number of items after MARK");
+        }
+        PickleValue* dict = p.newValue(PickleType::Dict);
+        for (size_t k = first; k < p.stack.size(); k += 2) {
+            setItem(dict, p.stack[k], p.stack[k + 1]);
+        }
+        p.stack.resize(first);
+        p.push(dict);
+    }
 
-    // BINSTRING (0x54 'T')
-    parserMap[0x54] = [this](const char* data) -> size_t {
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 4 > buff.size()) throw std::runtime_error("BINSTRING: Not enough bytes for length");
-        uint32_t len_val = read_le32(data);
-        size_t len = static_cast<size_t>(len_val);
-        if (arg_offset + 4 + len > buff.size()) throw std::runtime_error("BINSTRING: Not enough bytes for string (len: " + std::to_string(len) + ")");
-        std::string str(data + 4, len);
-        std::cout << "BINSTRING: '" << str << "' (" << len << " bytes)" << std::endl;
-        return 4 + len;
-    };
+    void on_tuple(int items) {
+        size_t first;
+        if (items == kPopToMark) {
+            first = p.popMark("TUPLE");
+        } else {
+            if (p.stack.size() < static_cast<size_t>(items)) throw std::runtime_error(std::string(op()) + ": stack underflow");
+            first = p.stack.size() - static_cast<size_t>(items);
+        }
+        p.makeTuple(first, op());
+    }
 
-    // SHORTBINUNICODE (0x8c)
-    parserMap[0x8c] = [this](const char* data) -> size_t {
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 1 > buff.size()) throw std::runtime_error("SHORTBINUNICODE: Not enough bytes for length");
-        uint8_t len = static_cast<uint8_t>(data[0]);
-        if (arg_offset + 1 + len > buff.size()) throw std::runtime_error("SHORTBINUNICODE: Not enough bytes for string (len: " + std::to_string(len) + ")");
-        std::string str(data + 1, len);
-        std::cout << "SHORTBINUNICODE: '" << str << "'" << std::endl;
-        return 1 + len;
-    };
-    
-    // BINUNICODE8 (user's 0x8d)
-    parserMap[0x8d] = [this](const char* data) -> size_t {
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 8 > buff.size()) {
-            throw std::runtime_error("BINUNICODE8: Not enough bytes for length");
-        }
-        uint64_t len_val = 0; 
-        for (size_t i = 0; i < 8; ++i) {
-            len_val |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (i * 8);
-        }
-        size_t len = static_cast<size_t>(len_val); 
-        if (len_val > (buff.size() - (arg_offset + 8)) ) { // Check if declared length fits remaining buffer
-             throw std::runtime_error("BINUNICODE8: Declared length " + std::to_string(len_val) + " exceeds remaining buffer space.");
-        }
-        std::string str(data + 8, len);
-        std::cout << "BINUNICODE8: '" << str << "'" << std::endl;
-        return 8 + len;
-    };
+    void on_append() {
+        PickleValue* item = p.pop("APPEND");
+        PickleValue* list = p.top("APPEND");
+        if (list->type != PickleType::List) throw std::runtime_error("APPEND: target is not a list");
+        list->append(p.arena, item);
+    }
 
-    // BINBYTES (0x42 'B')
-    parserMap[0x42] = [this](const char* data) -> size_t {
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 4 > buff.size()) throw std::runtime_error("BINBYTES: Not enough bytes for length");
-        uint32_t len_val = read_le32(data);
-        size_t len = static_cast<size_t>(len_val);
-        if (arg_offset + 4 + len > buff.size()) throw std::runtime_error("BINBYTES: Not enough bytes for data (len: " + std::to_string(len) + ")");
-        std::cout << "BINBYTES: " << len << " bytes" << std::endl;
-        return 4 + len;
-    };
+    void on_appends() {
+        size_t first = p.popMark("APPENDS");
+        if (first == 0 || (!p.marks.empty() && p.marks.back() == first)) {
+            throw std::runtime_error("APPENDS: stack underflow");
+        }
+        PickleValue* list = p.stack[first - 1];
+        if (list->type != PickleType::List) throw std::runtime_error("APPENDS: target is not a list");
+        for (size_t k = first; k < p.stack.size(); ++k) {
+            list->append(p.arena, p.stack[k]);
+        }
+        p.stack.resize(first);
+    }
 
-    // SHORTBINBYTES (user's 0x8f)
-    parserMap[0x8f] = [this](const char* data) -> size_t { 
-        size_t arg_offset = data - buff.data();
-        if (arg_offset + 1 > buff.size()) throw std::runtime_error("SHORTBINBYTES (0x8f): Not enough bytes for length");
-        uint8_t len = static_cast<uint8_t>(data[0]);
-        if (arg_offset + 1 + len > buff.size()) throw std::runtime_error("SHORTBINBYTES (0x8f): Not enough bytes for data (len: " + std::to_string(len) + ")");
-        std::cout << "SHORTBINBYTES (0x8f): " << static_cast<int>(len) << " bytes" << std::endl;
-        return 1 + len;
-    };
+    void on_setitem() {
+        PickleValue* value = p.pop("SETITEM");
+        PickleValue* key = p.pop("SETITEM");
+        PickleValue* dict = p.top("SETITEM");
+        if (dict->type != PickleType::Dict) throw std::runtime_error("SETITEM: target is not a dict");
+        setItem(dict, key, value);
+    }
 
-    // GLOBAL (0x63 'c')
-    parserMap[0x63] = [this](const char* data) -> size_t {
-        size_t pos = 0; // Relative to 'data' pointer
-        std::string module, name;
-        size_t initial_arg_offset = data - buff.data(); // Offset of 'data' from start of 'buff'
+    void on_setitems() {
+        size_t first = p.popMark("SETITEMS");
+        if ((p.stack.size() - first) % 2 != 0) {
+            throw std::runtime_error("SETITEMS: odd number of items after MARK");
+        }
+        if (first == 0 || (!p.marks.empty() && p.marks.back() == first)) {
+            throw std::runtime_error("SETITEMS: stack underflow");
+        }
+        PickleValue* dict = p.stack[first - 1];
+        if (dict->type != PickleType::Dict) throw std::runtime_error("SETITEMS: target is not a dict");
+        for (size_t k = first; k < p.stack.size(); k += 2) {
+            setItem(dict, p.stack[k], p.stack[k + 1]);
+        }
+        p.stack.resize(first);
+    }
 
-        // Read module name
-        while (initial_arg_offset + pos < buff.size() && buff[initial_arg_offset + pos] != '\n') {
-            module += buff[initial_arg_offset + pos];
-            pos++;
+    void on_additems() {
+        size_t first = p.popMark("ADDITEMS");
+        if (first == 0 || (!p.marks.empty() && p.marks.back() == first)) {
+            throw std::runtime_error("ADDITEMS: stack underflow");
         }
-        if (initial_arg_offset + pos >= buff.size() || buff[initial_arg_offset + pos] != '\n') {
-            throw std::runtime_error("GLOBAL: No newline for module or buffer exhausted");
+        PickleValue* set = p.stack[first - 1];
+        if (set->type != PickleType::Set) throw std::runtime_error("ADDITEMS: target is not a set");
+        for (size_t k = first; k < p.stack.size(); ++k) {
+            set->append(p.arena, p.stack[k]);
         }
-        pos++; // Consume module's newline
+        p.stack.resize(first);
+    }
 
-        // Read object name
-        while (initial_arg_offset + pos < buff.size() && buff[initial_arg_offset + pos] != '\n') {
-            name += buff[initial_arg_offset + pos];
-            pos++;
+    void on_frozenset() { p.makeTuple(p.popMark("FROZENSET"), "FROZENSET")->type = PickleType::FrozenSet; }
+
+    void on_reduce() {
+        PickleValue* args = p.pop("REDUCE");
+        PickleValue* callable = p.pop("REDUCE");
+        p.push(reduce(callable, args));
+    }
+
+    // cls.__new__(cls, *args) is kept as a Reduce of cls; the tree does not
+    // tell the two apart.
+    void on_newobj() {
+        PickleValue* args = p.pop("NEWOBJ");
+        PickleValue* cls = p.pop("NEWOBJ");
+        if (!args->isTuple()) throw std::runtime_error("NEWOBJ: args is not a tuple");
+        p.push(reduce(cls, args));
+    }
+
+    void on_newobj_ex() {
+        PickleValue* kwargs = p.pop("NEWOBJ_EX");
+        PickleValue* args = p.pop("NEWOBJ_EX");
+        PickleValue* cls = p.pop("NEWOBJ_EX");
+        if (!args->isTuple() || !kwargs->isDict()) {
+            throw std::runtime_error("NEWOBJ_EX: args is not a tuple or kwargs not a dict");
         }
-        if (initial_arg_offset + pos >= buff.size() || buff[initial_arg_offset + pos] != '\n') {
-            throw std::runtime_error("GLOBAL: No newline for name or buffer exhausted");
+        if (kwargs->dict.size != 0) {
+            throw std::runtime_error("NEWOBJ_EX: keyword arguments are not supported");
         }
-        pos++; // Consume name's newline
-        std::cout << "GLOBAL: module='" << module << "', name='" << name << "'" << std::endl;
-        return pos; // Total bytes consumed from 'data' onwards
-    };
+        p.push(reduce(cls, args));
+    }
 
-    // BINPUT (0x71 'q')
-    parserMap[0x71] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 1 > buff.size()) throw std::runtime_error("BINPUT: Not enough bytes for index");
-        uint8_t index = static_cast<uint8_t>(data[0]);
-        std::cout << "BINPUT: storing at index " << static_cast<int>(index) << std::endl;
-        return 1;
-    };
+    // Old-style class instances (Python 2) are Reduces of the class too.
+    void on_inst(std::string_view module, std::string_view name) {
+        PickleValue* args = p.makeTuple(p.popMark("INST"), "INST");
+        p.stack.pop_back();
+        p.push(reduce(global(module, name), args));
+    }
 
-    // BINGET (0x68 'h')
-    parserMap[0x68] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 1 > buff.size()) throw std::runtime_error("BINGET: Not enough bytes for index");
-        uint8_t index = static_cast<uint8_t>(data[0]);
-        std::cout << "BINGET: retrieving index " << static_cast<int>(index) << std::endl;
-        return 1;
-    };
-    
-    // GET (0x67 'g') - newline terminated string index
-    parserMap[0x67] = [this](const char* data) -> size_t {
-        size_t pos = 0;
-        std::string index_str;
-        size_t initial_arg_offset = data - buff.data();
-        while (initial_arg_offset + pos < buff.size() && buff[initial_arg_offset + pos] != '\n') {
-            index_str += buff[initial_arg_offset + pos];
-            pos++;
-        }
-        if (initial_arg_offset + pos >= buff.size() || buff[initial_arg_offset + pos] != '\n') {
-            throw std::runtime_error("GET (0x67): No newline or buffer exhausted for index string");
-        }
-        pos++; // Consume newline
-        std::cout << "GET (0x67): retrieving from memo with index '" << index_str << "'" << std::endl;
-        return pos;
-    };
+    void on_obj() {
+        size_t first = p.popMark("OBJ");
+        if (first >= p.stack.size()) throw std::runtime_error("OBJ: stack underflow");
+        PickleValue* cls = p.stack[first];
+        PickleValue* args = p.makeTuple(first + 1, "OBJ");
+        p.stack.resize(first);
+        p.push(reduce(cls, args));
+    }
 
-    // LONG_BINPUT (0x72 'r')
-    parserMap[0x72] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 4 > buff.size()) {
-            throw std::runtime_error("LONG_BINPUT (0x72): Not enough bytes for 4-byte index");
+    void on_build() {
+        PickleValue* state = p.pop("BUILD");
+        PickleValue* obj = p.top("BUILD");
+        if (obj->type == PickleType::Reduce) {
+            obj->reduce.state = state;
+        } else if (obj->type == PickleType::Dict) {
+            // State of a dict subclass (e.g. a state_dict's OrderedDict._metadata)
+            // is instance attributes, not items; the tree has nowhere to keep it.
+        } else {
+            throw std::runtime_error("BUILD: cannot apply state to this object");
         }
-        uint32_t index = read_le32(data);
-        std::cout << "LONG_BINPUT (0x72 'r'): storing at index " << index << std::endl;
-        return 4; 
-    };
+    }
+
+    void on_persid() {
+        PickleValue* v = p.newValue(PickleType::PersId);
+        v->pid = p.pop("BINPERSID");
+        if (p.persistentIdHook) p.persistentIdHook(v->pid);
+        p.push(v);
+    }
+
+    void on_text_persid(std::string_view id) {
+        PickleValue* v = p.newValue(PickleType::PersId);
+        v->pid = p.newStr(id.data(), id.size());
+        if (p.persistentIdHook) p.persistentIdHook(v->pid);
+        p.push(v);
+    }
+
+    void on_memo_put(size_t index) { p.memoPut(index, op()); }
+    void on_memo_get(size_t index) { p.push(p.memoGet(index, op())); }
+
+private:
+    const char* op() const { return kPickleOps[static_cast<unsigned char>(p.buff[p.opcodeOffset])].name; }
+
+    PickleValue* global(std::string_view module, std::string_view name) {
+        if (p.interning) return p.internedGlobal(p.interning->internGlobal(module, name));
+        PickleValue* v = p.newValue(PickleType::Global);
+        v->global.module = p.copyStrings ? p.arena.copy(module.data(), module.size()) : module.data();
+        v->global.name = p.copyStrings ? p.arena.copy(name.data(), name.size()) : name.data();
+        v->global.moduleLen = static_cast<uint32_t>(module.size());
+        v->global.nameLen = static_cast<uint32_t>(name.size());
+        return v;
+    }
 
-    // LONG_BINGET (0x6A 'j')
-    parserMap[0x6A] = [this](const char* data) -> size_t {
-        if ((data - buff.data()) + 4 > buff.size()) { 
-            throw std::runtime_error("LONG_BINGET (0x6A): Not enough bytes for 4-byte index");
+    PickleValue* reduce(PickleValue* callable, PickleValue* args) {
+        if (callable->type == PickleType::Global && callable->module() == "collections" &&
+            callable->name() == "OrderedDict" && args->type == PickleType::Tuple && args->seq.size == 0) {
+            // torch state_dicts are OrderedDicts filled by SETITEMS afterwards;
+            // decoding them as plain dicts keeps insertion order all the same.
+            return p.newValue(PickleType::Dict);
         }
-        uint32_t index = read_le32(data);
-        std::cout << "LONG_BINGET (0x6A 'j'): retrieving index " << index << std::endl;
-        return 4;
-    };
+        PickleValue* v = p.newValue(PickleType::Reduce);
+        v->reduce.callable = callable;
+        v->reduce.args = args;
+        return v;
+    }
 
-    // SETITEMS (0x75 'u')
-    parserMap[0x75] = [](const char* ) -> size_t {
-        std::cout << "SETITEMS: Setting multiple key-value pairs in dictionary" << std::endl;
-        return 0;
-    };
+    PickleParser& p;
+};
 
-    // TUPLE (0x74 't')
-    parserMap[0x74] = [](const char* ) -> size_t {
-        std::cout << "TUPLE: Creating tuple from stack items" << std::endl;
-        return 0;
-    };
+// Fills every dispatch slot without a real handler, so the hot loop never
+// has to branch on a missing entry.
+size_t PickleParser::opUnknown(const char* data) {
+    // The argument length of an unknown opcode is unknown too, so the
+    // VM cannot resynchronise; skipping would only corrupt the stack.
+    unsigned char opcode = static_cast<unsigned char>(data[-1]);
+    std::ostringstream msg;
+    msg << "Unknown opcode: 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(opcode)
+        << " (decimal: " << std::dec << static_cast<int>(opcode) << ")"
+        << " ('" << (isprint(opcode) ? static_cast<char>(opcode) : '?') << "')"
+        << " at stream offset " << (streamOffset + (data - 1 - buff.data()));
+    throw std::runtime_error(msg.str());
+}
 
-    // APPEND (0x61 'a')
-    parserMap[0x61] = [](const char* ) -> size_t {
-        std::cout << "APPEND: Appending item to list" << std::endl;
-        return 0;
-    };
+void PickleParser::setParsers() {
+    // Kept for source compatibility with callers that still invoke it.
+}
 
-    // APPENDS (0x65 'e')
-    parserMap[0x65] = [](const char* ) -> size_t {
-        std::cout << "APPENDS: Appending multiple items to list" << std::endl;
-        return 0;
-    };
+void PickleParser::resetMachine() {
+    arena.reset();
+    stack.clear();
+    marks.clear();
+    memo.clear();
+    memoLazy.clear();
+    memoNext = 0;
+    internedStrs.clear();
+    internedGlobals.clear();
+    bigDicts.clear();
+    if (interning && interning == ownInterned.get()) interning->clear();
+    nextBuffer = 0;
+    frameEnd = 0;
+    rootValue = nullptr;
+    stopped = false;
+}
 
-    // SETITEM (0x73 's')
-    parserMap[0x73] = [](const char* ) -> size_t {
-        std::cout << "SETITEM: Setting a single key-value pair in dictionary" << std::endl;
-        return 0;
-    };
+void PickleParser::reportError(const std::exception& e) const {
+    unsigned char opcode = static_cast<unsigned char>(buff[opcodeOffset]);
+    if (!diagnostics) return;
+    *diagnostics << "Error during parsing opcode 0x" << std::hex << static_cast<int>(opcode) << std::dec
+              << " ('" << (isprint(opcode) ? static_cast<char>(opcode) : '?') << "')"
+              << " at stream offset " << (streamOffset + opcodeOffset) << ": " << e.what() << std::endl;
+}
+
+// Pages in a whole FRAME ahead of its opcodes when the input is mapped
+// without AdviseWillNeed; otherwise the kernel is already reading ahead.
+void PickleParser::prefetchFrame(size_t offset, size_t len) const {
+    if (mappedBuff.empty() || buff.data() != mappedBuff.data() || (mappedAdvice & MappedFile::AdviseWillNeed)) {
+        return;
+    }
+    mappedBuff.advise(MappedFile::AdviseWillNeed, offset, len);
+}
 
-    // BUILD (0x62 'b')
-    parserMap[0x62] = [](const char* ) -> size_t {
-        std::cout << "BUILD: Setting object attributes" << std::endl;
-        return 0;
+// Walks opcodes from buff[i] by their stack effects alone, tracking where
+// each stack item started and which memo indices name it, without running
+// any handler. Stops at STOP, or at the first opcode that would pop past
+// the starting level (the SETITEMS closing a dict's MARK, when started just
+// after it). MEMOIZE indices are counted on from memoNext. Returns false
+// for anything it cannot follow: unknown or truncated opcodes, DUP,
+// NEXT_BUFFER, an unbalanced stack or reaching `end`.
+bool PickleParser::scan(size_t i, size_t end, Scan& out) const {
+    constexpr size_t npos = std::string_view::npos;
+    struct ScanMark {
+        size_t level;  // items.size() at the MARK
+        size_t offset; // of the MARK
+        size_t memo;   // nextMemo at the MARK
     };
+    std::vector<ScanItem>& items = out.items;
+    std::vector<ScanMark> scanMarks;
+    size_t nextMemo = memoNext;
+    items.clear();
+    out.puts.clear();
 
-    // REDUCE (0x52 'R')
-    parserMap[0x52] = [](const char* ) -> size_t {
-        std::cout << "REDUCE (0x52 'R'): Applying callable to arguments" << std::endl;
-        return 0;
+    // Items from `first` up are complete by the opcode at `at`: each one
+    // once the item above it starts, the topmost at `at`.
+    auto close = [&](size_t first, size_t at) {
+        for (size_t k = first; k < items.size(); ++k) {
+            size_t done = k + 1 < items.size() ? items[k + 1].start : at;
+            for (size_t p = items[k].lastPut; p != npos; p = out.puts[p].prev) out.puts[p].end = done;
+        }
     };
-    
-    // BINPERSID (0x51 'Q')
-    parserMap[0x51] = [](const char* ) -> size_t {
-        std::cout << "BINPERSID (0x51 'Q'): (Persistent ID from stack)" << std::endl;
-        return 0; 
+    auto retire = [&](size_t first, size_t at) {
+        close(first, at);
+        items.resize(first);
     };
 
-    // TUPLE1 (0x85)
-    parserMap[0x85] = [](const char* ) -> size_t {
-        std::cout << "TUPLE1 (0x85): creating one-element tuple" << std::endl;
-        return 0;
-    };
+    while (i < end) {
+        unsigned char opcode = static_cast<unsigned char>(buff[i]);
+        const PickleOpInfo& op = kPickleOps[opcode];
+        if (!op.name || opcode == 0x32) return false; // unknown, or DUP (its copy has no range of its own)
+        if (opcode == 0x97) return false;             // NEXT_BUFFER: skipping it would misnumber the rest
+        size_t argLen = pickleArgLength(buff.data() + i + 1, end - i - 1, op.arg);
+        if (argLen == kPickleArgIncomplete) return false;
+        size_t level = scanMarks.empty() ? 0 : scanMarks.back().level;
 
-    // TUPLE2 (0x86)
-    parserMap[0x86] = [](const char* ) -> size_t {
-        std::cout << "TUPLE2 (0x86): creating two-element tuple" << std::endl;
-        return 0;
-    };
-    
-    // NEWFALSE (0x89) - Corrected based on pickletools.dis()
-    parserMap[0x89] = [](const char* ) -> size_t {
-        std::cout << "NEWFALSE (0x89): pushing False" << std::endl; 
-        return 0;
-    };
+        if (opcode == 0x2e) { // STOP
+            out.stop = i;
+            if (!scanMarks.empty()) return false;
+            close(0, i);
+            return true;
+        }
+        if (op.pops == kPopToMark && scanMarks.empty()) {
+            out.stop = i;
+            close(0, i);
+            return true; // the caller's own MARK is being closed
+        }
 
-    // EMPTY_TUPLE (0x29 ')')
-    parserMap[0x29] = [](const char* ) -> size_t {
-        std::cout << "EMPTY_TUPLE (0x29): pushing empty tuple" << std::endl;
-        return 0;
-    };
+        size_t start = i;
+        size_t memoStart = nextMemo;
+        bool merge = false;
+        if (op.pops == kPopToMark) {
+            start = scanMarks.back().offset;
+            memoStart = scanMarks.back().memo;
+            retire(scanMarks.back().level, i);
+            scanMarks.pop_back();
+        } else if (op.pops > 0) {
+            size_t n = static_cast<size_t>(op.pops);
+            if (items.size() - level < n) {
+                if (!scanMarks.empty()) return false;
+                out.stop = i;
+                close(0, i);
+                return true; // pops past the starting level
+            }
+            start = items[items.size() - n].start;
+            memoStart = items[items.size() - n].memoStart;
+            merge = op.pushes == 1;
+            retire(items.size() - n, i);
+        }
 
-    // DUP (0x32 '2')
-    parserMap[0x32] = [](const char* ) -> size_t {
-        std::cout << "DUP (0x32 '2'): duplicating top of stack" << std::endl;
-        return 0;
-    };
+        if (op.pushes == kPushMark) {
+            scanMarks.push_back({items.size(), i, nextMemo});
+        } else if (op.pushes == 1) {
+            items.push_back({start, merge ? i : start, npos, memoStart});
+        }
 
-    // Placeholder for opcode 0x02 - meaning in this file context is still unknown.
-    parserMap[0x02] = [](const char* ) -> size_t {
-        std::cout << "CUSTOM_OPCODE_0x02: encountered 0x02" << std::endl;
-        return 0; 
-    };
+        if (opcode == 0x70 || opcode == 0x71 || opcode == 0x72 || opcode == 0x94) { // PUT, BINPUT, LONG_BINPUT, MEMOIZE
+            if (items.size() == level) return false;
+            int64_t line = 0;
+            if (opcode == 0x70 &&
+                (parse_decimal(buff.substr(i + 1, argLen - 1), line) != std::errc() || line < 0)) {
+                return false;
+            }
+            size_t index = opcode == 0x94   ? nextMemo
+                           : opcode == 0x70 ? static_cast<size_t>(line)
+                           : opcode == 0x71 ? static_cast<uint8_t>(buff[i + 1])
+                                            : read_le32(buff.data() + i + 1);
+            nextMemo = std::max(nextMemo, index + 1);
+            out.puts.push_back({index, items.back().start, npos, items.back().lastPut, items.back().memoStart});
+            items.back().lastPut = out.puts.size() - 1;
+        }
+        i += 1 + argLen;
+    }
+    return false;
 }
 
-void PickleParser::parsePickle() {
-    size_t i = 2; // Start after PROTO (buff[0]) and VERSION (buff[1])
-    size_t file_s = static_cast<size_t>(size);
+// Rebuilds a memo entry defined inside a skipped value by running the
+// opcodes recorded for it on top of the current stack. MEMOIZEs in the
+// range are renumbered as they were the first time through, and a FRAME
+// in it is not mistaken for one overlapping the current frame.
+PickleValue* PickleParser::materialize(size_t index) {
+    LazyMemo range = memoLazy[index];
+    memoLazy[index] = {0, 0, 0};
+    size_t savedOffset = opcodeOffset;
+    size_t savedMemoNext = memoNext;
+    uint64_t savedFrameEnd = frameEnd;
+    memoNext = range.memoBase;
+    frameEnd = 0;
+    size_t base = stack.size();
+    marks.push_back(base); // the range must not reach below what is already on the stack
+    Builder builder(*this);
+    execute(range.begin, range.end, builder);
+    memoNext = savedMemoNext;
+    frameEnd = savedFrameEnd;
+    if (stack.size() <= base || marks.empty() || marks.back() != base) {
+        throw std::runtime_error("memo index " + std::to_string(index) + " could not be rebuilt");
+    }
+    PickleValue* v = stack[base];
+    stack.resize(base);
+    marks.pop_back();
+    if (memo[index] == nullptr) memo[index] = v;
+    opcodeOffset = savedOffset;
+    return memo[index];
+}
 
-    while (i < file_s) {
-        unsigned char opcode = static_cast<unsigned char>(buff[i]);
-        auto it = parserMap.find(opcode);
-        if (it != parserMap.end()) {
-            size_t consumed_args_length = 0;
-            try {
-                // Pass pointer to the byte *after* the current opcode.
-                // Handlers are responsible for their own bounds checking.
-                consumed_args_length = it->second(buff.data() + i + 1);
-            } catch (const std::exception& e) {
-                 std::cerr << "Error during parsing opcode 0x" << std::hex << static_cast<int>(opcode) << std::dec 
-                           << " ('" << (isprint(opcode) ? static_cast<char>(opcode) : '?') << "')"
-                           << " at stream offset " << i << ": " << e.what() << std::endl;
-                 throw; 
+// Like execute(), but each dict whose value sits at the bottom of this
+// range (and is not folded into another object after offset filterFrom)
+// has its entries filtered by path.
+size_t PickleParser::executeSelective(size_t i, size_t end, const std::string& path, size_t filterFrom) {
+    Builder builder(*this);
+    size_t base = stack.size();
+    while (i < end && !stopped) {
+        if (buff[i] == '(' && i >= filterFrom && stack.size() == base + 1 && stack.back()->isDict() &&
+            (marks.empty() || marks.back() < base)) {
+            size_t next = selectDictItems(i, end, path);
+            if (next != std::string_view::npos) {
+                i = next;
+                continue;
             }
-            i += (1 + consumed_args_length); // 1 for opcode, plus length of its arguments
+        }
+        i = execute(i, i + 1, builder); // one opcode
+    }
+    return i;
+}
+
+// Handles `MARK key value ... SETITEMS` at buff[mark] for the dict on top of
+// the stack, decoding only the entries pathFilter wants. Returns the offset
+// after SETITEMS, or npos (having run nothing) if the batch cannot be
+// scanned, in which case the caller decodes it normally.
+size_t PickleParser::selectDictItems(size_t mark, size_t end, const std::string& path) {
+    Scan batch;
+    if (!scan(mark + 1, end, batch) || static_cast<unsigned char>(buff[batch.stop]) != 0x75 ||
+        batch.items.size() % 2 != 0) {
+        return std::string_view::npos;
+    }
+
+    Builder builder(*this);
+    execute(mark, mark + 1, builder); // the MARK
+    std::string child;
+    for (size_t k = 0; k < batch.items.size(); k += 2) {
+        size_t keyStart = batch.items[k].start;
+        size_t valueStart = batch.items[k + 1].start;
+        size_t valueEnd = k + 2 < batch.items.size() ? batch.items[k + 2].start : batch.stop;
+        execute(keyStart, valueStart, builder);
+        const PickleValue* key = top("SETITEMS");
+
+        PathMatch match = PathMatch::Include;
+        if (key->isStr()) {
+            child.assign(path);
+            if (!child.empty()) child += '.';
+            child.append(key->string());
+            match = pathFilter(child);
+        }
+        if (match == PathMatch::Include) {
+            execute(valueStart, valueEnd, builder);
+        } else if (match == PathMatch::Descend) {
+            executeSelective(valueStart, valueEnd, child, batch.items[k + 1].merged);
         } else {
-            std::cout << "Unknown opcode: 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(opcode) 
-                      << " (decimal: " << std::dec << static_cast<int>(opcode) << ")"
-                      << " ('" << (isprint(opcode) ? static_cast<char>(opcode) : '?') << "')"
-                      << " at stream offset " << i << std::endl;
-            i += 1;  // Skip unknown opcode and continue
+            stack.pop_back(); // drop the key
+            for (const PutSite& put : batch.puts) {
+                if (put.begin < valueStart || put.begin >= valueEnd) continue;
+                if (put.index > streamOffset + buff.size()) {
+                    throw std::runtime_error("BINPUT: memo index " + std::to_string(put.index) + " out of range");
+                }
+                if (put.index >= memo.size()) memo.resize(put.index + 1, nullptr);
+                if (put.index >= memoLazy.size()) memoLazy.resize(memo.size(), {0, 0, 0});
+                memo[put.index] = nullptr;
+                memoLazy[put.index] = {put.begin, put.end, put.memoBase};
+                memoNext = std::max(memoNext, put.index + 1);
+            }
         }
     }
-     if (i == file_s ) {
-        if (file_s > 0 && static_cast<unsigned char>(buff[file_s-1]) == 0x2e /* STOP */) {
-             // Parsing finished exactly at file end and last was STOP, expected good outcome.
-        } else if (file_s == 0 || (file_s > 0 && static_cast<unsigned char>(buff[file_s-1]) != 0x2e)) {
-             std::cerr << "Warning: Parsing finished at end of file, but last opcode was not STOP (or file was empty/too short after header)." << std::endl;
+    return execute(batch.stop, batch.stop + 1, builder); // SETITEMS
+}
+
+void PickleParser::selectPaths(std::vector<std::string> paths) {
+    if (paths.empty()) {
+        pathFilter = nullptr;
+        return;
+    }
+    pathFilter = [paths = std::move(paths)](std::string_view path) {
+        PathMatch match = PathMatch::Skip;
+        for (const std::string& want : paths) {
+            if (path.size() >= want.size() && path.compare(0, want.size(), want) == 0 &&
+                (path.size() == want.size() || path[want.size()] == '.')) {
+                return PathMatch::Include; // the path itself or something below it
+            }
+            if (want.size() > path.size() && want.compare(0, path.size(), path) == 0 && want[path.size()] == '.') {
+                match = PathMatch::Descend; // something below the path is wanted
+            }
         }
+        return match;
+    };
+}
+
+void PickleParser::parsePickle() {
+    size_t i = 0;
+    Builder builder(*this);
+
+    resetMachine();
+    streamOffset = 0;
+    copyStrings = false;
+    try {
+        Scan whole;
+        if (!pathFilter) {
+            i = execute(i, buff.size(), builder);
+        } else if (scan(i, buff.size(), whole) && whole.items.size() == 1) {
+            // Only a root that stays a dict until STOP is filtered.
+            i = executeSelective(i, buff.size(), std::string(), whole.items[0].merged);
+        } else {
+            i = executeSelective(i, buff.size(), std::string(), std::string_view::npos);
+        }
+    } catch (const std::exception& e) {
+        reportError(e);
+        throw;
+    }
+    checkEnd(i);
+}
+
+// Called once a whole-buffer parse has run up to offset i.
+void PickleParser::checkEnd(size_t i) const {
+    size_t file_s = buff.size();
+    if (!stopped) {
+        throw std::runtime_error("Pickle stream ended without STOP");
+    }
+    if (i == file_s) {
+        // Parsing finished exactly at file end and last was STOP, expected good outcome.
     } else if (i > file_s) {
-        std::cerr << "Error: Parser overran buffer by " << (i - file_s) << " bytes. This should not happen." << std::endl;
+        if (diagnostics) *diagnostics << "Error: Parser overran buffer by " << (i - file_s) << " bytes. This should not happen." << std::endl;
     } else { // i < file_s
-         std::cerr << "Warning: Parsing finished prematurely. " << (file_s - i) << " bytes remaining." << std::endl;
+         if (diagnostics) *diagnostics << "Warning: " << (file_s - i) << " trailing bytes after STOP were ignored." << std::endl;
+    }
+}
+
+PickleParser::FeedStatus PickleParser::feed(const char* data, size_t len) {
+    if (!streaming) {
+        resetMachine();
+        pending.clear();
+        streamOffset = 0;
+        copyStrings = true; // chunks are not retained, so values may not view them
+        streaming = true;
+    }
+    if (stopped) {
+        return FeedStatus::Done; // trailing bytes after STOP are ignored
+    }
+
+    // An opcode split across chunks gets just the bytes it still needs and
+    // runs from `pending`; the rest of the chunk is then parsed in place,
+    // so only that one opcode is ever copied.
+    if (!pending.empty()) {
+        size_t need = bytes_to_complete(std::string_view(pending.data(), pending.size()), data, len);
+        if (need == kPickleArgIncomplete) {
+            pending.insert(pending.end(), data, data + len);
+            return FeedStatus::NeedMore;
+        }
+        pending.insert(pending.end(), data, data + need);
+        size_t ran = feedChunk(pending.data(), pending.size());
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(ran));
+        data += need;
+        len -= need;
+        if (!pending.empty() && !stopped) {
+            // Still short, against what the opcode table says; stay correct
+            // by carrying the whole chunk.
+            pending.insert(pending.end(), data, data + len);
+            return FeedStatus::NeedMore;
+        }
+    }
+    if (!stopped) {
+        size_t i = feedChunk(data, len);
+        if (!stopped) pending.assign(data + i, data + len);
     }
-}
\ No newline at end of file
+    if (stopped) pending.clear();
+    return stopped ? FeedStatus::Done : FeedStatus::NeedMore;
+}
+
+// Runs the opcodes in [data, data + len) in place, stopping at STOP or
+// before an opcode that runs past the end; returns the bytes consumed.
+size_t PickleParser::feedChunk(const char* data, size_t len) {
+    buff = std::string_view(data, len);
+    size_t i = 0;
+    Builder builder(*this);
+    try {
+        i = execute(0, buff.size(), builder);
+    } catch (const PickleTruncated&) {
+        i = opcodeOffset; // resume at the incomplete opcode once more bytes arrive
+    } catch (const std::exception& e) {
+        reportError(e);
+        streaming = false;
+        buff = std::string_view();
+        throw;
+    }
+    streamOffset += i;
+    buff = std::string_view();
+    return i;
+}
+
+void PickleParser::finish() {
+    bool complete = stopped;
+    size_t left = pending.size();
+    streaming = false;
+    pending.clear();
+    if (!complete) {
+        throw std::runtime_error("Pickle stream ended without STOP (" + std::to_string(left) +
+                                 " bytes of an incomplete opcode pending)");
+    }
+}
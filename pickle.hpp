@@ -2,28 +2,311 @@
 #define PICKLE_HPP
 
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <unordered_map>
-#include <functional>
 #include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <iostream>
+#include <memory>
+#include "arena.hpp"
+#include "mapped_file.hpp"
+#include "pickle_intern.hpp"
+#include "pickle_value.hpp"
+#include "pickle_visitor.hpp"
+
+// Thrown by handlers whose argument runs past the end of the input. In
+// streaming mode it means "wait for the next chunk" rather than an error.
+class PickleStats;
+
+class PickleTruncated : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
 
 class PickleParser {
 public:
+    enum class InputMode {
+        Read, // copy the file into an owned buffer
+        Mmap, // map the file read-only; nothing is copied
+    };
+
+    // No input yet; bytes are supplied through feed().
+    PickleParser();
     explicit PickleParser(const std::string& fname);
-    void pickleOpener();
+    // Parses a caller-owned buffer in place. The buffer must outlive the
+    // parser and every value obtained from it.
+    PickleParser(const char* data, size_t len);
+
+    // Points the parser at another file, or caller buffer, for the next
+    // pickleOpener(). The arena, the VM vectors and the Read-mode buffer
+    // keep their memory, so one parser reused across many files stops
+    // allocating once it has seen the largest.
+    void setInput(const std::string& fname);
+    void setInput(const char* data, size_t len);
+
+    void pickleOpener(InputMode mode = InputMode::Read,
+                      unsigned advice = MappedFile::AdviseSequential | MappedFile::AdviseWillNeed);
+    // Decodes the stream into a PickleValue tree, available from root().
     void parsePickle();
-    void setParsers();
+    // Decodes the stream into events on `visitor` (see PickleNullVisitor)
+    // instead; no tree is built and root() stays null.
+    template <class V> void parsePickle(V& visitor);
+    void setParsers(); // no-op: the dispatch table is built at compile time
+
+    // Incremental parsing from a pipe, socket or decompressor. Each chunk
+    // is parsed in place; only an opcode split across chunks is carried
+    // over, topped up with just the bytes it still needs, so memory is
+    // bounded by the largest single argument, never by stream size. Strings
+    // are copied into the arena since chunks are not retained. Returns
+    // Done once STOP has run; bytes after it are ignored.
+    enum class FeedStatus { NeedMore, Done };
+    FeedStatus feed(const char* data, size_t len);
+    // Ends the stream; throws if it stopped short of STOP. root() stays
+    // valid until the next parse.
+    void finish();
+
+    // Object left on the stack by STOP. Owned by this parser; strings inside
+    // it view into the input buffer.
+    const PickleValue* root() const { return rootValue; }
+    // The whole input once pickleOpener() has run, e.g. to build a
+    // PickleTape over it.
+    std::string_view input() const { return buff; }
+    // Protocol from the stream's PROTO opcode (0 before one is seen, and
+    // for protocol 0 and 1 streams, which have none).
+    int protocol() const { return cPickleVersion; }
+
+    // Called from BINPERSID with the persistent id as soon as it is decoded,
+    // so callers can start fetching what it names while the rest of the
+    // stream is still being parsed.
+    using PersistentIdHook = std::function<void(const PickleValue* pid)>;
+    void setPersistentIdHook(PersistentIdHook hook) { persistentIdHook = std::move(hook); }
+
+    // Protocol 5 out-of-band buffers (pickle.loads(..., buffers=...)),
+    // handed out in order by NEXT_BUFFER as Buffer values that view them in
+    // place. They must outlive the parse results.
+    void setBuffers(std::vector<std::string_view> buffers) { outOfBand = std::move(buffers); }
+
+    // Profiles every opcode of the following parses into `s` (nullptr
+    // detaches). Only has an effect in builds with PICKLE_STATS, which
+    // kStatsCompiled reports; without it the dispatch loop is unchanged.
+    void setStats(PickleStats* s) { stats = s; }
+    // Where errors (with the offset of the failing opcode) and warnings
+    // such as ignored trailing bytes are written; std::cerr by default,
+    // nullptr drops them.
+    void setDiagnostics(std::ostream* out) { diagnostics = out; }
+#ifdef PICKLE_STATS
+    static constexpr bool kStatsCompiled = true;
+#else
+    static constexpr bool kStatsCompiled = false;
+#endif
+
+    // Interns every Str of up to PickleInternTable::kMaxLength bytes, and
+    // every GLOBAL/STACK_GLOBAL pair, while building the tree: each
+    // distinct string or pair gets one node per parse, viewing the table's
+    // copy, and carries its id in PickleValue::interned. Streaming parses
+    // then copy each name once rather than per occurrence. Without a
+    // table the parser keeps its own, emptied by every parse; a caller's
+    // table is kept across parses and must outlive the values. Visitor
+    // parses are not affected.
+    void setInterning(bool on, PickleInternTable* table = nullptr);
+    // The table in use; nullptr with interning off.
+    const PickleInternTable* internTable() const { return interning; }
+
+    // Selective decoding for parsePickle(). Entries of dicts reached from
+    // the root through string keys are offered to the filter by dotted path
+    // ("dims", "model_state_dict.decoder.ln.weight"): Include decodes the
+    // value in full, Descend filters the entries of the value's own dict
+    // the same way, Skip leaves the entry out. Skipped values are stepped
+    // over by a structural scan that builds and copies nothing; memo entries
+    // they define are rebuilt from their opcodes only if a later GET needs
+    // them. Entries with non-string keys, dicts filled one SETITEM at a time
+    // and dicts inside lists or tuples are always decoded in full. Not
+    // applied by feed().
+    enum class PathMatch { Skip, Descend, Include };
+    using PathFilter = std::function<PathMatch(std::string_view path)>;
+    void setPathFilter(PathFilter filter) { pathFilter = std::move(filter); }
+    // Keeps exactly these paths and everything below them; an empty list
+    // turns selection off.
+    void selectPaths(std::vector<std::string> paths);
 private:
-    using opcodeParser = std::function<size_t(const char*)>;
-    std::unordered_map<unsigned char, opcodeParser> parserMap;
-    std::vector<char> buff;
+    template <class V> struct Dispatch; // 256-slot handler table per visitor type
+    class Builder;                      // visitor behind parsePickle(), in pickle.cpp
+
+    // Result of walking an opcode range by stack effect alone (see scan()).
+    struct ScanItem {
+        size_t start;     // offset of the first opcode that built it
+        size_t merged;    // offset of the last opcode that folded it into a new object
+        size_t lastPut;   // newest PutSite naming it, or npos
+        size_t memoStart; // memoNext when `start` was reached
+    };
+    struct PutSite {
+        size_t index;    // memo index
+        size_t begin;    // opcodes [begin, end) rebuild the memoized object at
+        size_t end;      // the bottom of the stack they leave behind
+        size_t prev;     // older PutSite naming the same item, or npos
+        size_t memoBase; // memoNext at `begin`, for the MEMOIZEs in the range
+    };
+    // How to rebuild a memo entry defined inside a skipped value.
+    struct LazyMemo {
+        size_t begin;
+        size_t end; // 0 when there is nothing to rebuild
+        size_t memoBase;
+    };
+    struct Scan {
+        std::vector<ScanItem> items; // items left at the starting level
+        std::vector<PutSite> puts;
+        size_t stop; // offset of the opcode the scan stopped at
+    };
+
+    std::string_view buff;         // the bytes being parsed, whatever their owner
+    std::vector<char> ownedBuff;   // InputMode::Read storage
+    MappedFile mappedBuff;         // InputMode::Mmap storage
+    unsigned mappedAdvice = 0;     // advice mappedBuff was opened with
+    bool externalBuff;             // buff was supplied by the caller
     unsigned char cPickleVersion; // Changed to unsigned char
     std::string sPickleFileName;
     std::streamsize size; // Changed to std::streamsize for consistency with tellg/read
-    
+
+    // Unpickling VM state, reset by every parsePickle() call.
+    Arena arena;
+    std::vector<PickleValue*> stack;
+    std::vector<size_t> marks; // stack heights at each MARK
+    std::vector<PickleValue*> memo;
+    size_t memoNext = 0; // index MEMOIZE assigns: one past the highest put so far
+    PickleValue* rootValue;
+    bool stopped;
+    PersistentIdHook persistentIdHook;
+    size_t opcodeOffset = 0;  // offset in buff of the opcode being executed
+    size_t streamOffset = 0;  // stream bytes consumed before buff[0]
+    bool copyStrings = false; // buff is transient (streaming)
+    bool streaming = false;
+    std::vector<char> pending; // incomplete opcode carried between chunks
+    PathFilter pathFilter;
+    // Opcode ranges that rebuild memo entries defined inside skipped values;
+    // parallel to memo.
+    std::vector<LazyMemo> memoLazy;
+    std::vector<std::string_view> outOfBand;
+    size_t nextBuffer = 0;   // next outOfBand entry NEXT_BUFFER hands out
+    uint64_t frameEnd = 0;   // stream offset where the current FRAME ends
+    PickleStats* stats = nullptr;
+    std::ostream* diagnostics = &std::cerr;
+    PickleInternTable* interning = nullptr; // null: interning off
+    std::unique_ptr<PickleInternTable> ownInterned;
+    std::vector<PickleValue*> internedStrs;    // this parse's node for each string id
+    std::vector<PickleValue*> internedGlobals; // this parse's node for each pair id
+    std::vector<PickleValue*> bigDicts;        // dicts past PickleValue::kDictScanLimit, merged at STOP
+    std::vector<std::vector<uint64_t>> keyHashes; // per big dict, its keys' hashes by entry (spares kept for reuse)
+    std::vector<uint64_t> keySlots;            // mergeDuplicateKeys() hash table
+
+    void resetMachine();
+    template <bool Profiled, class V> size_t step(size_t i, V& visitor);
+    template <class V> size_t execute(size_t i, size_t end, V& visitor);
+    void checkEnd(size_t i) const;
+    size_t feedChunk(const char* data, size_t len);
+    size_t executeSelective(size_t i, size_t end, const std::string& path, size_t filterFrom);
+    size_t selectDictItems(size_t mark, size_t end, const std::string& path);
+    bool scan(size_t i, size_t end, Scan& out) const;
+    PickleValue* materialize(size_t index);
+    void reportError(const std::exception& e) const;
+    void prefetchFrame(size_t offset, size_t len) const;
+
+    PickleValue* newValue(PickleType type);
+    PickleValue* newString(PickleType type, const char* data, size_t len);
+    PickleValue* newStr(const char* data, size_t len);
+    PickleValue* internedGlobal(uint32_t id);
+    void mergeDuplicateKeys();
+    void push(PickleValue* value) { stack.push_back(value); }
+    PickleValue* pop(const char* op);
+    PickleValue* top(const char* op);
+    size_t popMark(const char* op);
+    PickleValue* makeTuple(size_t first, const char* op);
+    std::string_view textLine(const char* data, const char* op) const;
+    int64_t parseTextInt(std::string_view text, const char* op) const;
+    size_t parseTextIndex(std::string_view text, const char* op) const;
+    double parseTextFloat(std::string_view text, const char* op) const;
+    std::string_view unescapeString(std::string_view text, const char* op);
+    std::string_view unescapeRawUnicode(std::string_view text, const char* op);
+    void memoPut(size_t index, const char* op);
+    PickleValue* memoGet(size_t index, const char* op);
+
+    // Opcode handlers (pickle_handlers.hpp). Each receives a pointer to the
+    // byte after the opcode, decodes its argument, raises the matching
+    // visitor event and returns how many argument bytes it consumed.
+    template <class V> size_t opMark(const char* data, V& v);
+    template <class V> size_t opEmptyTuple(const char* data, V& v);
+    template <class V> size_t opStop(const char* data, V& v);
+    template <class V> size_t opPop(const char* data, V& v);
+    template <class V> size_t opPopMark(const char* data, V& v);
+    template <class V> size_t opDup(const char* data, V& v);
+    template <class V> size_t opBinbytes(const char* data, V& v);
+    template <class V> size_t opBinint(const char* data, V& v);
+    template <class V> size_t opBinint1(const char* data, V& v);
+    template <class V> size_t opLong(const char* data, V& v);
+    template <class V> size_t opBinint2(const char* data, V& v);
+    template <class V> size_t opNone(const char* data, V& v);
+    template <class V> size_t opBinpersid(const char* data, V& v);
+    template <class V> size_t opReduce(const char* data, V& v);
+    template <class V> size_t opBinstring(const char* data, V& v);
+    template <class V> size_t opBinunicode(const char* data, V& v);
+    template <class V> size_t opEmptyList(const char* data, V& v);
+    template <class V> size_t opAppend(const char* data, V& v);
+    template <class V> size_t opBuild(const char* data, V& v);
+    template <class V> size_t opGlobal(const char* data, V& v);
+    template <class V> size_t opAppends(const char* data, V& v);
+    template <class V> size_t opGet(const char* data, V& v);
+    template <class V> size_t opBinget(const char* data, V& v);
+    template <class V> size_t opLongBinget(const char* data, V& v);
+    template <class V> size_t opBinput(const char* data, V& v);
+    template <class V> size_t opLongBinput(const char* data, V& v);
+    template <class V> size_t opSetitem(const char* data, V& v);
+    template <class V> size_t opTuple(const char* data, V& v);
+    template <class V> size_t opSetitems(const char* data, V& v);
+    template <class V> size_t opEmptyDict(const char* data, V& v);
+    template <class V> size_t opProto(const char* data, V& v);
+    template <class V> size_t opTuple1(const char* data, V& v);
+    template <class V> size_t opTuple2(const char* data, V& v);
+    template <class V> size_t opTuple3(const char* data, V& v);
+    template <class V> size_t opNewtrue(const char* data, V& v);
+    template <class V> size_t opNewfalse(const char* data, V& v);
+    template <class V> size_t opLong1(const char* data, V& v);
+    template <class V> size_t opLong4(const char* data, V& v);
+    template <class V> size_t opShortbinunicode(const char* data, V& v);
+    template <class V> size_t opBinunicode8(const char* data, V& v);
+    template <class V> size_t opShortBinbytes(const char* data, V& v);
+    template <class V> size_t opNewobj(const char* data, V& v);
+    template <class V> size_t opBinbytes8(const char* data, V& v);
+    template <class V> size_t opEmptySet(const char* data, V& v);
+    template <class V> size_t opAdditems(const char* data, V& v);
+    template <class V> size_t opFrozenset(const char* data, V& v);
+    template <class V> size_t opNewobjEx(const char* data, V& v);
+    template <class V> size_t opStackGlobal(const char* data, V& v);
+    template <class V> size_t opMemoize(const char* data, V& v);
+    template <class V> size_t opFrame(const char* data, V& v);
+    template <class V> size_t opBytearray8(const char* data, V& v);
+    template <class V> size_t opNextBuffer(const char* data, V& v);
+    template <class V> size_t opReadonlyBuffer(const char* data, V& v);
+    template <class V> size_t opFloat(const char* data, V& v);
+    template <class V> size_t opBinfloat(const char* data, V& v);
+    template <class V> size_t opInt(const char* data, V& v);
+    template <class V> size_t opPersid(const char* data, V& v);
+    template <class V> size_t opString(const char* data, V& v);
+    template <class V> size_t opShortBinstring(const char* data, V& v);
+    template <class V> size_t opUnicode(const char* data, V& v);
+    template <class V> size_t opDict(const char* data, V& v);
+    template <class V> size_t opInst(const char* data, V& v);
+    template <class V> size_t opList(const char* data, V& v);
+    template <class V> size_t opObj(const char* data, V& v);
+    template <class V> size_t opPut(const char* data, V& v);
+    size_t opUnknown(const char* data);
+
     uint32_t read_le32(const char* data) const;
     uint16_t read_le16(const char* data) const;
-    int64_t decode_signed_long(const unsigned char* bytes, size_t len) const;
+    uint64_t read_le64(const char* data) const;
+    int64_t decode_signed_long(const unsigned char* bytes, size_t len, const char* op) const;
 };
 
+#include "pickle_handlers.hpp"
+
 #endif // PICKLE_HPP
\ No newline at end of file
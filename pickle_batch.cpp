@@ -0,0 +1,141 @@
+#include "pickle_batch.hpp"
+#include "pickle_tape.hpp"
+#include "thread_pool.hpp"
+#include "zip_archive.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+bool has_suffix(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// What one pool thread reuses across every file it parses.
+struct BatchWorker {
+    PickleParser parser;
+    PickleTape tape;
+    PickleStats stats;
+    std::ostringstream diagnostics;
+    std::vector<char> inflated; // data.pkl of a .pt that deflated it
+
+    BatchWorker() { parser.setDiagnostics(&diagnostics); }
+
+    void run(PickleBatchFile& file, const PickleBatchOptions& options);
+};
+
+void BatchWorker::run(PickleBatchFile& file, const PickleBatchOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    diagnostics.str(std::string());
+    diagnostics.clear();
+    std::unique_ptr<ZipArchive> zip;
+    try {
+        if (has_suffix(file.path, ".pt")) {
+            zip = std::make_unique<ZipArchive>(file.path);
+            const ZipEntry* pkl = nullptr;
+            for (const ZipEntry& e : zip->entries()) {
+                if (has_suffix(e.name, "/data.pkl")) pkl = &e;
+            }
+            if (!pkl) throw std::runtime_error("no data.pkl in " + file.path);
+            std::string_view bytes;
+            if (pkl->stored()) {
+                bytes = zip->view(*pkl);
+            } else {
+                inflated = zip->extract(*pkl);
+                bytes = std::string_view(inflated.data(), inflated.size());
+            }
+            parser.setInput(bytes.data(), bytes.size());
+        } else {
+            parser.setInput(file.path);
+        }
+        parser.setStats(options.stats ? &stats : nullptr);
+        parser.pickleOpener(options.input);
+        file.bytes = parser.input().size();
+        file.protocol = parser.protocol();
+        switch (options.mode) {
+        case PickleBatchOptions::Mode::Validate: {
+            PickleNullVisitor visitor;
+            parser.parsePickle(visitor);
+            break;
+        }
+        case PickleBatchOptions::Mode::Tree:
+            parser.parsePickle();
+            break;
+        case PickleBatchOptions::Mode::Tape:
+            tape.build(parser.input());
+            break;
+        }
+        file.ok = true;
+    } catch (const std::exception& e) {
+        // The parser has already described the failing opcode, if it got
+        // that far.
+        if (diagnostics.tellp() == 0) diagnostics << e.what();
+    }
+    parser.setInput(nullptr, 0); // drop views into this file before it is unmapped
+    file.message = diagnostics.str();
+    while (!file.message.empty() && file.message.back() == '\n') file.message.pop_back();
+    file.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+std::vector<std::string> findPickles(const std::vector<std::string>& paths) {
+    std::vector<std::string> found;
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(path, ec)) {
+            found.push_back(path);
+            continue;
+        }
+        std::vector<std::string> inside;
+        for (auto it = std::filesystem::recursive_directory_iterator(path, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec)) continue;
+            std::string name = it->path().string();
+            if (has_suffix(name, ".pkl") || has_suffix(name, ".pickle") || has_suffix(name, ".pt")) {
+                inside.push_back(std::move(name));
+            }
+        }
+        std::sort(inside.begin(), inside.end());
+        found.insert(found.end(), inside.begin(), inside.end());
+    }
+    return found;
+}
+
+PickleBatchSummary parseBatch(const std::vector<std::string>& paths, const PickleBatchOptions& options) {
+    PickleBatchSummary summary;
+    summary.files.resize(paths.size());
+    std::vector<std::pair<uint64_t, size_t>> order; // (file size, index)
+    order.reserve(paths.size());
+    for (size_t k = 0; k < paths.size(); ++k) {
+        summary.files[k].path = paths[k];
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(paths[k], ec);
+        order.emplace_back(ec ? 0 : size, k);
+    }
+    std::sort(order.begin(), order.end());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(options.jobs);
+        std::vector<std::unique_ptr<BatchWorker>> workers;
+        for (size_t w = 0; w < pool.size(); ++w) workers.push_back(std::make_unique<BatchWorker>());
+        for (const auto& entry : order) {
+            PickleBatchFile* file = &summary.files[entry.second];
+            pool.submit([&pool, &workers, &options, file] { workers[pool.workerIndex()]->run(*file, options); });
+        }
+        pool.wait();
+        for (const auto& worker : workers) summary.stats.merge(worker->stats);
+    }
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const PickleBatchFile& file : summary.files) {
+        if (!file.ok) ++summary.failed;
+        summary.bytes += file.bytes;
+    }
+    return summary;
+}
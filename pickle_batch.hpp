@@ -0,0 +1,54 @@
+#ifndef PICKLE_BATCH_HPP
+#define PICKLE_BATCH_HPP
+
+#include "pickle.hpp"
+#include "pickle_stats.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PickleBatchOptions {
+    enum class Mode {
+        Validate, // decode with PickleNullVisitor: opcodes known, arguments in bounds, STOP reached
+        Tree,     // build the PickleValue tree, as parsePickle() does
+        Tape,     // only index opcode boundaries (PickleTape)
+    };
+    Mode mode = Mode::Validate;
+    PickleParser::InputMode input = PickleParser::InputMode::Read;
+    size_t jobs = 0; // worker threads; 0 for one per hardware thread
+    // Profile every opcode into PickleBatchSummary::stats (PICKLE_STATS
+    // builds only; Tape mode runs no opcodes).
+    bool stats = false;
+};
+
+struct PickleBatchFile {
+    std::string path;
+    uint64_t bytes = 0; // pickle bytes parsed; data.pkl's for a .pt
+    int protocol = 0;
+    bool ok = false;
+    std::string message; // why it failed, or the parser's warnings
+    double seconds = 0;
+};
+
+struct PickleBatchSummary {
+    std::vector<PickleBatchFile> files; // in the order the paths were given
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0; // wall clock for the whole batch
+    PickleStats stats;  // every worker's profile, merged
+};
+
+// Expands directories (recursively) into the *.pkl, *.pickle and *.pt
+// files under them, sorted; other paths are kept as given.
+std::vector<std::string> findPickles(const std::vector<std::string>& paths);
+
+// Parses every file on a work-stealing pool. Each worker keeps one
+// parser (arena, VM vectors, read buffer) and one tape for all the files
+// it handles. Files are queued smallest first, so each worker starts on
+// the largest in its own queue while idle workers steal the small ones,
+// and a few huge files do not end up last. A .pt file is parsed through
+// the data.pkl inside it. Failures are recorded per file, never thrown.
+PickleBatchSummary parseBatch(const std::vector<std::string>& paths,
+                              const PickleBatchOptions& options = PickleBatchOptions());
+
+#endif // PICKLE_BATCH_HPP
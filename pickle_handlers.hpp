@@ -0,0 +1,713 @@
+#ifndef PICKLE_HANDLERS_HPP
+#define PICKLE_HANDLERS_HPP
+
+// Opcode handlers and the dispatch loop of PickleParser, templated on the
+// visitor that receives their events. Included at the end of pickle.hpp;
+// not meant to be included on its own.
+
+#include "pickle_opcodes.hpp"
+#ifdef PICKLE_STATS
+#include "pickle_stats.hpp"
+#endif
+#include <array>
+#include <cstring>
+#include <string>
+
+// PROTO (0x80)
+template <class V>
+size_t PickleParser::opProto(const char* data, V& v) {
+    if ((data - buff.data()) + 1 > buff.size()) throw PickleTruncated("PROTO: Not enough bytes for version");
+    cPickleVersion = static_cast<unsigned char>(data[0]);
+    if (cPickleVersion > 5) {
+        throw std::runtime_error("PROTO: unsupported pickle protocol " + std::to_string(cPickleVersion));
+    }
+    v.on_proto(cPickleVersion);
+    return 1;
+}
+
+// FRAME (0x95)
+template <class V>
+size_t PickleParser::opFrame(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 8 > buff.size()) throw PickleTruncated("FRAME: Not enough bytes for length");
+    uint64_t len = read_le64(data);
+    uint64_t start = streamOffset + arg_offset + 8;
+    if (start - 9 < frameEnd) {
+        throw std::runtime_error("FRAME: new frame starts " + std::to_string(frameEnd - (start - 9)) +
+                                 " bytes before the end of the previous one");
+    }
+    // A chunk fed in streaming mode need not hold the whole frame; the
+    // opcodes inside are bounds-checked one by one as usual.
+    if (!streaming && len > buff.size() - (arg_offset + 8)) {
+        throw std::runtime_error("FRAME: frame of " + std::to_string(len) + " bytes runs past the end of the input");
+    }
+    frameEnd = start + len;
+    if (!streaming) prefetchFrame(arg_offset + 8, static_cast<size_t>(len));
+    v.on_frame(len);
+    return 8;
+}
+
+// STOP (0x2e '.')
+template <class V>
+size_t PickleParser::opStop(const char*, V& v) { // data not used for 0-arg
+    v.on_stop();
+    stopped = true;
+    return 0;
+}
+
+// MARK (0x28 '(')
+template <class V>
+size_t PickleParser::opMark(const char*, V& v) {
+    v.on_mark();
+    return 0;
+}
+
+// EMPTY_DICT (0x7d '}')
+template <class V>
+size_t PickleParser::opEmptyDict(const char*, V& v) {
+    v.on_dict();
+    return 0;
+}
+
+// EMPTY_SET (0x8f)
+template <class V>
+size_t PickleParser::opEmptySet(const char*, V& v) {
+    v.on_set();
+    return 0;
+}
+
+// ADDITEMS (0x90)
+template <class V>
+size_t PickleParser::opAdditems(const char*, V& v) {
+    v.on_additems();
+    return 0;
+}
+
+// FROZENSET (0x91)
+template <class V>
+size_t PickleParser::opFrozenset(const char*, V& v) {
+    v.on_frozenset();
+    return 0;
+}
+
+// EMPTY_LIST (0x5d ']')
+template <class V>
+size_t PickleParser::opEmptyList(const char*, V& v) {
+    v.on_list();
+    return 0;
+}
+
+// BININT1 (0x4b 'K')
+template <class V>
+size_t PickleParser::opBinint1(const char* data, V& v) {
+    if ((data - buff.data()) + 1 > buff.size()) {
+        throw PickleTruncated("BININT1: Not enough bytes for value");
+    }
+    v.on_int(static_cast<uint8_t>(data[0]));
+    return 1;
+}
+
+// BININT2 (0x4d 'M')
+template <class V>
+size_t PickleParser::opBinint2(const char* data, V& v) {
+    if ((data - buff.data()) + 2 > buff.size()) {
+        throw PickleTruncated("BININT2: Not enough bytes for value");
+    }
+    v.on_int(read_le16(data));
+    return 2;
+}
+
+// BININT (0x4a 'J')
+template <class V>
+size_t PickleParser::opBinint(const char* data, V& v) {
+    if ((data - buff.data()) + 4 > buff.size()) {
+        throw PickleTruncated("BININT: Not enough bytes for value");
+    }
+    v.on_int(static_cast<int32_t>(read_le32(data))); // BININT is signed
+    return 4;
+}
+
+// LONG (0x4c 'L') - decimal text, with the 'L' suffix Python 2 wrote
+template <class V>
+size_t PickleParser::opLong(const char* data, V& v) {
+    std::string_view line = textLine(data, "LONG");
+    std::string_view digits = line;
+    if (!digits.empty() && digits.back() == 'L') digits.remove_suffix(1);
+    v.on_int(parseTextInt(digits, "LONG"));
+    return line.size() + 1;
+}
+
+// INT (0x49 'I') - decimal text; "00" and "01" are protocol 0's False and True
+template <class V>
+size_t PickleParser::opInt(const char* data, V& v) {
+    std::string_view line = textLine(data, "INT");
+    if (line == "00" || line == "01") {
+        v.on_bool(line[1] == '1');
+    } else {
+        v.on_int(parseTextInt(line, "INT"));
+    }
+    return line.size() + 1;
+}
+
+// FLOAT (0x46 'F') - repr() text
+template <class V>
+size_t PickleParser::opFloat(const char* data, V& v) {
+    std::string_view line = textLine(data, "FLOAT");
+    v.on_float(parseTextFloat(line, "FLOAT"));
+    return line.size() + 1;
+}
+
+// BINFLOAT (0x47 'G') - big-endian IEEE 754 double
+template <class V>
+size_t PickleParser::opBinfloat(const char* data, V& v) {
+    if ((data - buff.data()) + 8 > buff.size()) throw PickleTruncated("BINFLOAT: Not enough bytes for value");
+    uint64_t bits = 0;
+    for (int b = 0; b < 8; ++b) bits = (bits << 8) | static_cast<unsigned char>(data[b]);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    v.on_float(value);
+    return 8;
+}
+
+// LONG1 (0x8a)
+template <class V>
+size_t PickleParser::opLong1(const char* d, V& v) {
+    size_t arg_offset = d - buff.data();
+    if (arg_offset + 1 > buff.size()) throw PickleTruncated("LONG1: Not enough bytes for length");
+    uint8_t len = static_cast<uint8_t>(d[0]);
+    if (arg_offset + 1 + len > buff.size()) {
+         throw PickleTruncated("LONG1: Insufficient data for value. Need " + std::to_string(len) + " value bytes.");
+    }
+    v.on_int(decode_signed_long(reinterpret_cast<const unsigned char*>(d + 1), len, "LONG1"));
+    return 1 + len;
+}
+
+// LONG4 (0x8b)
+template <class V>
+size_t PickleParser::opLong4(const char* d, V& v) {
+    size_t arg_offset = d - buff.data();
+    if (arg_offset + 4 > buff.size()) throw PickleTruncated("LONG4: Not enough bytes for length");
+    uint32_t len_val = read_le32(d);
+    size_t len = static_cast<size_t>(len_val);
+    if (arg_offset + 4 + len > buff.size()) {
+        throw PickleTruncated("LONG4: Insufficient data for value. Need " + std::to_string(len) + " value bytes.");
+    }
+    v.on_int(decode_signed_long(reinterpret_cast<const unsigned char*>(d + 4), len, "LONG4"));
+    return 4 + len;
+}
+
+// STRING (0x53 'S') - quoted repr() of a byte string, escapes and all
+template <class V>
+size_t PickleParser::opString(const char* data, V& v) {
+    std::string_view line = textLine(data, "STRING");
+    if (line.size() < 2 || line.front() != line.back() || (line.front() != '\'' && line.front() != '"')) {
+        throw std::runtime_error("STRING: argument is not quoted");
+    }
+    v.on_str(unescapeString(line.substr(1, line.size() - 2), "STRING"));
+    return line.size() + 1;
+}
+
+// UNICODE (0x56 'V') - raw-unicode-escape text
+template <class V>
+size_t PickleParser::opUnicode(const char* data, V& v) {
+    std::string_view line = textLine(data, "UNICODE");
+    v.on_str(unescapeRawUnicode(line, "UNICODE"));
+    return line.size() + 1;
+}
+
+// BINUNICODE (0x58 'X')
+template <class V>
+size_t PickleParser::opBinunicode(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 4 > buff.size()) throw PickleTruncated("BINUNICODE: Not enough bytes for length");
+    uint32_t len_val = read_le32(data);
+    size_t len = static_cast<size_t>(len_val);
+    if (arg_offset + 4 + len > buff.size()) throw PickleTruncated("BINUNICODE: Not enough bytes for string (len: " + std::to_string(len) + ")");
+    v.on_str(std::string_view(data + 4, len));
+    return 4 + len;
+}
+
+// BINSTRING (0x54 'T')
+template <class V>
+size_t PickleParser::opBinstring(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 4 > buff.size()) throw PickleTruncated("BINSTRING: Not enough bytes for length");
+    uint32_t len_val = read_le32(data);
+    size_t len = static_cast<size_t>(len_val);
+    if (arg_offset + 4 + len > buff.size()) throw PickleTruncated("BINSTRING: Not enough bytes for string (len: " + std::to_string(len) + ")");
+    v.on_str(std::string_view(data + 4, len));
+    return 4 + len;
+}
+
+// SHORT_BINSTRING (0x55 'U')
+template <class V>
+size_t PickleParser::opShortBinstring(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 1 > buff.size()) throw PickleTruncated("SHORT_BINSTRING: Not enough bytes for length");
+    uint8_t len = static_cast<uint8_t>(data[0]);
+    if (arg_offset + 1 + len > buff.size()) throw PickleTruncated("SHORT_BINSTRING: Not enough bytes for string (len: " + std::to_string(len) + ")");
+    v.on_str(std::string_view(data + 1, len));
+    return 1 + len;
+}
+
+// SHORTBINUNICODE (0x8c)
+template <class V>
+size_t PickleParser::opShortbinunicode(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 1 > buff.size()) throw PickleTruncated("SHORTBINUNICODE: Not enough bytes for length");
+    uint8_t len = static_cast<uint8_t>(data[0]);
+    if (arg_offset + 1 + len > buff.size()) throw PickleTruncated("SHORTBINUNICODE: Not enough bytes for string (len: " + std::to_string(len) + ")");
+    v.on_str(std::string_view(data + 1, len));
+    return 1 + len;
+}
+
+// BINUNICODE8 (user's 0x8d)
+template <class V>
+size_t PickleParser::opBinunicode8(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 8 > buff.size()) {
+        throw PickleTruncated("BINUNICODE8: Not enough bytes for length");
+    }
+    uint64_t len_val = read_le64(data);
+    size_t len = static_cast<size_t>(len_val);
+    if (len_val > (buff.size() - (arg_offset + 8)) ) { // Check if declared length fits remaining buffer
+         throw PickleTruncated("BINUNICODE8: Declared length " + std::to_string(len_val) + " exceeds remaining buffer space.");
+    }
+    v.on_str(std::string_view(data + 8, len));
+    return 8 + len;
+}
+
+// BINBYTES (0x42 'B')
+template <class V>
+size_t PickleParser::opBinbytes(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 4 > buff.size()) throw PickleTruncated("BINBYTES: Not enough bytes for length");
+    uint32_t len_val = read_le32(data);
+    size_t len = static_cast<size_t>(len_val);
+    if (arg_offset + 4 + len > buff.size()) throw PickleTruncated("BINBYTES: Not enough bytes for data (len: " + std::to_string(len) + ")");
+    v.on_bytes(std::string_view(data + 4, len));
+    return 4 + len;
+}
+
+// SHORT_BINBYTES (0x43 'C')
+template <class V>
+size_t PickleParser::opShortBinbytes(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 1 > buff.size()) throw PickleTruncated("SHORT_BINBYTES: Not enough bytes for length");
+    uint8_t len = static_cast<uint8_t>(data[0]);
+    if (arg_offset + 1 + len > buff.size()) throw PickleTruncated("SHORT_BINBYTES: Not enough bytes for data (len: " + std::to_string(len) + ")");
+    v.on_bytes(std::string_view(data + 1, len));
+    return 1 + len;
+}
+
+// BINBYTES8 (0x8e)
+template <class V>
+size_t PickleParser::opBinbytes8(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 8 > buff.size()) throw PickleTruncated("BINBYTES8: Not enough bytes for length");
+    uint64_t len = read_le64(data);
+    if (len > buff.size() - (arg_offset + 8)) {
+        throw PickleTruncated("BINBYTES8: Not enough bytes for data (len: " + std::to_string(len) + ")");
+    }
+    v.on_bytes(std::string_view(data + 8, static_cast<size_t>(len)));
+    return 8 + static_cast<size_t>(len);
+}
+
+// BYTEARRAY8 (0x96)
+template <class V>
+size_t PickleParser::opBytearray8(const char* data, V& v) {
+    size_t arg_offset = data - buff.data();
+    if (arg_offset + 8 > buff.size()) throw PickleTruncated("BYTEARRAY8: Not enough bytes for length");
+    uint64_t len = read_le64(data);
+    if (len > buff.size() - (arg_offset + 8)) {
+        throw PickleTruncated("BYTEARRAY8: Not enough bytes for data (len: " + std::to_string(len) + ")");
+    }
+    v.on_bytearray(std::string_view(data + 8, static_cast<size_t>(len)));
+    return 8 + static_cast<size_t>(len);
+}
+
+// NEXT_BUFFER (0x97)
+template <class V>
+size_t PickleParser::opNextBuffer(const char*, V& v) {
+    if (nextBuffer >= outOfBand.size()) {
+        throw std::runtime_error(outOfBand.empty()
+                                     ? "NEXT_BUFFER: stream uses out-of-band buffers but none were given"
+                                     : "NEXT_BUFFER: ran out of out-of-band buffers after " +
+                                           std::to_string(outOfBand.size()));
+    }
+    v.on_buffer(outOfBand[nextBuffer++]);
+    return 0;
+}
+
+// READONLY_BUFFER (0x98)
+template <class V>
+size_t PickleParser::opReadonlyBuffer(const char*, V& v) {
+    v.on_readonly_buffer();
+    return 0;
+}
+
+// GLOBAL (0x63 'c')
+template <class V>
+size_t PickleParser::opGlobal(const char* data, V& v) {
+    std::string_view module = textLine(data, "GLOBAL");
+    std::string_view name = textLine(data + module.size() + 1, "GLOBAL");
+    v.on_global(module, name);
+    return module.size() + name.size() + 2;
+}
+
+// INST (0x69 'i') - GLOBAL's two lines, applied to everything above the
+// topmost MARK
+template <class V>
+size_t PickleParser::opInst(const char* data, V& v) {
+    std::string_view module = textLine(data, "INST");
+    std::string_view name = textLine(data + module.size() + 1, "INST");
+    v.on_inst(module, name);
+    return module.size() + name.size() + 2;
+}
+
+// OBJ (0x6f 'o')
+template <class V>
+size_t PickleParser::opObj(const char*, V& v) {
+    v.on_obj();
+    return 0;
+}
+
+// STACK_GLOBAL (0x93)
+template <class V>
+size_t PickleParser::opStackGlobal(const char*, V& v) {
+    v.on_stack_global();
+    return 0;
+}
+
+// PUT (0x70 'p') - decimal text index
+template <class V>
+size_t PickleParser::opPut(const char* data, V& v) {
+    std::string_view line = textLine(data, "PUT");
+    size_t index = parseTextIndex(line, "PUT");
+    if (index >= memoNext) memoNext = index + 1;
+    v.on_memo_put(index);
+    return line.size() + 1;
+}
+
+// BINPUT (0x71 'q')
+template <class V>
+size_t PickleParser::opBinput(const char* data, V& v) {
+    if ((data - buff.data()) + 1 > buff.size()) throw PickleTruncated("BINPUT: Not enough bytes for index");
+    size_t index = static_cast<uint8_t>(data[0]);
+    if (index >= memoNext) memoNext = index + 1;
+    v.on_memo_put(index);
+    return 1;
+}
+
+// MEMOIZE (0x94)
+template <class V>
+size_t PickleParser::opMemoize(const char*, V& v) {
+    v.on_memo_put(memoNext++);
+    return 0;
+}
+
+// BINGET (0x68 'h')
+template <class V>
+size_t PickleParser::opBinget(const char* data, V& v) {
+    if ((data - buff.data()) + 1 > buff.size()) throw PickleTruncated("BINGET: Not enough bytes for index");
+    v.on_memo_get(static_cast<uint8_t>(data[0]));
+    return 1;
+}
+
+// GET (0x67 'g') - decimal text index
+template <class V>
+size_t PickleParser::opGet(const char* data, V& v) {
+    std::string_view line = textLine(data, "GET");
+    v.on_memo_get(parseTextIndex(line, "GET"));
+    return line.size() + 1;
+}
+
+// LONG_BINPUT (0x72 'r')
+template <class V>
+size_t PickleParser::opLongBinput(const char* data, V& v) {
+    if ((data - buff.data()) + 4 > buff.size()) {
+        throw PickleTruncated("LONG_BINPUT (0x72): Not enough bytes for 4-byte index");
+    }
+    size_t index = read_le32(data);
+    if (index >= memoNext) memoNext = index + 1;
+    v.on_memo_put(index);
+    return 4;
+}
+
+// LONG_BINGET (0x6A 'j')
+template <class V>
+size_t PickleParser::opLongBinget(const char* data, V& v) {
+    if ((data - buff.data()) + 4 > buff.size()) {
+        throw PickleTruncated("LONG_BINGET (0x6A): Not enough bytes for 4-byte index");
+    }
+    v.on_memo_get(read_le32(data));
+    return 4;
+}
+
+// SETITEMS (0x75 'u')
+template <class V>
+size_t PickleParser::opSetitems(const char*, V& v) {
+    v.on_setitems();
+    return 0;
+}
+
+// LIST (0x6c 'l')
+template <class V>
+size_t PickleParser::opList(const char*, V& v) {
+    v.on_marked_list();
+    return 0;
+}
+
+// DICT (0x64 'd')
+template <class V>
+size_t PickleParser::opDict(const char*, V& v) {
+    v.on_marked_dict();
+    return 0;
+}
+
+// TUPLE (0x74 't')
+template <class V>
+size_t PickleParser::opTuple(const char*, V& v) {
+    v.on_tuple(kPopToMark);
+    return 0;
+}
+
+// APPEND (0x61 'a')
+template <class V>
+size_t PickleParser::opAppend(const char*, V& v) {
+    v.on_append();
+    return 0;
+}
+
+// APPENDS (0x65 'e')
+template <class V>
+size_t PickleParser::opAppends(const char*, V& v) {
+    v.on_appends();
+    return 0;
+}
+
+// SETITEM (0x73 's')
+template <class V>
+size_t PickleParser::opSetitem(const char*, V& v) {
+    v.on_setitem();
+    return 0;
+}
+
+// BUILD (0x62 'b')
+template <class V>
+size_t PickleParser::opBuild(const char*, V& v) {
+    v.on_build();
+    return 0;
+}
+
+// REDUCE (0x52 'R')
+template <class V>
+size_t PickleParser::opReduce(const char*, V& v) {
+    v.on_reduce();
+    return 0;
+}
+
+// NEWOBJ (0x81)
+template <class V>
+size_t PickleParser::opNewobj(const char*, V& v) {
+    v.on_newobj();
+    return 0;
+}
+
+// NEWOBJ_EX (0x92)
+template <class V>
+size_t PickleParser::opNewobjEx(const char*, V& v) {
+    v.on_newobj_ex();
+    return 0;
+}
+
+// PERSID (0x50 'P') - the persistent id as a line of text
+template <class V>
+size_t PickleParser::opPersid(const char* data, V& v) {
+    std::string_view line = textLine(data, "PERSID");
+    v.on_text_persid(line);
+    return line.size() + 1;
+}
+
+// BINPERSID (0x51 'Q')
+template <class V>
+size_t PickleParser::opBinpersid(const char*, V& v) {
+    v.on_persid();
+    return 0;
+}
+
+// TUPLE1 (0x85)
+template <class V>
+size_t PickleParser::opTuple1(const char*, V& v) {
+    v.on_tuple(1);
+    return 0;
+}
+
+// TUPLE2 (0x86)
+template <class V>
+size_t PickleParser::opTuple2(const char*, V& v) {
+    v.on_tuple(2);
+    return 0;
+}
+
+// TUPLE3 (0x87)
+template <class V>
+size_t PickleParser::opTuple3(const char*, V& v) {
+    v.on_tuple(3);
+    return 0;
+}
+
+// NEWFALSE (0x89)
+template <class V>
+size_t PickleParser::opNewfalse(const char*, V& v) {
+    v.on_bool(false);
+    return 0;
+}
+
+// NEWTRUE (0x88)
+template <class V>
+size_t PickleParser::opNewtrue(const char*, V& v) {
+    v.on_bool(true);
+    return 0;
+}
+
+// NONE (0x4e 'N')
+template <class V>
+size_t PickleParser::opNone(const char*, V& v) {
+    v.on_none();
+    return 0;
+}
+
+// EMPTY_TUPLE (0x29 ')')
+template <class V>
+size_t PickleParser::opEmptyTuple(const char*, V& v) {
+    v.on_tuple(0);
+    return 0;
+}
+
+// DUP (0x32 '2')
+template <class V>
+size_t PickleParser::opDup(const char*, V& v) {
+    v.on_dup();
+    return 0;
+}
+
+// POP (0x30 '0')
+template <class V>
+size_t PickleParser::opPop(const char*, V& v) {
+    v.on_pop();
+    return 0;
+}
+
+// POP_MARK (0x31 '1')
+template <class V>
+size_t PickleParser::opPopMark(const char*, V& v) {
+    v.on_pop_mark();
+    return 0;
+}
+
+template <class V>
+struct PickleParser::Dispatch {
+    using Handler = size_t (*)(PickleParser&, const char*, V&);
+
+    // Member handlers are bound at compile time, so each slot is a plain
+    // function pointer and both the handler and the visitor calls it makes
+    // inline into the thunk.
+    template <size_t (PickleParser::*Op)(const char*, V&)>
+    static size_t thunk(PickleParser& parser, const char* data, V& visitor) {
+        return (parser.*Op)(data, visitor);
+    }
+
+    static size_t unknown(PickleParser& parser, const char* data, V&) {
+        return parser.opUnknown(data);
+    }
+
+    static constexpr std::array<Handler, 256> build() {
+        std::array<Handler, 256> slots{};
+        for (size_t op = 0; op < slots.size(); ++op) {
+            slots[op] = &unknown;
+        }
+#define PICKLE_OPCODE_SLOT(name, byte, handler, arg, pops, pushes) slots[byte] = &thunk<&PickleParser::handler<V>>;
+        PICKLE_OPCODES(PICKLE_OPCODE_SLOT)
+#undef PICKLE_OPCODE_SLOT
+        return slots;
+    }
+
+    static const std::array<Handler, 256> table;
+};
+
+// Defined out of class so build() is complete; still constant-initialised.
+template <class V>
+constexpr std::array<typename PickleParser::Dispatch<V>::Handler, 256> PickleParser::Dispatch<V>::table =
+    PickleParser::Dispatch<V>::build();
+
+// Runs the opcode at buff[i] and returns the offset of the next one.
+// Profiled steps also record it into stats.
+template <bool Profiled, class V>
+inline size_t PickleParser::step(size_t i, V& visitor) {
+#ifdef PICKLE_STATS
+    uint64_t started = Profiled ? PickleStats::now() : 0;
+#endif
+    opcodeOffset = i;
+    unsigned char opcode = static_cast<unsigned char>(buff[i]);
+    visitor.on_opcode(opcode, streamOffset + i);
+    // Pass pointer to the byte *after* the current opcode.
+    // Handlers are responsible for their own bounds checking.
+    const char* data = buff.data() + i + 1;
+    size_t consumed_args_length = 0;
+#ifdef PICKLE_SWITCH_DISPATCH
+    switch (opcode) {
+#define PICKLE_OPCODE_CASE(name, byte, handler, arg, pops, pushes) case byte: consumed_args_length = handler(data, visitor); break;
+    PICKLE_OPCODES(PICKLE_OPCODE_CASE)
+#undef PICKLE_OPCODE_CASE
+    default: consumed_args_length = opUnknown(data); break;
+    }
+#else
+    consumed_args_length = Dispatch<V>::table[opcode](*this, data, visitor);
+#endif
+#ifdef PICKLE_STATS
+    if constexpr (Profiled) {
+        stats->record(opcode, consumed_args_length, streamOffset + i, PickleStats::now() - started, stack.size(),
+                      marks.size(), memo.size());
+    }
+#endif
+    return i + 1 + consumed_args_length; // 1 for opcode, plus length of its arguments
+}
+
+// Runs opcodes from buff[i] until STOP or `end` and returns the offset
+// reached. When a handler throws, opcodeOffset still points at the opcode
+// that failed.
+template <class V>
+size_t PickleParser::execute(size_t i, size_t end, V& visitor) {
+#ifdef PICKLE_STATS
+    // Decided once per call, so an unprofiled parse runs the same loop as
+    // a build without PICKLE_STATS.
+    if (stats) {
+        while (i < end && !stopped) {
+            i = step<true>(i, visitor);
+        }
+        return i;
+    }
+#endif
+    while (i < end && !stopped) {
+        i = step<false>(i, visitor);
+    }
+    return i;
+}
+
+template <class V>
+void PickleParser::parsePickle(V& visitor) {
+    resetMachine();
+    streamOffset = 0;
+    copyStrings = false;
+    size_t i = 0;
+    try {
+        i = execute(i, buff.size(), visitor);
+    } catch (const std::exception& e) {
+        reportError(e);
+        throw;
+    }
+    checkEnd(i);
+}
+
+#endif // PICKLE_HANDLERS_HPP
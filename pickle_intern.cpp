@@ -0,0 +1,93 @@
+#include "pickle_intern.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Eight bytes per multiply; the strings interned are names, mostly well
+// under 64 bytes.
+uint64_t PickleInternTable::hashOf(std::string_view text) {
+    constexpr uint64_t kMul = 0xff51afd7ed558ccdULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ text.size();
+    size_t k = 0;
+    for (; k + 8 <= text.size(); k += 8) {
+        uint64_t w;
+        std::memcpy(&w, text.data() + k, 8);
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    }
+    if (k < text.size()) {
+        uint64_t w = 0;
+        std::memcpy(&w, text.data() + k, text.size() - k);
+        h = (h ^ w) * kMul;
+        h ^= h >> 32;
+    }
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 32);
+}
+
+// Slot holding `text`, or the empty slot where it would go.
+size_t PickleInternTable::slotOf(std::string_view text, uint64_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t s = hash & mask;; s = (s + 1) & mask) {
+        uint32_t id = slots[s];
+        if (id == kNone) return s;
+        const Entry& e = entries[id];
+        if (e.hash == hash && e.len == text.size() && std::memcmp(e.data, text.data(), text.size()) == 0) return s;
+    }
+}
+
+// Doubles the slot array once it is half full.
+void PickleInternTable::grow() {
+    slots.assign(slots.empty() ? 64 : slots.size() * 2, kNone);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 1; id < entries.size(); ++id) {
+        size_t s = entries[id].hash & mask;
+        while (slots[s] != kNone) s = (s + 1) & mask;
+        slots[s] = id;
+    }
+}
+
+uint32_t PickleInternTable::intern(std::string_view text) {
+    if (2 * entries.size() >= slots.size()) grow();
+    uint64_t h = hashOf(text);
+    size_t s = slotOf(text, h);
+    if (slots[s] != kNone) return slots[s];
+    char* copy = static_cast<char*>(storage.allocate(text.size() ? text.size() : 1, 1));
+    std::memcpy(copy, text.data(), text.size());
+    uint32_t id = static_cast<uint32_t>(entries.size());
+    entries.push_back({copy, static_cast<uint32_t>(text.size()), h});
+    slots[s] = id;
+    return id;
+}
+
+uint32_t PickleInternTable::find(std::string_view text) const {
+    if (slots.empty()) return kNone;
+    return slots[slotOf(text, hashOf(text))];
+}
+
+uint32_t PickleInternTable::internGlobal(uint32_t module, uint32_t name) {
+    uint64_t key = static_cast<uint64_t>(module) << 32 | name;
+    auto it = globalIds.find(key);
+    if (it != globalIds.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(globalList.size());
+    globalList.push_back({module, name});
+    globalIds.emplace(key, id);
+    return id;
+}
+
+uint32_t PickleInternTable::findGlobal(std::string_view module, std::string_view name) const {
+    uint32_t m = find(module);
+    uint32_t n = find(name);
+    if (m == kNone || n == kNone) return kNone;
+    auto it = globalIds.find(static_cast<uint64_t>(m) << 32 | n);
+    return it == globalIds.end() ? kNone : it->second;
+}
+
+void PickleInternTable::clear() {
+    storage.reset();
+    entries.resize(1);
+    std::fill(slots.begin(), slots.end(), kNone); // keeps its size: the next parse likely needs as many
+
+    globalList.resize(1);
+    globalIds.clear();
+}
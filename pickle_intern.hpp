@@ -0,0 +1,75 @@
+#ifndef PICKLE_INTERN_HPP
+#define PICKLE_INTERN_HPP
+
+#include "arena.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Deduplicated strings and GLOBAL (module, name) pairs, each named by a
+// small integer id. Ids are dense from 1 (0 is kNone) and stable for the
+// table's lifetime, so two interned strings are equal exactly when their
+// ids are, and a caller can resolve the classes it dispatches on once,
+// with internGlobal(), then compare ids. Text is copied into the table
+// and stays valid until clear() or destruction.
+//
+// PickleParser fills one when interning is on (setInterning()). A table
+// may be shared by parses run one after another, not by parsers running
+// at the same time.
+class PickleInternTable {
+public:
+    static constexpr uint32_t kNone = 0;
+    // Longest Str the parser interns; longer ones are payloads rather than
+    // names and are left as views.
+    static constexpr size_t kMaxLength = 128;
+
+    // Id of `text`, adding it first if it is new.
+    uint32_t intern(std::string_view text);
+    // Id of `text`, or kNone if it has not been interned.
+    uint32_t find(std::string_view text) const;
+    std::string_view str(uint32_t id) const { return {entries[id].data, entries[id].len}; }
+    // Hash computed when the string was added.
+    uint64_t hash(uint32_t id) const { return entries[id].hash; }
+    size_t size() const { return entries.size() - 1; }
+
+    // Id of the (module, name) pair, adding it first if it is new. Global
+    // ids are numbered apart from string ids.
+    uint32_t internGlobal(uint32_t module, uint32_t name);
+    uint32_t internGlobal(std::string_view module, std::string_view name) {
+        return internGlobal(intern(module), intern(name));
+    }
+    // Id of the pair, or kNone if it has not been interned.
+    uint32_t findGlobal(std::string_view module, std::string_view name) const;
+    uint32_t globalModule(uint32_t id) const { return globalList[id].module; }
+    uint32_t globalName(uint32_t id) const { return globalList[id].name; }
+    size_t globalCount() const { return globalList.size() - 1; }
+
+    // Forgets every string and pair; ids restart from 1.
+    void clear();
+
+    static uint64_t hashOf(std::string_view text);
+
+private:
+    struct Entry {
+        const char* data;
+        uint32_t len;
+        uint64_t hash;
+    };
+    struct Pair {
+        uint32_t module;
+        uint32_t name;
+    };
+
+    size_t slotOf(std::string_view text, uint64_t hash) const;
+    void grow();
+
+    Arena storage{16 * 1024};                         // the interned text
+    std::vector<Entry> entries{Entry{nullptr, 0, 0}}; // by id
+    std::vector<uint32_t> slots;                      // ids by hash, open addressing; kNone when empty
+    std::vector<Pair> globalList{Pair{kNone, kNone}}; // by global id
+    std::unordered_map<uint64_t, uint32_t> globalIds; // module id << 32 | name id
+};
+
+#endif // PICKLE_INTERN_HPP
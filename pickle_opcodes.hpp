@@ -0,0 +1,160 @@
+#ifndef PICKLE_OPCODES_HPP
+#define PICKLE_OPCODES_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// How an opcode's argument is laid out after the opcode byte.
+enum class PickleArg : uint8_t {
+    None,
+    U1, U2, U4, U8,    // fixed width (little-endian integers; BINFLOAT is a big-endian double)
+    Len1, Len4, Len8,  // little-endian length, then that many bytes
+    Line,              // one '\n'-terminated line
+    Line2,             // two '\n'-terminated lines
+};
+
+// Stack effects that are not a plain item count.
+constexpr int kPopToMark = -1; // pops everything down to and including the topmost MARK
+constexpr int kPushMark = -1;  // pushes a MARK
+
+// Every opcode PickleParser has a handler for, as
+// X(NAME, byte, handler, argument layout, items popped, items pushed).
+// Expanded into the compile-time dispatch table (and the switch used when
+// PICKLE_SWITCH_DISPATCH is defined) and into kPickleOps, which lets the
+// structural scanners walk a stream without running any handler. Adding
+// an opcode means adding one line here plus its handler.
+#define PICKLE_OPCODES(X) \
+    X(MARK,            0x28, opMark,            None,  0,          kPushMark) \
+    X(EMPTY_TUPLE,     0x29, opEmptyTuple,      None,  0,          1) \
+    X(STOP,            0x2e, opStop,            None,  1,          0) \
+    X(POP,             0x30, opPop,             None,  1,          0) \
+    X(POP_MARK,        0x31, opPopMark,         None,  kPopToMark, 0) \
+    X(DUP,             0x32, opDup,             None,  0,          1) \
+    X(BINBYTES,        0x42, opBinbytes,        Len4,  0,          1) \
+    X(SHORT_BINBYTES,  0x43, opShortBinbytes,   Len1,  0,          1) \
+    X(FLOAT,           0x46, opFloat,           Line,  0,          1) \
+    X(BINFLOAT,        0x47, opBinfloat,        U8,    0,          1) \
+    X(INT,             0x49, opInt,             Line,  0,          1) \
+    X(BININT,          0x4a, opBinint,          U4,    0,          1) \
+    X(BININT1,         0x4b, opBinint1,         U1,    0,          1) \
+    X(LONG,            0x4c, opLong,            Line,  0,          1) \
+    X(BININT2,         0x4d, opBinint2,         U2,    0,          1) \
+    X(NONE,            0x4e, opNone,            None,  0,          1) \
+    X(PERSID,          0x50, opPersid,          Line,  0,          1) \
+    X(BINPERSID,       0x51, opBinpersid,       None,  1,          1) \
+    X(REDUCE,          0x52, opReduce,          None,  2,          1) \
+    X(STRING,          0x53, opString,          Line,  0,          1) \
+    X(BINSTRING,       0x54, opBinstring,       Len4,  0,          1) \
+    X(SHORT_BINSTRING, 0x55, opShortBinstring,  Len1,  0,          1) \
+    X(UNICODE,         0x56, opUnicode,         Line,  0,          1) \
+    X(BINUNICODE,      0x58, opBinunicode,      Len4,  0,          1) \
+    X(EMPTY_LIST,      0x5d, opEmptyList,       None,  0,          1) \
+    X(APPEND,          0x61, opAppend,          None,  1,          0) \
+    X(BUILD,           0x62, opBuild,           None,  1,          0) \
+    X(GLOBAL,          0x63, opGlobal,          Line2, 0,          1) \
+    X(DICT,            0x64, opDict,            None,  kPopToMark, 1) \
+    X(APPENDS,         0x65, opAppends,         None,  kPopToMark, 0) \
+    X(GET,             0x67, opGet,             Line,  0,          1) \
+    X(BINGET,          0x68, opBinget,          U1,    0,          1) \
+    X(INST,            0x69, opInst,            Line2, kPopToMark, 1) \
+    X(LONG_BINGET,     0x6a, opLongBinget,      U4,    0,          1) \
+    X(LIST,            0x6c, opList,            None,  kPopToMark, 1) \
+    X(OBJ,             0x6f, opObj,             None,  kPopToMark, 1) \
+    X(PUT,             0x70, opPut,             Line,  0,          0) \
+    X(BINPUT,          0x71, opBinput,          U1,    0,          0) \
+    X(LONG_BINPUT,     0x72, opLongBinput,      U4,    0,          0) \
+    X(SETITEM,         0x73, opSetitem,         None,  2,          0) \
+    X(TUPLE,           0x74, opTuple,           None,  kPopToMark, 1) \
+    X(SETITEMS,        0x75, opSetitems,        None,  kPopToMark, 0) \
+    X(EMPTY_DICT,      0x7d, opEmptyDict,       None,  0,          1) \
+    X(PROTO,           0x80, opProto,           U1,    0,          0) \
+    X(NEWOBJ,          0x81, opNewobj,          None,  2,          1) \
+    X(TUPLE1,          0x85, opTuple1,          None,  1,          1) \
+    X(TUPLE2,          0x86, opTuple2,          None,  2,          1) \
+    X(TUPLE3,          0x87, opTuple3,          None,  3,          1) \
+    X(NEWTRUE,         0x88, opNewtrue,         None,  0,          1) \
+    X(NEWFALSE,        0x89, opNewfalse,        None,  0,          1) \
+    X(LONG1,           0x8a, opLong1,           Len1,  0,          1) \
+    X(LONG4,           0x8b, opLong4,           Len4,  0,          1) \
+    X(SHORTBINUNICODE, 0x8c, opShortbinunicode, Len1,  0,          1) \
+    X(BINUNICODE8,     0x8d, opBinunicode8,     Len8,  0,          1) \
+    X(BINBYTES8,       0x8e, opBinbytes8,       Len8,  0,          1) \
+    X(EMPTY_SET,       0x8f, opEmptySet,        None,  0,          1) \
+    X(ADDITEMS,        0x90, opAdditems,        None,  kPopToMark, 0) \
+    X(FROZENSET,       0x91, opFrozenset,       None,  kPopToMark, 1) \
+    X(NEWOBJ_EX,       0x92, opNewobjEx,        None,  3,          1) \
+    X(STACK_GLOBAL,    0x93, opStackGlobal,     None,  2,          1) \
+    X(MEMOIZE,         0x94, opMemoize,         None,  0,          0) \
+    X(FRAME,           0x95, opFrame,           U8,    0,          0) \
+    X(BYTEARRAY8,      0x96, opBytearray8,      Len8,  0,          1) \
+    X(NEXT_BUFFER,     0x97, opNextBuffer,      None,  0,          1) \
+    X(READONLY_BUFFER, 0x98, opReadonlyBuffer,  None,  1,          1)
+
+struct PickleOpInfo {
+    const char* name; // nullptr for bytes that are not opcodes
+    PickleArg arg;
+    int8_t pops;
+    int8_t pushes;
+};
+
+constexpr std::array<PickleOpInfo, 256> makePickleOpInfo() {
+    std::array<PickleOpInfo, 256> ops{};
+#define PICKLE_OPCODE_INFO(name, byte, handler, arg, pops, pushes) \
+    ops[byte] = PickleOpInfo{#name, PickleArg::arg, pops, pushes};
+    PICKLE_OPCODES(PICKLE_OPCODE_INFO)
+#undef PICKLE_OPCODE_INFO
+    return ops;
+}
+
+inline constexpr std::array<PickleOpInfo, 256> kPickleOps = makePickleOpInfo();
+
+constexpr size_t kPickleArgIncomplete = static_cast<size_t>(-1);
+
+// Length of an argument laid out as `layout` that starts at `arg` with
+// `avail` bytes left in the buffer, or kPickleArgIncomplete if it runs past
+// them. Lines are found with memchr.
+inline size_t pickleArgLength(const char* arg, size_t avail, PickleArg layout) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(arg);
+    size_t n = 0;
+    switch (layout) {
+    case PickleArg::None: return 0;
+    case PickleArg::U1: n = 1; break;
+    case PickleArg::U2: n = 2; break;
+    case PickleArg::U4: n = 4; break;
+    case PickleArg::U8: n = 8; break;
+    case PickleArg::Len1:
+        if (avail < 1) return kPickleArgIncomplete;
+        n = 1 + p[0];
+        break;
+    case PickleArg::Len4:
+        if (avail < 4) return kPickleArgIncomplete;
+        n = 4 + (static_cast<size_t>(p[0]) | static_cast<size_t>(p[1]) << 8 |
+                 static_cast<size_t>(p[2]) << 16 | static_cast<size_t>(p[3]) << 24);
+        break;
+    case PickleArg::Len8: {
+        if (avail < 8) return kPickleArgIncomplete;
+        uint64_t len = 0;
+        for (int b = 7; b >= 0; --b) len = (len << 8) | p[b];
+        if (len > avail - 8) return kPickleArgIncomplete;
+        n = 8 + static_cast<size_t>(len);
+        break;
+    }
+    case PickleArg::Line:
+    case PickleArg::Line2: {
+        const void* nl = std::memchr(p, '\n', avail);
+        if (!nl) return kPickleArgIncomplete;
+        n = static_cast<size_t>(static_cast<const unsigned char*>(nl) - p) + 1;
+        if (layout == PickleArg::Line2) {
+            nl = std::memchr(p + n, '\n', avail - n);
+            if (!nl) return kPickleArgIncomplete;
+            n = static_cast<size_t>(static_cast<const unsigned char*>(nl) - p) + 1;
+        }
+        break;
+    }
+    }
+    return n <= avail ? n : kPickleArgIncomplete;
+}
+
+#endif // PICKLE_OPCODES_HPP
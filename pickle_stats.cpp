@@ -0,0 +1,119 @@
+#include "pickle_stats.hpp"
+#include "pickle_opcodes.hpp"
+#include <algorithm>
+
+void PickleStats::reset() {
+    ops.assign(256, Op());
+    totalCount = 0;
+    stackHigh = 0;
+    markHigh = 0;
+    memoHigh = 0;
+    payloadHigh = 0;
+    payloadOffset = 0;
+    payloadOpcode = 0;
+    startTicks = now();
+    startTime = std::chrono::steady_clock::now();
+}
+
+void PickleStats::merge(const PickleStats& other) {
+    for (size_t c = 0; c < ops.size(); ++c) {
+        ops[c].count += other.ops[c].count;
+        ops[c].bytes += other.ops[c].bytes;
+        ops[c].ticks += other.ops[c].ticks;
+        for (size_t b = 0; b < kBuckets; ++b) ops[c].histogram[b] += other.ops[c].histogram[b];
+    }
+    totalCount += other.totalCount;
+    stackHigh = std::max(stackHigh, other.stackHigh);
+    markHigh = std::max(markHigh, other.markHigh);
+    memoHigh = std::max(memoHigh, other.memoHigh);
+    if (other.payloadOpcode && (!payloadOpcode || other.payloadHigh > payloadHigh)) {
+        payloadHigh = other.payloadHigh;
+        payloadOffset = other.payloadOffset;
+        payloadOpcode = other.payloadOpcode;
+    }
+}
+
+void PickleStats::record(unsigned char opcode, size_t argBytes, size_t offset, uint64_t ticks, size_t stackDepth,
+                         size_t markDepth, size_t memoSize) {
+    Op& op = ops[opcode];
+    ++op.count;
+    op.bytes += 1 + argBytes;
+    op.ticks += ticks;
+    size_t bucket = 0;
+    while (ticks > 1 && bucket + 1 < kBuckets) {
+        ticks >>= 1;
+        ++bucket;
+    }
+    ++op.histogram[bucket];
+    ++totalCount;
+    stackHigh = std::max(stackHigh, stackDepth);
+    markHigh = std::max(markHigh, markDepth);
+    memoHigh = std::max(memoHigh, memoSize);
+
+    // Length-prefixed strings and bytes; LONG1/LONG4 share the layout but
+    // carry an integer.
+    size_t prefix = 0;
+    switch (kPickleOps[opcode].arg) {
+    case PickleArg::Len1: prefix = 1; break;
+    case PickleArg::Len4: prefix = 4; break;
+    case PickleArg::Len8: prefix = 8; break;
+    default: return;
+    }
+    if (opcode == 0x8a || opcode == 0x8b) return;
+    if (argBytes - prefix > payloadHigh || payloadOpcode == 0) {
+        payloadHigh = argBytes - prefix;
+        payloadOffset = offset;
+        payloadOpcode = opcode;
+    }
+}
+
+void PickleStats::writeJson(std::ostream& out) const {
+    uint64_t elapsedTicks = now() - startTicks;
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime);
+    double ticksPerNs = elapsed.count() > 0 ? static_cast<double>(elapsedTicks) / elapsed.count() : 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+    const char* clock = "tsc";
+#else
+    const char* clock = "steady_clock";
+    ticksPerNs = 1.0;
+#endif
+
+    uint64_t bytes = 0;
+    uint64_t ticks = 0;
+    for (const Op& op : ops) {
+        bytes += op.bytes;
+        ticks += op.ticks;
+    }
+    out << "{\n"
+        << "  \"clock\": \"" << clock << "\",\n"
+        << "  \"ticks_per_ns\": " << ticksPerNs << ",\n"
+        << "  \"opcodes\": " << totalCount << ",\n"
+        << "  \"bytes\": " << bytes << ",\n"
+        << "  \"ns\": " << static_cast<uint64_t>(static_cast<double>(ticks) / ticksPerNs) << ",\n"
+        << "  \"max_stack_depth\": " << stackHigh << ",\n"
+        << "  \"max_mark_depth\": " << markHigh << ",\n"
+        << "  \"memo_high_water\": " << memoHigh << ",\n"
+        << "  \"largest_payload\": ";
+    if (payloadOpcode) {
+        out << "{\"bytes\": " << payloadHigh << ", \"opcode\": \"" << kPickleOps[payloadOpcode].name
+            << "\", \"offset\": " << payloadOffset << "},\n";
+    } else {
+        out << "null,\n";
+    }
+    out << "  \"ops\": {";
+    bool first = true;
+    for (size_t c = 0; c < ops.size(); ++c) {
+        const Op& op = ops[c];
+        if (!op.count) continue;
+        out << (first ? "\n" : ",\n") << "    \"" << (kPickleOps[c].name ? kPickleOps[c].name : "?")
+            << "\": {\"count\": " << op.count << ", \"bytes\": " << op.bytes
+            << ", \"ns\": " << static_cast<uint64_t>(static_cast<double>(op.ticks) / ticksPerNs)
+            << ", \"log2_ticks\": [";
+        size_t last = kBuckets;
+        while (last > 1 && op.histogram[last - 1] == 0) --last;
+        for (size_t b = 0; b < last; ++b) out << (b ? ", " : "") << op.histogram[b];
+        out << "]}";
+        first = false;
+    }
+    out << (first ? "}\n" : "\n  }\n") << "}\n";
+}
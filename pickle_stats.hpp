@@ -0,0 +1,79 @@
+#ifndef PICKLE_STATS_HPP
+#define PICKLE_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-opcode profile of the parses a PickleParser runs while one of these
+// is attached with setStats(). Only recorded when the library is built
+// with PICKLE_STATS; otherwise the dispatch loop has no trace of it.
+//
+// Each opcode's time covers its visitor events and handler, taken from
+// the TSC where there is one (steady_clock elsewhere). Stack and memo
+// high-water marks come from the parser's own VM, so they are only filled
+// by tree-building parses (parsePickle(), feed()); a visitor parse keeps
+// no stack. The structural scan behind selective decoding runs no
+// opcodes and is not counted.
+class PickleStats {
+public:
+    static constexpr size_t kBuckets = 32; // log2 of the opcode's ticks
+
+    struct Op {
+        uint64_t count = 0;
+        uint64_t bytes = 0; // opcode byte plus argument
+        uint64_t ticks = 0;
+        std::array<uint64_t, kBuckets> histogram{};
+    };
+
+    PickleStats() { reset(); }
+    void reset();
+    // Adds another profile's counts into this one, e.g. one per worker
+    // thread after a batch.
+    void merge(const PickleStats& other);
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    // Called by the dispatch loop after each opcode.
+    void record(unsigned char opcode, size_t argBytes, size_t offset, uint64_t ticks, size_t stackDepth,
+                size_t markDepth, size_t memoSize);
+
+    const Op& op(unsigned char opcode) const { return ops[opcode]; }
+    uint64_t opcodes() const { return totalCount; }
+    size_t maxStackDepth() const { return stackHigh; }
+    size_t maxMarkDepth() const { return markHigh; }
+    size_t memoHighWater() const { return memoHigh; }
+    size_t largestPayload() const { return payloadHigh; }
+
+    // One JSON object: totals, high-water marks, the largest string or
+    // bytes payload, and count/bytes/ns/histogram for every opcode seen.
+    // Ticks are converted to ns by timing the TSC against steady_clock
+    // since construction or reset().
+    void writeJson(std::ostream& out) const;
+
+private:
+    std::vector<Op> ops; // by opcode byte
+    uint64_t totalCount = 0;
+    size_t stackHigh = 0;
+    size_t markHigh = 0;
+    size_t memoHigh = 0;
+    size_t payloadHigh = 0;
+    size_t payloadOffset = 0;
+    unsigned char payloadOpcode = 0;
+    uint64_t startTicks = 0;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#endif // PICKLE_STATS_HPP
@@ -0,0 +1,114 @@
+#include "pickle_tape.hpp"
+#include "pickle_opcodes.hpp"
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// kPickleOps folded into what the indexing loop needs, so the common
+// opcodes (fixed-size argument, plain stack effect) take no switch and no
+// data-dependent branch.
+struct TapeOp {
+    uint8_t fixedArg; // argument length when not `variable`
+    bool variable;    // Len*, Line*: length read from the stream
+    bool known;
+    bool markOp;      // pushes or pops to a MARK (or is POP, which may)
+    int8_t pops;
+    int8_t pushes;
+};
+
+constexpr std::array<TapeOp, 256> makeTapeOps() {
+    std::array<TapeOp, 256> ops{};
+    for (size_t c = 0; c < ops.size(); ++c) {
+        const PickleOpInfo& op = kPickleOps[c];
+        if (!op.name) continue;
+        TapeOp& t = ops[c];
+        t.known = true;
+        switch (op.arg) {
+        case PickleArg::None: t.fixedArg = 0; break;
+        case PickleArg::U1: t.fixedArg = 1; break;
+        case PickleArg::U2: t.fixedArg = 2; break;
+        case PickleArg::U4: t.fixedArg = 4; break;
+        case PickleArg::U8: t.fixedArg = 8; break;
+        default: t.variable = true; break;
+        }
+        t.markOp = op.pops == kPopToMark || op.pushes == kPushMark || c == '0';
+        t.pops = op.pops;
+        t.pushes = op.pushes;
+    }
+    return ops;
+}
+
+constexpr std::array<TapeOp, 256> kTapeOps = makeTapeOps();
+
+} // namespace
+
+void PickleTape::build(std::string_view buff) {
+    count = 0;
+    marks.clear();
+    stopEnd = 0;
+    depth = 0;
+    // Entries are written through a raw pointer: a push_back per opcode
+    // costs a third of the throughput.
+    if (tape.empty()) tape.resize(std::min<size_t>(buff.size() / 8 + 16, 1 << 16));
+    PickleTapeEntry* out = tape.data();
+    size_t n = 0;
+    size_t above = 0; // items above the topmost MARK (or the stack bottom)
+
+    auto fail = [](unsigned char opcode, size_t offset, const char* what) {
+        return std::runtime_error(std::string(kPickleOps[opcode].name) + ": " + what + " at stream offset " +
+                                  std::to_string(offset));
+    };
+
+    size_t i = 0;
+    while (i < buff.size()) {
+        unsigned char opcode = static_cast<unsigned char>(buff[i]);
+        const TapeOp& op = kTapeOps[opcode];
+        if (!op.known) {
+            std::ostringstream msg;
+            msg << "Unknown opcode: 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(opcode)
+                << std::dec << " at stream offset " << i;
+            throw std::runtime_error(msg.str());
+        }
+        size_t argLen = op.fixedArg;
+        if (op.variable || argLen >= buff.size() - i) {
+            argLen = pickleArgLength(buff.data() + i + 1, buff.size() - i - 1, kPickleOps[opcode].arg);
+            if (argLen == kPickleArgIncomplete) throw fail(opcode, i, "argument runs past the end of the input");
+        }
+        if (n == tape.size()) {
+            if (n == kNoMatch) throw fail(opcode, i, "too many opcodes to index");
+            tape.resize(std::min<size_t>(n * 2, kNoMatch));
+            out = tape.data();
+        }
+        uint32_t k = static_cast<uint32_t>(n++);
+        out[k] = {i, kNoMatch, opcode};
+
+        if (!op.markOp || (opcode == '0' && (above > 0 || marks.empty()))) {
+            if (above < static_cast<size_t>(op.pops)) throw fail(opcode, i, "stack underflow");
+            above = above - static_cast<size_t>(op.pops) + static_cast<size_t>(op.pushes);
+        } else if (op.pushes == kPushMark) {
+            marks.push_back({k, static_cast<uint32_t>(above)});
+            above = 0;
+            depth = std::max(depth, marks.size());
+        } else { // pops to the MARK, or POP of a bare one
+            if (marks.empty()) throw fail(opcode, i, "no MARK on the stack");
+            out[marks.back().index].match = k;
+            out[k].match = marks.back().index;
+            above = marks.back().below + (op.pushes > 0 ? static_cast<size_t>(op.pushes) : 0);
+            marks.pop_back();
+        }
+
+        i += 1 + argLen;
+        if (opcode == '.') { // STOP
+            if (!marks.empty()) throw fail(opcode, i - 1, "MARK left open");
+            stopEnd = i;
+            count = n;
+            return;
+        }
+    }
+    throw std::runtime_error("Pickle stream ended without STOP");
+}
@@ -0,0 +1,75 @@
+#ifndef PICKLE_TAPE_HPP
+#define PICKLE_TAPE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// One opcode of a PickleTape. Records are 16 bytes and sit back to back in
+// stream order, so an opcode's argument length is implied by where the
+// next one starts.
+struct PickleTapeEntry {
+    uint64_t offset; // of the opcode byte
+    // For a MARK, the index of the opcode that pops it (TUPLE, APPENDS,
+    // SETITEMS, ..., or a POP of the bare MARK); for that opcode, the index
+    // of its MARK. kNoMatch for everything else.
+    uint32_t match;
+    uint8_t opcode;
+};
+
+// Flat index of a pickle stream, built in one pass that only reads opcode
+// bytes and argument lengths: no handler runs and nothing is decoded or
+// allocated per opcode. Lets repeated inspections of the same stream walk
+// it without re-parsing, and step over a whole MARK-delimited container
+// (the items of a tuple, list batch or dict batch) in O(1).
+class PickleTape {
+public:
+    static constexpr uint32_t kNoMatch = UINT32_MAX;
+
+    PickleTape() = default;
+    explicit PickleTape(std::string_view buff) { build(buff); }
+
+    // Indexes buff up to and including STOP, replacing the current
+    // contents but keeping their memory, so one tape reused across files
+    // stops allocating. Throws for unknown opcodes, truncated arguments,
+    // unbalanced MARKs and a missing STOP.
+    void build(std::string_view buff);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const PickleTapeEntry& operator[](size_t k) const { return tape[k]; }
+    const PickleTapeEntry* begin() const { return tape.data(); }
+    const PickleTapeEntry* end() const { return tape.data() + count; }
+    // Stream offset just past STOP.
+    uint64_t endOffset() const { return stopEnd; }
+    // Deepest MARK nesting seen.
+    size_t maxDepth() const { return depth; }
+
+    size_t argLength(size_t k) const {
+        uint64_t next = k + 1 < count ? tape[k + 1].offset : stopEnd;
+        return static_cast<size_t>(next - tape[k].offset - 1);
+    }
+    // Argument bytes of entry k inside the buffer the tape was built from.
+    std::string_view arg(std::string_view buff, size_t k) const {
+        return buff.substr(static_cast<size_t>(tape[k].offset) + 1, argLength(k));
+    }
+    // Entry after k, jumping past the whole container when k is a MARK.
+    size_t skip(size_t k) const {
+        return tape[k].opcode == '(' ? static_cast<size_t>(tape[k].match) + 1 : k + 1;
+    }
+
+private:
+    struct OpenMark {
+        uint32_t index; // tape entry of the MARK
+        uint32_t below; // items above the enclosing MARK when it was pushed
+    };
+
+    std::vector<PickleTapeEntry> tape; // kept at its high-water size
+    size_t count = 0;                  // entries of tape in use
+    std::vector<OpenMark> marks;       // build() scratch
+    uint64_t stopEnd = 0;
+    size_t depth = 0;
+};
+
+#endif // PICKLE_TAPE_HPP
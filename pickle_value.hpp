@@ -0,0 +1,174 @@
+#ifndef PICKLE_VALUE_HPP
+#define PICKLE_VALUE_HPP
+
+#include "arena.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+enum class PickleType : uint8_t {
+    None,
+    Bool,
+    Int,
+    Str,
+    Bytes,
+    List,
+    Tuple,
+    Dict,
+    Global,    // module/name pair pushed by GLOBAL or STACK_GLOBAL
+    Reduce,    // callable applied to args (REDUCE, NEWOBJ), optionally with BUILD state
+    PersId,    // persistent id pushed by BINPERSID, resolved by the caller
+    Set,       // items in stream order, like List
+    FrozenSet,
+    ByteArray, // BYTEARRAY8; a view like Bytes
+    Buffer,    // protocol 5 out-of-band buffer (NEXT_BUFFER), viewing caller memory
+    Float,     // FLOAT, BINFLOAT
+};
+
+struct PickleValue;
+
+struct PickleDictEntry {
+    PickleValue* key;
+    PickleValue* value;
+};
+
+// One node of the decoded object graph. Nodes live in the parser's arena and
+// are trivially destructible; Str/Bytes/ByteArray/Global views point straight
+// into the parser's input buffer, so they are only valid while that buffer
+// is alive. Buffer views point into the out-of-band buffer it came from.
+struct PickleValue {
+    PickleType type;
+    // With interning on (PickleParser::setInterning()): a Str's string id,
+    // or a Global's pair id, in the parser's PickleInternTable; otherwise
+    // PickleInternTable::kNone. Fits in the padding after `type`.
+    uint32_t interned = 0;
+    union {
+        bool b;
+        int64_t i;
+        double f;
+        struct {
+            const char* data;
+            size_t len;
+        } str;
+        struct {
+            PickleValue** items;
+            uint32_t size;
+            uint32_t capacity;
+        } seq;
+        struct {
+            PickleDictEntry* entries;
+            uint32_t size;
+            uint32_t capacity;
+            uint32_t hashed; // 1 + the parser's key-hash list, once past kDictScanLimit; else 0
+        } dict;
+        struct {
+            const char* module;
+            const char* name;
+            uint32_t moduleLen;
+            uint32_t nameLen;
+        } global;
+        struct {
+            PickleValue* callable;
+            PickleValue* args;
+            PickleValue* state;
+        } reduce;
+        PickleValue* pid;
+    };
+
+    explicit PickleValue(PickleType t) : type(t) { std::memset(&reduce, 0, sizeof(reduce)); }
+
+    bool isNone() const { return type == PickleType::None; }
+    bool isInt() const { return type == PickleType::Int; }
+    bool isStr() const { return type == PickleType::Str; }
+    bool isDict() const { return type == PickleType::Dict; }
+    bool isTuple() const { return type == PickleType::Tuple; }
+    bool isList() const { return type == PickleType::List; }
+
+    std::string_view string() const { return {str.data, str.len}; }
+    std::string_view module() const { return {global.module, global.moduleLen}; }
+    std::string_view name() const { return {global.name, global.nameLen}; }
+
+    // List/Tuple/Set/FrozenSet access.
+    size_t size() const { return type == PickleType::Dict ? dict.size : seq.size; }
+    const PickleValue* operator[](size_t idx) const { return seq.items[idx]; }
+
+    // Linear lookup of a string key; pickled dicts are small enough in
+    // practice that hashing would cost more than it saves. Searches from
+    // the end, so of keys that are kept twice (see setItem()) the value set
+    // last wins, as in Python.
+    const PickleValue* get(std::string_view key) const {
+        for (uint32_t e = dict.size; e-- > 0;) {
+            const PickleValue* k = dict.entries[e].key;
+            if (k->type == PickleType::Str && k->string() == key) return dict.entries[e].value;
+        }
+        return nullptr;
+    }
+
+    // Python equality for the scalar keys a dict can be given twice: Str
+    // and Bytes by content, Int and Bool by value (True == 1), None. Any
+    // other key (tuple, global, ...) only equals the very same node, as
+    // when BINGET repeats a memoised key, so a dict keeps each separately
+    // built occurrence of it as an entry of its own.
+    static bool sameKey(const PickleValue* a, const PickleValue* b) {
+        if (a == b) return true;
+        switch (a->type) {
+        case PickleType::Str:
+        case PickleType::Bytes:
+            return b->type == a->type && a->string() == b->string();
+        case PickleType::Int:
+        case PickleType::Bool: {
+            int64_t x = a->type == PickleType::Int ? a->i : a->b;
+            if (b->type == PickleType::Int) return b->i == x;
+            return b->type == PickleType::Bool && b->b == x;
+        }
+        case PickleType::None:
+            return b->type == PickleType::None;
+        default:
+            return false;
+        }
+    }
+
+    void append(Arena& arena, PickleValue* v) {
+        if (seq.size == seq.capacity) {
+            uint32_t cap = seq.capacity ? seq.capacity * 2 : 4;
+            PickleValue** items = arena.makeArray<PickleValue*>(cap);
+            if (seq.size) std::memcpy(items, seq.items, seq.size * sizeof(PickleValue*));
+            seq.items = items;
+            seq.capacity = cap;
+        }
+        seq.items[seq.size++] = v;
+    }
+
+    // Dicts with fewer entries than this look for an equal key on every
+    // setItem(); scanning a bigger one each time would make building it
+    // quadratic.
+    static constexpr uint32_t kDictScanLimit = 16;
+
+    // SETITEM semantics: a key equal (sameKey()) to one already present
+    // replaces that entry's value and keeps its position. Only dicts under
+    // kDictScanLimit entries are checked here; past that, entries are
+    // appended and the parser merges equal keys once the stream has
+    // stopped. Returns true on the first such unchecked append, so the
+    // caller can note the dict for that pass.
+    bool setItem(Arena& arena, PickleValue* k, PickleValue* v) {
+        if (dict.size < kDictScanLimit) {
+            for (uint32_t e = 0; e < dict.size; ++e) {
+                if (sameKey(dict.entries[e].key, k)) {
+                    dict.entries[e].value = v;
+                    return false;
+                }
+            }
+        }
+        if (dict.size == dict.capacity) {
+            uint32_t cap = dict.capacity ? dict.capacity * 2 : 8;
+            PickleDictEntry* entries = arena.makeArray<PickleDictEntry>(cap);
+            if (dict.size) std::memcpy(entries, dict.entries, dict.size * sizeof(PickleDictEntry));
+            dict.entries = entries;
+            dict.capacity = cap;
+        }
+        dict.entries[dict.size++] = {k, v};
+        return dict.size == kDictScanLimit + 1;
+    }
+};
+
+#endif // PICKLE_VALUE_HPP
@@ -0,0 +1,145 @@
+#include "pickle_visitor.hpp"
+#include "pickle_opcodes.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+std::string pythonFloatRepr(double value) {
+    if (std::isnan(value)) return "nan";
+    if (std::isinf(value)) return value < 0 ? "-inf" : "inf";
+    // Shortest round-trip digits as d.ddde±XX, then laid out as Python would.
+    char buf[32];
+    char* end = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific).ptr;
+    std::string_view sci(buf, end - buf);
+    std::string out;
+    if (sci.front() == '-') {
+        out += '-';
+        sci.remove_prefix(1);
+    }
+    size_t e = sci.find('e');
+    std::string digits(sci.substr(0, e));
+    if (digits.size() > 1) digits.erase(1, 1); // the '.'
+    int exponent = std::atoi(std::string(sci.substr(e + 1)).c_str());
+    int point = exponent + 1; // digits before the decimal point
+    if (point > -4 && point <= 16) {
+        if (point <= 0) {
+            out += "0." + std::string(static_cast<size_t>(-point), '0') + digits;
+        } else if (static_cast<size_t>(point) >= digits.size()) {
+            out += digits + std::string(static_cast<size_t>(point) - digits.size(), '0') + ".0";
+        } else {
+            out += digits.substr(0, point) + "." + digits.substr(point);
+        }
+        return out;
+    }
+    out += digits.substr(0, 1);
+    if (digits.size() > 1) out += "." + digits.substr(1);
+    out += exponent < 0 ? "e-" : "e+";
+    if (std::abs(exponent) < 10) out += '0'; // Python pads to two digits
+    return out + std::to_string(std::abs(exponent));
+}
+
+void PickleDisassembler::on_opcode(unsigned char opcode, size_t offset) {
+    const PickleOpInfo& op = kPickleOps[opcode];
+    if (op.pops == kPopToMark && depth > 0) --depth; // printed at the MARK's level
+    out << std::setw(5) << offset << ": ";
+    if (opcode >= 0x20 && opcode < 0x7f) {
+        out << static_cast<char>(opcode) << "   ";
+    } else {
+        out << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(opcode) << std::dec
+            << std::setfill(' ');
+    }
+    out << std::string(4 * depth + 1, ' ') << op.name;
+    nameWidth = std::strlen(op.name);
+    current = opcode;
+}
+
+// Separates an argument from the opcode name, lining arguments up.
+void PickleDisassembler::arg() {
+    out << std::string(nameWidth < 16 ? 16 - nameWidth : 1, ' ');
+}
+
+void PickleDisassembler::on_proto(int version) {
+    arg();
+    out << version << '\n';
+}
+
+void PickleDisassembler::on_frame(uint64_t length) {
+    arg();
+    out << length << '\n';
+}
+
+void PickleDisassembler::on_mark() {
+    ++depth;
+    end();
+}
+
+// INT spells False and True as 00 and 01; NEWTRUE/NEWFALSE have no argument.
+void PickleDisassembler::on_bool(bool value) {
+    if (current == 0x49) {
+        arg();
+        out << (value ? "True" : "False");
+    }
+    end();
+}
+
+void PickleDisassembler::on_int(int64_t value) {
+    arg();
+    out << value << '\n';
+}
+
+void PickleDisassembler::on_float(double value) {
+    arg();
+    out << pythonFloatRepr(value) << '\n';
+}
+
+void PickleDisassembler::on_str(std::string_view text) {
+    arg();
+    quoted(text);
+    end();
+}
+
+void PickleDisassembler::on_bytes(std::string_view data) {
+    arg();
+    out << data.size() << " bytes\n";
+}
+
+void PickleDisassembler::on_global(std::string_view module, std::string_view name) {
+    arg();
+    quoted(std::string(module) + " " + std::string(name));
+    end();
+}
+
+void PickleDisassembler::on_memo_put(size_t index) {
+    if (current == 0x94) { // MEMOIZE: the index is implied, shown the way pickletools does
+        out << "    (as " << index << ")\n";
+        return;
+    }
+    arg();
+    out << index << '\n';
+}
+
+void PickleDisassembler::on_memo_get(size_t index) {
+    arg();
+    out << index << '\n';
+}
+
+// Long strings are cut short; a checkpoint can carry megabytes in one.
+void PickleDisassembler::quoted(std::string_view text) {
+    constexpr size_t kMaxShown = 80;
+    out << '\'';
+    for (char c : text.substr(0, kMaxShown)) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '\'' || c == '\\') {
+            out << '\\' << c;
+        } else if (u >= 0x20 && u < 0x7f) {
+            out << c;
+        } else {
+            out << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(u) << std::dec
+                << std::setfill(' ');
+        }
+    }
+    out << '\'';
+    if (text.size() > kMaxShown) out << "... (" << text.size() << " bytes)";
+}
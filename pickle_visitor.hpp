@@ -0,0 +1,133 @@
+#ifndef PICKLE_VISITOR_HPP
+#define PICKLE_VISITOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Events PickleParser::parsePickle(visitor) raises, one call per opcode
+// after on_opcode(). The visitor is a template parameter, so every call is
+// resolved at compile time and inlines; derive from this class and hide
+// only the events you need. Used as is, it only checks that the stream
+// decodes (opcodes known, arguments in bounds, STOP reached).
+//
+// String views point into the parser's input and are only valid while it
+// is. Stack effects are the visitor's business: the parser does not keep a
+// stack of its own on this path.
+struct PickleNullVisitor {
+    void on_opcode(unsigned char /*opcode*/, size_t /*offset*/) {}
+    void on_proto(int /*version*/) {}
+    void on_frame(uint64_t /*length*/) {} // FRAME; the parser has already checked it
+    void on_stop() {}
+    void on_mark() {}
+    void on_pop() {}
+    void on_pop_mark() {}
+    void on_dup() {}
+    void on_none() {}
+    void on_bool(bool /*value*/) {}
+    void on_int(int64_t /*value*/) {}
+    void on_float(double /*value*/) {}
+    void on_str(std::string_view /*text*/) {}
+    void on_bytes(std::string_view /*data*/) {}
+    void on_bytearray(std::string_view /*data*/) {}
+    // NEXT_BUFFER: the next out-of-band buffer given to setBuffers().
+    void on_buffer(std::string_view /*data*/) {}
+    void on_readonly_buffer() {}
+    void on_global(std::string_view /*module*/, std::string_view /*name*/) {}
+    void on_stack_global() {} // module and name are the top two stack entries
+    void on_list() {} // EMPTY_LIST
+    void on_dict() {} // EMPTY_DICT
+    void on_set() {}  // EMPTY_SET
+    void on_marked_list() {} // LIST: of everything above the topmost MARK
+    void on_marked_dict() {} // DICT: key/value pairs above the topmost MARK
+    // A tuple of the top `items` stack entries, or of everything above the
+    // topmost MARK when items is kPopToMark (TUPLE).
+    void on_tuple(int /*items*/) {}
+    void on_append() {}
+    void on_appends() {}
+    void on_setitem() {}
+    void on_setitems() {}
+    void on_additems() {}
+    void on_frozenset() {} // of everything above the topmost MARK
+    void on_reduce() {}
+    void on_newobj() {}
+    void on_newobj_ex() {}
+    // INST: the class named by module and name, applied to everything above
+    // the topmost MARK.
+    void on_inst(std::string_view /*module*/, std::string_view /*name*/) {}
+    void on_obj() {} // OBJ: the first item above the topmost MARK applied to the rest
+    void on_build() {}
+    void on_persid() {}
+    void on_text_persid(std::string_view /*id*/) {} // PERSID: the id is inline, not on the stack
+    // PUT, BINPUT, LONG_BINPUT, or MEMOIZE with the index it implies.
+    void on_memo_put(size_t /*index*/) {}
+    void on_memo_get(size_t /*index*/) {}
+};
+
+// A float the way Python's repr() writes it: shortest round-trip digits,
+// positional from 1e-4 up to 1e16 ("0.0001", "1.5", "100.0"), scientific
+// outside it ("1e-05", "1e+16"), and "inf", "-inf", "nan".
+std::string pythonFloatRepr(double value);
+
+// Prints one line per opcode in the layout of Python's pickletools.dis():
+// stream offset, opcode name indented by MARK depth, then its argument.
+class PickleDisassembler : public PickleNullVisitor {
+public:
+    explicit PickleDisassembler(std::ostream& out = std::cout) : out(out) {}
+
+    void on_opcode(unsigned char opcode, size_t offset);
+    void on_proto(int version);
+    void on_frame(uint64_t length);
+    void on_stop() { end(); }
+    void on_mark();
+    void on_pop() { end(); }
+    void on_pop_mark() { end(); }
+    void on_dup() { end(); }
+    void on_none() { end(); }
+    void on_bool(bool value);
+    void on_int(int64_t value);
+    void on_float(double value);
+    void on_str(std::string_view text);
+    void on_bytes(std::string_view data);
+    void on_bytearray(std::string_view data) { on_bytes(data); }
+    void on_buffer(std::string_view data) { on_bytes(data); }
+    void on_readonly_buffer() { end(); }
+    void on_global(std::string_view module, std::string_view name);
+    void on_stack_global() { end(); }
+    void on_list() { end(); }
+    void on_dict() { end(); }
+    void on_set() { end(); }
+    void on_marked_list() { end(); }
+    void on_marked_dict() { end(); }
+    void on_tuple(int) { end(); }
+    void on_append() { end(); }
+    void on_appends() { end(); }
+    void on_setitem() { end(); }
+    void on_setitems() { end(); }
+    void on_additems() { end(); }
+    void on_frozenset() { end(); }
+    void on_reduce() { end(); }
+    void on_newobj() { end(); }
+    void on_newobj_ex() { end(); }
+    void on_inst(std::string_view module, std::string_view name) { on_global(module, name); }
+    void on_obj() { end(); }
+    void on_build() { end(); }
+    void on_persid() { end(); }
+    void on_text_persid(std::string_view id) { on_str(id); }
+    void on_memo_put(size_t index);
+    void on_memo_get(size_t index);
+
+private:
+    void end() { out << '\n'; }
+    void arg();
+    void quoted(std::string_view text);
+
+    std::ostream& out;
+    size_t depth = 0;          // open MARKs
+    size_t nameWidth = 0;      // of the opcode name on the current line
+    unsigned char current = 0; // opcode on the current line
+};
+
+#endif // PICKLE_VISITOR_HPP
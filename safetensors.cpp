@@ -0,0 +1,261 @@
+#include "safetensors.hpp"
+#include "half_convert.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char* safetensorsDType(TorchDType dtype) {
+    switch (dtype) {
+    case TorchDType::Float16: return "F16";
+    case TorchDType::BFloat16: return "BF16";
+    case TorchDType::Float32: return "F32";
+    case TorchDType::Float64: return "F64";
+    case TorchDType::Int8: return "I8";
+    case TorchDType::UInt8: return "U8";
+    case TorchDType::Int16: return "I16";
+    case TorchDType::Int32: return "I32";
+    case TorchDType::Int64: return "I64";
+    case TorchDType::Bool: return "BOOL";
+    }
+    return "unknown";
+}
+
+namespace {
+
+constexpr size_t kDataAlign = 64;
+constexpr size_t kMaxWrite = size_t(1) << 30; // Linux caps a single write() just below 2 GiB
+
+bool is_float(TorchDType dtype) {
+    return dtype == TorchDType::Float16 || dtype == TorchDType::BFloat16 || dtype == TorchDType::Float32;
+}
+
+bool is_contiguous(const TorchTensor& t) {
+    int64_t expect = 1;
+    for (size_t d = t.shape.size(); d-- > 0;) {
+        if (t.shape[d] != 1 && t.stride[d] != expect) return false;
+        expect *= t.shape[d];
+    }
+    return true;
+}
+
+// Copies a strided view into dst in row-major order, a row at a time when
+// the innermost dimension is dense.
+void gather(const TorchTensor& t, char* dst) {
+    size_t rank = t.shape.size();
+    size_t elem = dtypeSize(t.dtype);
+    const char* base = static_cast<const char*>(t.data());
+    size_t inner = static_cast<size_t>(t.shape[rank - 1]);
+    int64_t inner_stride = t.stride[rank - 1];
+    std::vector<int64_t> index(rank - 1, 0);
+    size_t rows = t.numel() / inner;
+    for (size_t r = 0; r < rows; ++r) {
+        int64_t offset = 0;
+        for (size_t d = 0; d + 1 < rank; ++d) offset += index[d] * t.stride[d];
+        const char* row = base + offset * static_cast<int64_t>(elem);
+        char* out = dst + r * inner * elem;
+        if (inner_stride == 1) {
+            std::memcpy(out, row, inner * elem);
+        } else {
+            for (size_t k = 0; k < inner; ++k) {
+                std::memcpy(out + k * elem, row + static_cast<int64_t>(k) * inner_stride * static_cast<int64_t>(elem),
+                            elem);
+            }
+        }
+        for (size_t d = rank - 1; d-- > 0;) { // odometer over the outer dims
+            if (++index[d] < t.shape[d]) break;
+            index[d] = 0;
+        }
+    }
+}
+
+void json_string(std::string& out, std::string_view text) {
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20) {
+            out += "\\u00";
+            out += kHex[u >> 4];
+            out += kHex[u & 15];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// The file being written, plus read-only descriptors of the storage files
+// copy_file_range() pulls from.
+class Output {
+public:
+    explicit Output(const std::string& path) : path(path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) fail("cannot create");
+    }
+    ~Output() {
+        for (auto& source : sources) ::close(source.second);
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlink(path.c_str()); // close() was not reached: an error left the file partial
+        }
+    }
+
+    void write(const char* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = ::write(fd, data, std::min(len, kMaxWrite));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) fail("write failed");
+            data += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
+
+    // Appends len bytes of `source` from `offset`, in the kernel when it
+    // can; `mapped` is the same bytes, for whatever it could not copy.
+    void copy(const std::string& source, uint64_t offset, const char* mapped, size_t len) {
+#ifdef __linux__
+        int in = copyRange ? sourceFd(source) : -1;
+        loff_t from = static_cast<loff_t>(offset);
+        while (in >= 0 && len > 0) {
+            ssize_t n = ::copy_file_range(in, &from, fd, nullptr, std::min(len, kMaxWrite), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // Unsupported here (old kernel, cross-filesystem, ...): stop
+                // trying for this file.
+                if (n < 0) copyRange = false;
+                break;
+            }
+            mapped += n;
+            len -= static_cast<size_t>(n);
+        }
+#else
+        (void)source;
+        (void)offset;
+#endif
+        write(mapped, len);
+    }
+
+    void close() {
+        int closing = fd;
+        fd = -1;
+        if (::close(closing) != 0) {
+            ::unlink(path.c_str());
+            throw std::runtime_error("safetensors: close failed for " + path + ": " + std::strerror(errno));
+        }
+    }
+
+private:
+    [[noreturn]] void fail(const char* what) const {
+        throw std::runtime_error(std::string("safetensors: ") + what + " " + path + ": " + std::strerror(errno));
+    }
+
+    int sourceFd(const std::string& source) {
+        auto it = sources.find(source);
+        if (it == sources.end()) it = sources.emplace(source, ::open(source.c_str(), O_RDONLY | O_CLOEXEC)).first;
+        return it->second;
+    }
+
+    std::string path;
+    int fd = -1;
+    bool copyRange = true;
+    std::unordered_map<std::string, int> sources; // -1 if it would not open
+};
+
+} // namespace
+
+uint64_t writeSafetensors(const std::vector<TorchTensor>& tensors, const std::string& path,
+                          const SafetensorsOptions& options) {
+    if (options.convertTo && !is_float(*options.convertTo)) {
+        throw std::runtime_error(std::string("safetensors: cannot convert to ") + dtypeName(*options.convertTo));
+    }
+    std::vector<TorchDType> dtypes;
+    dtypes.reserve(tensors.size());
+    std::string header = "{";
+    if (!options.metadata.empty()) {
+        header += "\"__metadata__\":{";
+        for (size_t m = 0; m < options.metadata.size(); ++m) {
+            if (m) header += ',';
+            json_string(header, options.metadata[m].first);
+            header += ':';
+            json_string(header, options.metadata[m].second);
+        }
+        header += '}';
+    }
+    uint64_t offset = 0;
+    for (const TorchTensor& t : tensors) {
+        if (t.numel() > 0 && !t.data()) {
+            throw std::runtime_error("safetensors: tensor '" + t.name + "' has no data (storage '" +
+                                     t.storage->key + "' missing or not loaded)");
+        }
+        TorchDType dtype = options.convertTo && is_float(t.dtype) ? *options.convertTo : t.dtype;
+        dtypes.push_back(dtype);
+        uint64_t end = offset + t.numel() * dtypeSize(dtype);
+        if (header.size() > 1) header += ',';
+        json_string(header, t.name);
+        header += ":{\"dtype\":\"";
+        header += safetensorsDType(dtype);
+        header += "\",\"shape\":[";
+        for (size_t d = 0; d < t.shape.size(); ++d) {
+            if (d) header += ',';
+            header += std::to_string(t.shape[d]);
+        }
+        header += "],\"data_offsets\":[" + std::to_string(offset) + "," + std::to_string(end) + "]}";
+        offset = end;
+    }
+    header += '}';
+    // Spaces after the JSON are allowed and put the data on a 64-byte boundary.
+    header.append((kDataAlign - (8 + header.size()) % kDataAlign) % kDataAlign, ' ');
+
+    Output out(path);
+    char length[8];
+    for (int b = 0; b < 8; ++b) length[b] = static_cast<char>(static_cast<uint64_t>(header.size()) >> (8 * b));
+    out.write(length, sizeof(length));
+    out.write(header.data(), header.size());
+
+    std::vector<char> staging;
+    std::vector<float> wide;
+    for (size_t k = 0; k < tensors.size(); ++k) {
+        const TorchTensor& t = tensors[k];
+        size_t n = t.numel();
+        if (n == 0) continue;
+        const TorchStorage& storage = *t.storage;
+        const char* data = static_cast<const char*>(t.data());
+        size_t bytes = n * dtypeSize(dtypes[k]);
+        if (dtypes[k] == t.dtype) {
+            if (!is_contiguous(t)) {
+                staging.resize(bytes);
+                gather(t, staging.data());
+                out.write(staging.data(), bytes);
+            } else if (!storage.path.empty()) {
+                uint64_t from = storage.fileOffset + static_cast<uint64_t>(data - storage.bytes.data());
+                out.copy(storage.path, from, data, bytes);
+            } else {
+                out.write(data, bytes);
+            }
+            continue;
+        }
+        wide.resize(n);
+        convertToFloat32(t, wide.data());
+        if (dtypes[k] == TorchDType::Float32) {
+            out.write(reinterpret_cast<const char*>(wide.data()), bytes);
+            continue;
+        }
+        staging.resize(bytes);
+        uint16_t* narrow = reinterpret_cast<uint16_t*>(staging.data());
+        if (dtypes[k] == TorchDType::Float16) {
+            floatToHalf(wide.data(), narrow, n);
+        } else {
+            floatToBFloat16(wide.data(), narrow, n);
+        }
+        out.write(staging.data(), bytes);
+    }
+    out.close();
+    return 8 + header.size() + offset;
+}
@@ -0,0 +1,33 @@
+#ifndef SAFETENSORS_HPP
+#define SAFETENSORS_HPP
+
+#include "torch_checkpoint.hpp"
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct SafetensorsOptions {
+    // float16, bfloat16 and float32 tensors are converted to this type
+    // while they are copied; other dtypes, and everything when unset, are
+    // written as they are.
+    std::optional<TorchDType> convertTo;
+    // String pairs for the header's "__metadata__" entry.
+    std::vector<std::pair<std::string, std::string>> metadata{{"format", "pt"}};
+};
+
+// Name of a dtype in a safetensors header ("F16", "BF16", "I64", ...).
+const char* safetensorsDType(TorchDType dtype);
+
+// Writes `tensors` (whose storages must be loaded) to `path` as a
+// safetensors file: an 8-byte header length, the JSON header padded with
+// spaces so the data starts 64-byte aligned, then every tensor back to
+// back in the given order, row-major. Views are gathered; contiguous
+// tensors that need no conversion are copied file to file with
+// copy_file_range() where the kernel allows it, and with large write()s
+// from the mapping otherwise. Returns the file size; throws on any error,
+// leaving no partial file behind.
+uint64_t writeSafetensors(const std::vector<TorchTensor>& tensors, const std::string& path,
+                          const SafetensorsOptions& options = SafetensorsOptions());
+
+#endif // SAFETENSORS_HPP
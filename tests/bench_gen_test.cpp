@@ -0,0 +1,182 @@
+// The benchmark's synthetic workloads, decoded: each must give the tree its
+// generator describes, and the opcode count libpickle-bench divides by must
+// be the number of opcodes actually in the stream.
+#include "pickle.hpp"
+#include "pickle_gen.hpp"
+#include "pickle_tape.hpp"
+#include "test_support.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Scale 0.001 of the generators' defaults: 2000 ints, lists and dicts 200
+// deep, 16777-byte strings, 1000 memo tuples and 4 state_dict layers.
+constexpr double kScale = 0.001;
+
+struct IntCollector : PickleNullVisitor {
+    std::vector<int64_t> values;
+    void on_int(int64_t value) { values.push_back(value); }
+};
+
+void check_opcode_count(const GeneratedPickle& g) {
+    PickleTape tape(g.bytes);
+    CHECK_EQ(tape.size(), g.opcodes);
+}
+
+void check_ints() {
+    GeneratedPickle g = generateInts(kScale);
+    check_opcode_count(g);
+    PickleParser parser(g.bytes.data(), g.bytes.size());
+    parser.pickleOpener();
+    IntCollector events;
+    parser.parsePickle(events);
+    parser.parsePickle(); // after: every parse resets the arena the tree lives in
+    const PickleValue* root = parser.root();
+    CHECK(root->isList());
+    CHECK_EQ(root->size(), size_t{2000});
+    CHECK_EQ(events.values.size(), root->size());
+    bool same = events.values.size() == root->size();
+    for (size_t k = 0; same && k < root->size(); ++k) {
+        same = (*root)[k]->isInt() && (*root)[k]->i == events.values[k];
+    }
+    CHECK(same);
+}
+
+void check_nested() {
+    GeneratedPickle g = generateNested(kScale);
+    check_opcode_count(g);
+    PickleParser parser(g.bytes.data(), g.bytes.size());
+    parser.pickleOpener();
+    parser.parsePickle();
+    const PickleValue* root = parser.root();
+    CHECK(root->isTuple());
+    CHECK_EQ(root->size(), size_t{2});
+    if (!root->isTuple() || root->size() != 2) return;
+
+    size_t lists = 0;
+    const PickleValue* v = (*root)[0];
+    for (; v->isList() && v->size() == 1; v = (*v)[0]) ++lists;
+    CHECK(v->isList() && v->size() == 0);
+    CHECK_EQ(lists + 1, size_t{200});
+
+    size_t dicts = 0;
+    v = (*root)[1];
+    for (; v->isDict() && v->size() == 1; v = v->get("k")) ++dicts;
+    CHECK(v && v->isDict() && v->size() == 0);
+    CHECK_EQ(dicts, size_t{200});
+}
+
+void check_strings() {
+    GeneratedPickle g = generateStrings(kScale);
+    check_opcode_count(g);
+    PickleParser parser(g.bytes.data(), g.bytes.size());
+    parser.pickleOpener();
+    parser.parsePickle();
+    const PickleValue* root = parser.root();
+    CHECK(root->isList());
+    CHECK_EQ(root->size(), size_t{8});
+    if (!root->isList() || root->size() != 8) return;
+
+    // Unicode and bytes alternate, each the last one rotated by an eighth.
+    for (size_t k = 0; k < 8; ++k) {
+        const PickleValue* s = (*root)[k];
+        CHECK(s->type == (k % 2 ? PickleType::Bytes : PickleType::Str));
+        CHECK_EQ(s->str.len, size_t{16777});
+        if (k == 0) continue;
+        std::string prev((*root)[k - 1]->string());
+        std::rotate(prev.begin(), prev.begin() + 16777 / 8, prev.end());
+        CHECK(s->string() == prev);
+    }
+}
+
+void check_memo() {
+    GeneratedPickle g = generateMemo(kScale);
+    check_opcode_count(g);
+    PickleParser parser(g.bytes.data(), g.bytes.size());
+    parser.pickleOpener();
+    parser.parsePickle();
+    const PickleValue* root = parser.root();
+    CHECK(root->isTuple());
+    CHECK_EQ(root->size(), size_t{3});
+    if (!root->isTuple() || root->size() != 3) return;
+
+    const PickleValue* words = (*root)[0];
+    const PickleValue* tuples = (*root)[1];
+    const PickleValue* refs = (*root)[2];
+    CHECK_EQ(words->size(), size_t{4096});
+    CHECK_EQ(tuples->size(), size_t{1000});
+    CHECK_EQ(refs->size(), size_t{1000});
+    CHECK((*words)[17]->string() == "word_17");
+
+    // BINGET hands back the memoised node itself, never a copy.
+    bool shared = true;
+    for (size_t k = 0; shared && k < tuples->size(); ++k) {
+        const PickleValue* t = (*tuples)[k];
+        for (size_t w = 0; w < 2; ++w) {
+            size_t index = std::stoul(std::string((*t)[w]->string().substr(5)));
+            shared = shared && (*words)[index] == (*t)[w];
+        }
+        shared = shared && (*t)[2]->isInt() && (*t)[2]->i == static_cast<int64_t>(k);
+    }
+    CHECK(shared);
+    bool found = true;
+    for (size_t k = 0; found && k < refs->size(); ++k) {
+        const PickleValue* r = (*refs)[k];
+        found = std::find(tuples->seq.items, tuples->seq.items + tuples->size(), r) !=
+                tuples->seq.items + tuples->size();
+    }
+    CHECK(found);
+}
+
+void check_state_dict() {
+    GeneratedPickle g = generateStateDict(kScale);
+    check_opcode_count(g);
+    PickleParser parser(g.bytes.data(), g.bytes.size());
+    parser.pickleOpener();
+    parser.parsePickle();
+    const PickleValue* root = parser.root();
+    CHECK(root->isDict());
+    const PickleValue* dims = root->get("dims");
+    CHECK(dims && dims->isDict() && dims->size() == 4);
+    CHECK(dims && dims->get("n_vocab") && dims->get("n_vocab")->isInt());
+    const PickleValue* sd = root->get("model_state_dict");
+    CHECK(sd && sd->isDict());
+    if (!sd || !sd->isDict()) return;
+    CHECK_EQ(sd->size(), size_t{4 * 12});
+    CHECK(sd->get("blocks.3.mlp.2.bias") != nullptr);
+
+    for (uint32_t e = 0; e < sd->dict.size; ++e) {
+        const PickleValue* t = sd->dict.entries[e].value;
+        CHECK(t->type == PickleType::Reduce);
+        if (t->type != PickleType::Reduce) continue;
+        CHECK(t->reduce.callable->name() == "_rebuild_tensor_v2");
+        const PickleValue* args = t->reduce.args;
+        CHECK(args->isTuple() && args->size() == 6);
+        if (!args->isTuple() || args->size() != 6) continue;
+        const PickleValue* pid = (*args)[0];
+        CHECK(pid->type == PickleType::PersId && pid->pid->isTuple() && pid->pid->size() == 5);
+        if (pid->type != PickleType::PersId || pid->pid->size() != 5) continue;
+        // Storage keys count up in entry order, and each storage holds
+        // exactly its tensor.
+        CHECK((*pid->pid)[2]->string() == std::to_string(e));
+        int64_t numel = 1;
+        const PickleValue* shape = (*args)[2];
+        for (size_t d = 0; d < shape->size(); ++d) numel *= (*shape)[d]->i;
+        CHECK_EQ((*pid->pid)[4]->i, numel);
+        CHECK((*args)[4]->type == PickleType::Bool && !(*args)[4]->b);
+        CHECK((*args)[5]->isDict()); // OrderedDict() decodes as a plain dict
+    }
+}
+
+} // namespace
+
+int main() {
+    check_ints();
+    check_nested();
+    check_strings();
+    check_memo();
+    check_state_dict();
+    return testExit();
+}
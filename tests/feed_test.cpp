@@ -0,0 +1,192 @@
+// feed() against a whole-buffer parsePickle(): every fixture, fed in
+// chunks of each size from 1 to 64 bytes and a few larger ones, must give
+// the same tree. Small hand-written streams are also cut at every point
+// and every pair of points, so each opcode gets split inside its length
+// prefix, its payload and its text lines. Chunks are scribbled over once
+// fed, as a reader reusing its buffer would, so nothing may view them.
+#include "pickle.hpp"
+#include "test_support.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::string whole_tree(const std::string& data, const std::vector<std::string_view>& buffers) {
+    PickleParser parser(data.data(), data.size());
+    parser.setBuffers(buffers);
+    parser.pickleOpener();
+    parser.parsePickle();
+    return dumpTree(parser.root());
+}
+
+// Feeds data cut at `cuts` (ascending offsets) and returns the tree, or
+// the error that stopped it.
+std::string fed_tree(PickleParser& parser, const std::string& data, const std::vector<size_t>& cuts,
+                     const std::string& what) {
+    std::vector<char> scratch;
+    size_t from = 0;
+    try {
+        for (size_t k = 0; k <= cuts.size(); ++k) {
+            size_t to = k < cuts.size() ? cuts[k] : data.size();
+            scratch.assign(data.begin() + static_cast<std::ptrdiff_t>(from),
+                           data.begin() + static_cast<std::ptrdiff_t>(to));
+            PickleParser::FeedStatus status = parser.feed(scratch.data(), scratch.size());
+            std::fill(scratch.begin(), scratch.end(), '\xaa');
+            // Every stream here ends in its STOP, so only the last chunk
+            // completes it.
+            if ((status == PickleParser::FeedStatus::Done) != (to == data.size())) {
+                testFail(__FILE__, __LINE__, what + ": Done at the wrong chunk, ending at " + std::to_string(to));
+            }
+            from = to;
+        }
+        parser.finish();
+    } catch (const std::exception& e) {
+        try {
+            parser.finish(); // ready for the next stream
+        } catch (const std::exception&) {
+        }
+        return std::string("error: ") + e.what();
+    }
+    return dumpTree(parser.root());
+}
+
+void check_fixtures(PickleParser& parser) {
+    std::vector<size_t> sizes;
+    for (size_t c = 1; c <= 64; ++c) sizes.push_back(c);
+    for (size_t c : {100, 255, 256, 257, 1000, 4096, 65536}) sizes.push_back(c);
+
+    for (const std::string& name : fixtureNames()) {
+        std::string data = readFile(fixturePath(name + ".pkl"));
+        std::vector<std::string> owned = fixtureBuffers(name);
+        std::vector<std::string_view> buffers(owned.begin(), owned.end());
+        std::string want = whole_tree(data, buffers);
+        parser.setBuffers(buffers);
+        for (size_t c : sizes) {
+            std::vector<size_t> cuts;
+            for (size_t at = c; at < data.size(); at += c) cuts.push_back(at);
+            std::string what = name + " in " + std::to_string(c) + "-byte chunks";
+            std::string got = fed_tree(parser, data, cuts, what);
+            if (got != want) {
+                testFail(__FILE__, __LINE__, what + ": tree differs");
+                break;
+            }
+        }
+    }
+    parser.setBuffers({});
+}
+
+// Little-endian writer for the hand-written streams.
+struct Stream {
+    std::string out;
+    Stream& op(char opcode) {
+        out += opcode;
+        return *this;
+    }
+    Stream& le(uint64_t v, int bytes) {
+        for (int b = 0; b < bytes; ++b) out += static_cast<char>((v >> (8 * b)) & 0xff);
+        return *this;
+    }
+    Stream& raw(std::string_view s) {
+        out += s;
+        return *this;
+    }
+};
+
+// Protocol 4 opcodes with fixed-width or length-prefixed arguments. One
+// payload is 260 bytes long, so the second byte of its prefix counts too;
+// the longer prefixes are in long_payload().
+std::string length_prefixed() {
+    Stream s;
+    s.op('\x80').le(4, 1);
+    s.op(']').op('(');
+    s.op('\x8c').le(5, 1).raw("short");                     // SHORTBINUNICODE
+    s.op('X').le(260, 4).raw(std::string(260, 't'));         // BINUNICODE
+    s.op('\x8d').le(3, 8).raw("bu8");                        // BINUNICODE8
+    s.op('C').le(3, 1).raw("sbb");                           // SHORT_BINBYTES
+    s.op('B').le(2, 4).raw("bb");                            // BINBYTES
+    s.op('\x8e').le(3, 8).raw("bb8");                        // BINBYTES8
+    s.op('\x96').le(4, 8).raw("ba8!");                       // BYTEARRAY8
+    s.op('K').le(200, 1);                                    // BININT1
+    s.op('M').le(0x1234, 2);                                 // BININT2
+    s.op('J').le(static_cast<uint32_t>(-123456789), 4);      // BININT
+    s.op('\x8a').le(8, 1).le(0x0102030405060708ull, 8);      // LONG1
+    s.op('\x8b').le(3, 4).le(0x7fffff, 3);                   // LONG4
+    s.op('G').raw(std::string("\x3f\xf8\0\0\0\0\0\0", 8));   // BINFLOAT 1.5
+    s.op('r').le(300, 4);                                    // LONG_BINPUT
+    s.op('j').le(300, 4);                                    // LONG_BINGET
+    s.op('e');
+    s.op('.');
+    return s.out;
+}
+
+// Protocol 0 opcodes whose arguments are newline-terminated lines,
+// GLOBAL's two lines included.
+std::string text_lines() {
+    return "(lp0\n"
+           "I12345\na"
+           "I01\na"
+           "F1.5\na"
+           "L123456789012345L\na"
+           "Vcaf\\u00e9\na"
+           "S'quoted \\'text\\''\na"
+           "ccollections\nOrderedDict\na"
+           "Pstorage:7\na"
+           "I7\np1\nag1\na"
+           "(I1\nI2\ntp2\na"
+           ".";
+}
+
+// Payloads whose lengths need three bytes of a 4- and an 8-byte prefix.
+std::string long_payload() {
+    Stream s;
+    s.op('\x80').le(4, 1);
+    s.op('\x8e').le(70000, 8).raw(std::string(70000, 'b'));
+    s.op('B').le(70000, 4).raw(std::string(70000, 'c'));
+    s.op('\x86');
+    s.op('.');
+    return s.out;
+}
+
+// Every cut in [first, last) and every pair of them, so each opcode there
+// is split at each point of its argument and can also arrive in three
+// pieces.
+void check_all_cuts(PickleParser& parser, const std::string& name, const std::string& data, size_t first,
+                    size_t last) {
+    std::string want = whole_tree(data, {});
+    last = std::min(last, data.size());
+    for (size_t a = first; a < last; ++a) {
+        std::string what = name + " cut at " + std::to_string(a);
+        if (fed_tree(parser, data, {a}, what) != want) {
+            testFail(__FILE__, __LINE__, what + ": tree differs");
+            return;
+        }
+    }
+    for (size_t a = first; a < last; ++a) {
+        for (size_t b = a + 1; b < last; ++b) {
+            std::string what = name + " cut at " + std::to_string(a) + " and " + std::to_string(b);
+            if (fed_tree(parser, data, {a, b}, what) != want) {
+                testFail(__FILE__, __LINE__, what + ": tree differs");
+                return;
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    PickleParser parser;
+    parser.setDiagnostics(nullptr);
+    check_fixtures(parser);
+    check_all_cuts(parser, "text lines", text_lines(), 1, std::string::npos);
+    check_all_cuts(parser, "length prefixes", length_prefixed(), 1, std::string::npos);
+    // Around the two prefixes only: pairs of cuts through 140 KB add time,
+    // not coverage.
+    std::string payload = long_payload();
+    check_all_cuts(parser, "long payload", payload, 1, 16);
+    check_all_cuts(parser, "long payload", payload, 70008, 70024);
+    return testExit();
+}
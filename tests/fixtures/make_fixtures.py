@@ -0,0 +1,516 @@
+#!/usr/bin/env python3
+"""Writes the pickles under tests/fixtures and the tree each must decode to.
+
+    python3 make_fixtures.py [DIR]
+
+For every case, NAME.pkl holds the stream and NAME.tree the expected tree,
+rendered the way tests/test_support.cpp's dumpTree() renders a
+PickleValue. NAME.bufN files are protocol 5 out-of-band buffers, handed to
+the parser in order. NAME.select files list selections to check
+against the full tree, one per line as space-separated dotted paths.
+NAME.zip files are the archives zip_archive_test
+opens, well-formed or broken in one specific way each, apart from
+checkpoint.zip, a small torch.save() archive. The trees come from pickle's own pure-Python
+unpickler with the object-building opcodes replaced, so they decode the
+stream the way PickleParser does: classes are Globals, calls Reduces,
+persistent ids PersIds, and sets keep stream order. Everything else,
+SETITEM on a key the dict already holds included, is Python's own
+behaviour. Re-run this after changing a case; the output is deterministic.
+"""
+
+import collections
+import copyreg
+import io
+import os
+import pickle
+import struct
+import sys
+import types
+import zipfile
+
+
+# --- The reference decoder ---------------------------------------------------
+
+class Global:  # a new one per GLOBAL, as PickleParser builds without interning
+    def __init__(self, module, name):
+        self.module, self.name = module, name
+
+
+class Reduce:
+    def __init__(self, callable, args):
+        self.callable, self.args, self.state = callable, args, None
+
+
+class PersId:
+    def __init__(self, pid):
+        self.pid = pid
+
+
+class Set(list):  # EMPTY_SET/ADDITEMS, in stream order
+    pass
+
+
+class FrozenSet(tuple):
+    pass
+
+
+class Buffer(bytes):  # an out-of-band buffer given to NEXT_BUFFER
+    pass
+
+
+def make_reduce(callable, args):
+    # PickleParser decodes OrderedDict() as a plain dict.
+    if isinstance(callable, Global) and (callable.module, callable.name) == ("collections", "OrderedDict") \
+            and args == ():
+        return {}
+    return Reduce(callable, args)
+
+
+class ReferenceUnpickler(pickle._Unpickler):
+    dispatch = dict(pickle._Unpickler.dispatch)
+
+    def find_class(self, module, name):
+        return Global(module, name)
+
+    def persistent_load(self, pid):
+        return PersId(pid)
+
+    def load_reduce(self):
+        args = self.stack.pop()
+        self.stack[-1] = make_reduce(self.stack[-1], args)
+    dispatch[pickle.REDUCE[0]] = load_reduce
+
+    def load_newobj(self):
+        args = self.stack.pop()
+        cls = self.stack.pop()
+        self.append(make_reduce(cls, args))
+    dispatch[pickle.NEWOBJ[0]] = load_newobj
+
+    def load_newobj_ex(self):
+        kwargs = self.stack.pop()
+        args = self.stack.pop()
+        cls = self.stack.pop()
+        assert not kwargs
+        self.append(make_reduce(cls, args))
+    dispatch[pickle.NEWOBJ_EX[0]] = load_newobj_ex
+
+    def load_inst(self):
+        module = self.readline()[:-1].decode("ascii")
+        name = self.readline()[:-1].decode("ascii")
+        args = tuple(self.pop_mark())  # before self.append: pop_mark() swaps the stack
+        self.append(make_reduce(Global(module, name), args))
+    dispatch[pickle.INST[0]] = load_inst
+
+    def load_obj(self):
+        args = self.pop_mark()
+        cls = args.pop(0)
+        self.append(make_reduce(cls, tuple(args)))
+    dispatch[pickle.OBJ[0]] = load_obj
+
+    def load_build(self):
+        state = self.stack.pop()
+        inst = self.stack[-1]
+        if isinstance(inst, Reduce):
+            inst.state = state
+        else:
+            assert type(inst) is dict
+    dispatch[pickle.BUILD[0]] = load_build
+
+    def load_empty_set(self):
+        self.append(Set())
+    dispatch[pickle.EMPTY_SET[0]] = load_empty_set
+
+    def load_additems(self):
+        items = self.pop_mark()
+        self.stack[-1].extend(items)
+    dispatch[pickle.ADDITEMS[0]] = load_additems
+
+    def load_frozenset(self):
+        items = self.pop_mark()
+        self.append(FrozenSet(items))
+    dispatch[pickle.FROZENSET[0]] = load_frozenset
+
+
+def escape(data):
+    out = []
+    for c in data:
+        if c == 0x5c:
+            out.append("\\\\")
+        elif c == 0x27:
+            out.append("\\'")
+        elif 0x20 <= c < 0x7f:
+            out.append(chr(c))
+        else:
+            out.append("\\x%02x" % c)
+    return "".join(out)
+
+
+def dump(v):
+    """Same text as dumpTree() in tests/test_support.cpp."""
+    if v is None:
+        return "None"
+    if v is True or v is False:
+        return repr(v)
+    if type(v) is int:
+        return str(v)
+    if type(v) is float:
+        return repr(v)
+    if type(v) is str:
+        return "'" + escape(v.encode("utf-8", "surrogatepass")) + "'"
+    if type(v) is Buffer:
+        return "buffer(b'" + escape(v) + "')"
+    if type(v) is bytes:
+        return "b'" + escape(v) + "'"
+    if type(v) is bytearray:
+        return "bytearray(b'" + escape(v) + "')"
+    if type(v) is Set:
+        return "set(" + ", ".join(dump(x) for x in v) + ")"
+    if type(v) is FrozenSet:
+        return "frozenset(" + ", ".join(dump(x) for x in v) + ")"
+    if type(v) is list:
+        return "[" + ", ".join(dump(x) for x in v) + "]"
+    if type(v) is tuple:
+        return "(" + ", ".join(dump(x) for x in v) + ("," if len(v) == 1 else "") + ")"
+    if type(v) is dict:
+        return "{" + ", ".join(dump(k) + ": " + dump(x) for k, x in v.items()) + "}"
+    if type(v) is Global:
+        return v.module + "." + v.name
+    if type(v) is Reduce:
+        parts = [dump(v.callable), dump(v.args)]
+        if v.state is not None:
+            parts.append(dump(v.state))
+        return "reduce(" + ", ".join(parts) + ")"
+    if type(v) is PersId:
+        return "persid(" + dump(v.pid) + ")"
+    raise TypeError("no rendering for %r" % type(v))
+
+
+# --- The cases ---------------------------------------------------------------
+
+class Point:
+    def __init__(self, x, y):
+        self.x, self.y = x, y
+
+
+class Slotted:
+    __slots__ = ("a", "b")
+
+    def __init__(self):
+        self.a, self.b = 1, [2]
+
+
+class NewArgs:
+    """Rebuilt through NEWOBJ_EX (empty kwargs) from protocol 4 on."""
+
+    def __init__(self, n):
+        self.n = n
+
+    def __reduce_ex__(self, protocol):
+        return copyreg.__newobj_ex__, (type(self), (self.n,), {}), {"n": self.n}
+
+
+class Storage:
+    def __init__(self, key):
+        self.key = key
+
+
+class DupDict:
+    """Pickles as an OrderedDict() filled by SETITEM(S) with `pairs` exactly
+    as given, repeated keys included."""
+
+    def __init__(self, pairs):
+        self.pairs = pairs
+
+    def __reduce__(self):
+        return collections.OrderedDict, (), None, None, iter(self.pairs)
+
+
+class StoragePickler(pickle.Pickler):
+    def __init__(self, file, protocol, **kwargs):
+        super().__init__(file, protocol, **kwargs)
+        self.text = protocol == 0
+
+    def persistent_id(self, obj):
+        if not isinstance(obj, Storage):
+            return None
+        if self.text:
+            return "storage:" + obj.key  # PERSID takes a text line
+        return ("storage", obj.key, "cpu")
+
+
+# Stand-ins for the torch names a checkpoint refers to, registered as the
+# modules they live in so the pickler writes GLOBALs for them.
+def _rebuild_tensor_v2(*args):
+    raise NotImplementedError
+
+
+class FloatStorage:
+    pass
+
+
+_rebuild_tensor_v2.__module__ = "torch._utils"
+FloatStorage.__module__ = "torch"
+sys.modules.setdefault("torch", types.ModuleType("torch")).FloatStorage = FloatStorage
+sys.modules.setdefault("torch._utils", types.ModuleType("torch._utils"))._rebuild_tensor_v2 = _rebuild_tensor_v2
+
+
+class TorchStorage:
+    def __init__(self, key, numel):
+        self.key, self.numel = key, numel
+
+
+class Tensor:
+    def __init__(self, storage, offset, numel):
+        self.storage, self.offset, self.numel = storage, offset, numel
+
+    def __reduce__(self):
+        return _rebuild_tensor_v2, (self.storage, self.offset, (self.numel,), (1,), False,
+                                    collections.OrderedDict())
+
+
+class TorchPickler(pickle.Pickler):
+    def persistent_id(self, obj):
+        if not isinstance(obj, TorchStorage):
+            return None
+        return ("storage", FloatStorage, obj.key, "cpu", obj.numel)
+
+
+def k(*parts):
+    """A fresh str object, so the pickler cannot memoise it into a BINGET
+    of an earlier, equal key."""
+    return "".join(parts)
+
+
+def scalars():
+    return [None, True, False, 0, 1, -1, 255, 256, 65535, 65536, -129, 2**31 - 1, -2**31, 2**31,
+            2**63 - 1, -2**63, 0.0, -0.0, 1.5, 0.1, 100.0, 1e16, 1e-5, 1e300, 5e-324, -2.5e-7,
+            float("inf"), float("-inf"), float("nan"),
+            "", "abc", "café € \U0001f600", "quote's \\ and\nnewline\ttab", "x" * 300,
+            b"", b"\x00\xffbytes", b"y" * 300, bytearray(b"ba")]
+
+
+def containers():
+    shared = [1, 2]
+    return {
+        "list": [1, [2, [3]]],
+        "tuples": ((), (1,), (1, 2), (1, 2, 3), (1, 2, 3, 4)),
+        "set": {3, 1, 2},
+        "frozenset": frozenset({7}),
+        "nested": {"a": {"b": {"c": None}}},
+        "shared": (shared, shared),
+        "long_list": list(range(1100)),  # two APPENDS batches
+        "long_dict": {i: str(i) for i in range(1050)},  # two SETITEMS batches
+        "ordered": collections.OrderedDict([("b", 1), ("a", 2)]),
+    }
+
+
+def objects():
+    return [Point(1, "two"), Point, len, Storage("0"), Storage("1"), {"nested": Point(3, 4)}]
+
+
+def dup_pairs():
+    return [(1, "a"), (True, "b"),
+            ("x", "str"), (b"x", "bytes"),
+            (None, 1), (None, 2),
+            (k("k"), 1), (k("k"), 2), (k("k"), 3),
+            (False, "f"), (0, "zero"),
+            (b"b", 1), (b"b", 2)]
+
+
+def dup_big_pairs():
+    cases = []
+    # The 16th key repeats one already there: still caught by the scan.
+    cases.append([(k("k", str(i)), i) for i in range(15)] + [(k("k3"), "again")])
+    # The 17th repeats one: the first append past the scan limit.
+    cases.append([(k("k", str(i)), i) for i in range(16)] + [(k("k10"), "again")])
+    cases.append([(k("k", str(i)), i) for i in range(16)] + [(k("k15"), "again")])
+    # Every kind of equal scalar key, well past the limit.
+    pairs = [(k("k", str(i)), i) for i in range(16)]
+    pairs += [(1, "one"), ("x", "str"), (None, "none"), (b"b", "bytes")]
+    pairs += [(i, i) for i in range(100, 110)]
+    pairs += [(True, "true"), (b"x", "bytes"), (None, "none2"), (b"b", "bytes2"), (k("k3"), "k3"),
+              (105, "105"), (0, "zero"), (False, "false"), (k("k0"), "last")]
+    cases.append(pairs)
+    # Several SETITEMS batches, with a repeat every seventh key.
+    cases.append([(i if i % 7 else i // 7, str(i)) for i in range(1100)])
+    return cases
+
+
+def pickled(obj, protocol, buffers=None):
+    out = io.BytesIO()
+    StoragePickler(out, protocol=protocol, buffer_callback=buffers).dump(obj)
+    return out.getvalue()
+
+
+def cases():
+    for p in range(6):
+        yield "scalars_p%d" % p, pickled(scalars(), p), []
+        yield "containers_p%d" % p, pickled(containers(), p), []
+        yield "objects_p%d" % p, pickled(objects(), p), []
+        yield "dupkeys_p%d" % p, pickled(DupDict(dup_pairs()), p), []
+        yield "dupkeys_big_p%d" % p, pickled([DupDict(c) for c in dup_big_pairs()], p), []
+    for p in (2, 3, 4, 5):
+        yield "slots_p%d" % p, pickled(Slotted(), p), []
+    for p in (4, 5):
+        yield "newobj_ex_p%d" % p, pickled(NewArgs(5), p), []
+    # Past the 64 KiB frame target: several FRAMEs, and a payload big enough
+    # to be written between them rather than inside one.
+    yield "frames_p4", pickled(["item %04d of the frames case" % i for i in range(2300)] +
+                               [b"0123456789abcdef" * 4100], 4), []
+
+    buffers = []
+    data = pickled([pickle.PickleBuffer(bytearray(b"writable")), pickle.PickleBuffer(b"read only"),
+                    pickle.PickleBuffer(bytearray(b"in band"))], 5,
+                   lambda b: len(buffers) == 2 or buffers.append(b.raw().tobytes()))
+    yield "buffers_p5", data, buffers
+
+    # DICT with a repeated key, written by hand: the pickler never emits one.
+    yield "dict_dup_p0", b"(I1\nI10\nI01\nI11\nS'a'\nI2\nS'a'\nI3\nd.", []
+    yield "dict_dup_p2", b"\x80\x02(K\x01K\nK\x01K\x0bX\x01\x00\x00\x00aq\x00K\x02h\x00K\x03d.", []
+    # Python 2 text opcodes: INST, OBJ, STRING, BINSTRING, SHORT_BINSTRING.
+    yield "py2_text_p0", (b"(lp0\n(i__main__\nOld\np1\n(dp2\nS'a'\np3\nI1\nsbaS\"dq\"\na"
+                          b"(c__main__\nOld\np4\nS'x'\noag1\naT\x02\x00\x00\x00bsaU\x02usa."), []
+
+
+def select_cases():
+    """Dicts whose wanted entries reach, through GETs, memo entries first PUT
+    inside siblings a selection skips. Yields (name, object, selections,
+    protocols), each selection a list of dotted paths."""
+    shared = ["shared", (1, 2)]
+    deep = {"leaf": ("deep", 3.5)}
+    holder = [deep, b"bytes"]
+    yield "select_nested", {
+        "skipped": {"inner": [0, shared, holder]},
+        "also_skipped": [holder, {"k": "v"}],
+        "wanted": {"s": shared, "d": deep, "h": holder, "own": [1]},
+        "tail": shared,
+    }, [["wanted", "tail"], ["wanted.d", "tail"], ["wanted.s", "wanted.own"], ["tail"]], range(6)
+
+    # Objects the way a state dict shares them: a storage and a Reduce.
+    weights = Point(Storage("0"), [0.5, 1.5])
+    yield "select_objects", {
+        "encoder": {"w": weights, "b": Point(Storage("1"), weights.y)},
+        "decoder": {"w": Point(weights, Storage("1")), "tied": weights},
+    }, [["decoder"], ["decoder.tied"], ["encoder.b", "decoder.w"]], range(6)
+
+    # A chain: the second sibling, skipped too, GETs the first's entry and
+    # PUTs its own; the wanted one GETs both.
+    first = ("first", 1)
+    second = ["second", first]
+    yield "select_chain", {"a": [first], "b": [second, first], "c": [second, first]}, [["c"], ["a", "c"]], range(6)
+
+    # A skipped sibling large enough to span several FRAMEs, with the shared
+    # entry in the last of them.
+    late = {"late": "defined after 70 KB"}
+    yield "select_frames", {
+        "big": ["%04d " % i + "x" * 995 for i in range(70)] + [late],
+        "wanted": [late, late],
+    }, [["wanted"]], [4]
+
+
+def zip_bytes(members, method):
+    out = io.BytesIO()
+    with zipfile.ZipFile(out, "w") as z:
+        for name, data in members:
+            info = zipfile.ZipInfo(name, date_time=(2020, 1, 1, 0, 0, 0))
+            info.compress_type = method
+            z.writestr(info, data)
+    return bytearray(out.getvalue())
+
+
+def eocd(data):
+    return data.rindex(b"PK\x05\x06")
+
+
+def zip_cases():
+    members = [("archive/data.pkl", pickle.dumps({"a": 1}, protocol=2)),
+               ("archive/version", b"3\n"),
+               ("archive/data/0", bytes(range(256)) * 4)]
+    yield "stored", zip_bytes(members, zipfile.ZIP_STORED)
+    yield "deflated", zip_bytes(members, zipfile.ZIP_DEFLATED)
+
+    # The last member's CRC off by one, in its local and central headers.
+    data = zip_bytes(members, zipfile.ZIP_DEFLATED)
+    crc = zipfile.crc32(members[-1][1])
+    wrong = struct.pack("<I", (crc + 1) & 0xffffffff)
+    for sig in (b"PK\x03\x04", b"PK\x01\x02"):
+        at = data.rindex(sig)
+        field = at + (14 if sig == b"PK\x03\x04" else 16)
+        assert data[field:field + 4] == struct.pack("<I", crc)
+        data[field:field + 4] = wrong
+    yield "bad_crc", data
+
+    # The end record claims a central directory 10 bytes shorter than it is,
+    # so the last header runs past its end.
+    data = zip_bytes(members, zipfile.ZIP_STORED)
+    end = eocd(data)
+    size = struct.unpack_from("<I", data, end + 12)[0]
+    struct.pack_into("<I", data, end + 12, size - 10)
+    yield "truncated_dir", data
+
+    # ...and here one more entry than the directory holds.
+    data = zip_bytes(members, zipfile.ZIP_STORED)
+    end = eocd(data)
+    struct.pack_into("<HH", data, end + 8, 4, 4)
+    yield "missing_entry", data
+
+    # 46 bytes: a ZIP64 locator pointing at offset 0, where a ZIP64 end
+    # record starts but cannot fit.
+    yield "zip64_short", (b"PK\x06\x06" + b"PK\x06\x07" + struct.pack("<IQI", 0, 0, 1) +
+                          b"PK\x05\x06" + struct.pack("<HHHHIIH", 0, 0, 0xffff, 0xffff, 0xffffffff,
+                                                       0xffffffff, 0))
+
+
+def checkpoint():
+    """A torch.save()-shaped archive of float32 storages, where element i of
+    storage K holds K * 1000 + i. Even storages also back a second tensor
+    viewing their upper half, and "missing.weight" names a storage with no
+    data/ member."""
+    storages = [TorchStorage(str(key), 128 * (key + 1)) for key in range(16)]
+    state = collections.OrderedDict()
+    for s in storages:
+        state["layer%s.weight" % s.key] = Tensor(s, 0, s.numel)
+        if int(s.key) % 2 == 0:
+            state["layer%s.half" % s.key] = Tensor(s, s.numel // 2, s.numel // 2)
+    state["missing.weight"] = Tensor(TorchStorage("99", 4), 0, 4)
+    out = io.BytesIO()
+    TorchPickler(out, protocol=2).dump(state)
+    members = [("checkpoint/data.pkl", out.getvalue()), ("checkpoint/version", b"3\n")]
+    for s in storages:
+        base = int(s.key) * 1000
+        members.append(("checkpoint/data/" + s.key, struct.pack("<%df" % s.numel, *range(base, base + s.numel))))
+    return zip_bytes(members, zipfile.ZIP_STORED)
+
+
+def main():
+    root = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    for name, data, buffers in cases():
+        loaded = ReferenceUnpickler(io.BytesIO(data), encoding="latin1",
+                                    buffers=[Buffer(b) for b in buffers]).load()
+        with open(os.path.join(root, name + ".pkl"), "wb") as f:
+            f.write(data)
+        with open(os.path.join(root, name + ".tree"), "w") as f:
+            f.write(dump(loaded) + "\n")
+        for i, b in enumerate(buffers):
+            with open(os.path.join(root, "%s.buf%d" % (name, i)), "wb") as f:
+                f.write(b)
+    with open(os.path.join(root, "checkpoint.zip"), "wb") as f:
+        f.write(checkpoint())
+    for name, obj, selections, protocols in select_cases():
+        for p in protocols:
+            data = pickled(obj, p)
+            loaded = ReferenceUnpickler(io.BytesIO(data), encoding="latin1").load()
+            base = os.path.join(root, "%s_p%d" % (name, p))
+            with open(base + ".pkl", "wb") as f:
+                f.write(data)
+            with open(base + ".tree", "w") as f:
+                f.write(dump(loaded) + "\n")
+            with open(base + ".select", "w") as f:
+                f.write("".join(" ".join(paths) + "\n" for paths in selections))
+    for name, data in zip_cases():
+        with open(os.path.join(root, name + ".zip"), "wb") as f:
+            f.write(data)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+// Every fixture under tests/fixtures decodes to the tree Python's own
+// unpickler gives for it (NAME.tree, see make_fixtures.py), whether the
+// parser reads a caller buffer, a mapped file or interns its strings.
+#include "pickle.hpp"
+#include "test_support.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::string expected_tree(const std::string& name) {
+    std::string tree = readFile(fixturePath(name + ".tree"));
+    if (!tree.empty() && tree.back() == '\n') tree.pop_back();
+    return tree;
+}
+
+std::vector<std::string_view> views(const std::vector<std::string>& buffers) {
+    return std::vector<std::string_view>(buffers.begin(), buffers.end());
+}
+
+void check_fixture(const std::string& name) {
+    std::string data = readFile(fixturePath(name + ".pkl"));
+    std::vector<std::string> buffers = fixtureBuffers(name);
+    std::string want = expected_tree(name);
+
+    PickleParser parser(data.data(), data.size());
+    parser.setDiagnostics(nullptr);
+    parser.setBuffers(views(buffers));
+    parser.pickleOpener();
+    try {
+        parser.parsePickle();
+        std::string got = dumpTree(parser.root());
+        if (got != want) testFail(__FILE__, __LINE__, name + ": got\n" + got + "\nwant\n" + want);
+    } catch (const std::exception& e) {
+        testFail(__FILE__, __LINE__, name + ": " + e.what());
+        return;
+    }
+
+    PickleParser mapped(fixturePath(name + ".pkl"));
+    mapped.setBuffers(views(buffers));
+    mapped.setInterning(true);
+    mapped.pickleOpener(PickleParser::InputMode::Mmap);
+    mapped.parsePickle();
+    if (dumpTree(mapped.root()) != want) testFail(__FILE__, __LINE__, name + ": differs when mapped and interned");
+}
+
+// BINUNICODE, protocol 2 style.
+std::string str_op(std::string_view s) {
+    std::string out = "X";
+    uint32_t n = static_cast<uint32_t>(s.size());
+    for (int b = 0; b < 4; ++b) out += static_cast<char>((n >> (8 * b)) & 0xff);
+    return out + std::string(s);
+}
+
+// Tuple keys are not compared by content: two tuples built separately
+// stay two entries, while one memoised tuple given twice is one key, as
+// in Python (where it is the same object). Both below and above the scan
+// limit, where the merge at STOP does the work.
+void check_tuple_keys() {
+    for (int filler : {0, 20}) {
+        std::string head = "\x80\x02}(";
+        for (int k = 0; k < filler; ++k) head += str_op("f" + std::to_string(k)) + "K\x01";
+        std::string separate = head + "K\x07K\x08\x86" + str_op("a") + "K\x07K\x08\x86" + str_op("b") + "u.";
+        std::string memoised = head + "K\x07K\x08\x86q\x01" + str_op("a") + "h\x01" + str_op("b") + "u.";
+
+        PickleParser parser(separate.data(), separate.size());
+        parser.pickleOpener();
+        parser.parsePickle();
+        const PickleValue* d = parser.root();
+        CHECK_EQ(d->size(), static_cast<size_t>(filler + 2));
+        CHECK(d->dict.entries[filler].value->string() == "a");
+        CHECK(d->dict.entries[filler + 1].value->string() == "b");
+
+        parser.setInput(memoised.data(), memoised.size());
+        parser.pickleOpener();
+        parser.parsePickle();
+        d = parser.root();
+        CHECK_EQ(d->size(), static_cast<size_t>(filler + 1));
+        CHECK(d->dict.entries[filler].key->isTuple());
+        CHECK(d->dict.entries[filler].value->string() == "b");
+    }
+}
+
+// A second SETITEM for a string key replaces the first value in place,
+// and get() sees the new one.
+void check_get_after_replace() {
+    for (int filler : {0, 20}) {
+        std::string p = "\x80\x02}(" + str_op("k") + "K\x01";
+        for (int k = 0; k < filler; ++k) p += str_op("f" + std::to_string(k)) + "K\x01";
+        p += str_op("k") + "K\x02u" + str_op("k") + "K\x03s.";
+        PickleParser parser(p.data(), p.size());
+        parser.pickleOpener();
+        parser.parsePickle();
+        const PickleValue* d = parser.root();
+        CHECK_EQ(d->size(), static_cast<size_t>(filler + 1));
+        CHECK(d->dict.entries[0].key->string() == "k");
+        CHECK(d->get("k") && d->get("k")->i == 3);
+    }
+}
+
+// LONG1/LONG4 hold any size of integer, but only what fits int64 decodes:
+// longer encodings are fine while the extra bytes just extend the sign, and
+// a value that needs them throws, as a text LONG does.
+void check_long_range() {
+    auto parse = [](const std::string& body) {
+        std::string p = "\x80\x02" + body + ".";
+        PickleParser parser(p.data(), p.size());
+        parser.setDiagnostics(nullptr);
+        parser.pickleOpener();
+        parser.parsePickle();
+        return parser.root()->i;
+    };
+    std::string max9("\x8a\x09\xff\xff\xff\xff\xff\xff\xff\x7f\x00", 11);
+    std::string min8("\x8a\x08\x00\x00\x00\x00\x00\x00\x00\x80", 10);
+    std::string minus_one12 = std::string("\x8b\x0c\x00\x00\x00", 5) + std::string(12, '\xff');
+    CHECK_EQ(parse(max9), INT64_MAX);
+    CHECK_EQ(parse(min8), INT64_MIN);
+    CHECK_EQ(parse(minus_one12), int64_t{-1});
+
+    // 2**63 and -2**63 - 1, as Python writes them, and a 300-byte LONG4.
+    CHECK_THROWS(parse(std::string("\x8a\x09\x00\x00\x00\x00\x00\x00\x00\x80\x00", 11)),
+                 "LONG1: integer out of int64 range (9 bytes)");
+    CHECK_THROWS(parse(std::string("\x8a\x09\xff\xff\xff\xff\xff\xff\xff\x7f\xff", 11)),
+                 "LONG1: integer out of int64 range");
+    CHECK_THROWS(parse(std::string("\x8b\x2c\x01\x00\x00", 5) + std::string(299, '\0') + "\x01"),
+                 "LONG4: integer out of int64 range (300 bytes)");
+    std::string text = "L9223372036854775808L\n.";
+    PickleParser parser(text.data(), text.size());
+    parser.setDiagnostics(nullptr);
+    parser.pickleOpener();
+    CHECK_THROWS(parser.parsePickle(), "LONG: integer out of int64 range");
+}
+
+} // namespace
+
+int main() {
+    std::vector<std::string> names = fixtureNames();
+    CHECK(names.size() > 40);
+    for (const std::string& name : names) check_fixture(name);
+    check_tuple_keys();
+    check_get_after_replace();
+    check_long_range();
+    return testExit();
+}
@@ -0,0 +1,213 @@
+// Every fp16 and bf16 bit pattern through every kernel set this CPU runs
+// (avx512, avx2, scalar). Widening is checked against an IEEE decoding
+// written out here; narrowing against results known by construction: each
+// pattern's own value, the ties halfway to the next pattern (which go to
+// the even one) and one float ulp either side of them. All kernels must
+// then agree bit for bit with the scalar one, NaN payloads included.
+#include "half_convert.hpp"
+#include "test_support.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+uint32_t bits_of(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float float_of(uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+std::string hex(uint32_t v) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out = "0x";
+    for (int shift = 28; shift >= 0; shift -= 4) out += digits[(v >> shift) & 15];
+    return out;
+}
+
+// fp16 by its definition; NaNs come back quiet with their payload kept.
+uint32_t reference_half_to_float(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    int exp = (h >> 10) & 0x1f;
+    int mant = h & 0x3ff;
+    if (exp == 0x1f) return mant ? sign | 0x7fc00000u | (static_cast<uint32_t>(mant) << 13) : sign | 0x7f800000u;
+    float magnitude = exp ? std::ldexp(static_cast<float>(1024 + mant), exp - 25)
+                          : std::ldexp(static_cast<float>(mant), -24);
+    return sign | bits_of(magnitude);
+}
+
+bool half_is_nan(uint16_t h) { return (h & 0x7c00) == 0x7c00 && (h & 0x3ff); }
+bool bfloat16_is_nan(uint16_t b) { return (b & 0x7f80) == 0x7f80 && (b & 0x7f); }
+
+// Float inputs for narrowing, each with the pattern it must round to, or
+// with a NaN flag when any quiet NaN of the input's sign will do.
+struct Narrowing {
+    std::vector<float> in;
+    std::vector<uint16_t> want;
+    std::vector<bool> nan;
+
+    void add(float f, uint16_t w) {
+        in.push_back(f);
+        want.push_back(w);
+        nan.push_back(std::isnan(f));
+    }
+};
+
+// For every finite pattern p of one sign: its value gives p; the tie
+// between p and the next pattern up gives whichever is even, and the floats
+// just below and above the tie give p and the next one. Past the largest
+// finite value the next pattern is infinity, so the tie there overflows.
+template <typename ToFloat>
+Narrowing narrowing_cases(ToFloat to_float, uint16_t inf, uint16_t nan_mask) {
+    Narrowing c;
+    for (uint32_t p = 0; p < 0x10000; ++p) {
+        uint16_t h = static_cast<uint16_t>(p);
+        float f = to_float(h);
+        if ((h & inf) == inf && (h & nan_mask)) { // NaN
+            c.add(f, 0);
+            continue;
+        }
+        c.add(f, h);
+        if ((h & 0x7fff) == inf) continue;
+        uint16_t up = static_cast<uint16_t>(h + 1);
+        // The step to infinity is as wide as the one below it; for bf16 it
+        // ends past the float range, so the tie is found from f, not from
+        // the next value.
+        float step = (up & 0x7fff) == inf ? f - to_float(static_cast<uint16_t>(h - 1)) : to_float(up) - f;
+        float tie = f + step / 2;
+        c.add(tie, (h & 1) ? up : h);
+        c.add(std::nextafter(tie, f), h);
+        c.add(std::nextafter(tie, std::copysign(INFINITY, f)), up);
+    }
+    // Far outside the range on both ends, and NaNs whose payload sits only
+    // in the bits narrowing drops.
+    for (float sign : {1.0f, -1.0f}) {
+        uint16_t s = sign < 0 ? 0x8000 : 0;
+        c.add(sign * std::numeric_limits<float>::max(), s | inf);
+        c.add(sign * std::numeric_limits<float>::denorm_min(), s);
+        c.add(float_of(bits_of(sign * INFINITY) | 1), 0);
+        c.add(float_of(bits_of(sign * INFINITY) | 0x400000), 0);
+    }
+    return c;
+}
+
+float half_value(uint16_t h) { return float_of(reference_half_to_float(h)); }
+float bfloat16_value(uint16_t b) { return float_of(static_cast<uint32_t>(b) << 16); }
+
+using Widen = void (*)(const uint16_t*, float*, size_t);
+using Narrow = void (*)(const float*, uint16_t*, size_t);
+
+// Converts the whole input, then again from one element in and one short,
+// so the vector loops see unaligned loads and odd tails.
+std::vector<float> widen(Widen fn, const std::vector<uint16_t>& in) {
+    std::vector<float> out(in.size());
+    fn(in.data(), out.data(), in.size());
+    std::vector<float> shifted(in.size() - 2);
+    fn(in.data() + 1, shifted.data(), shifted.size());
+    if (std::memcmp(shifted.data(), out.data() + 1, shifted.size() * sizeof(float)) != 0) {
+        testFail(__FILE__, __LINE__, "widening depends on alignment or length");
+    }
+    return out;
+}
+
+std::vector<uint16_t> narrow(Narrow fn, const std::vector<float>& in) {
+    std::vector<uint16_t> out(in.size());
+    fn(in.data(), out.data(), in.size());
+    std::vector<uint16_t> shifted(in.size() - 2);
+    fn(in.data() + 1, shifted.data(), shifted.size());
+    if (std::memcmp(shifted.data(), out.data() + 1, shifted.size() * sizeof(uint16_t)) != 0) {
+        testFail(__FILE__, __LINE__, "narrowing depends on alignment or length");
+    }
+    return out;
+}
+
+void check_widening(const char* kernel, const char* what, const std::vector<float>& got,
+                    uint32_t (*reference)(uint16_t)) {
+    for (uint32_t p = 0; p < 0x10000; ++p) {
+        uint32_t want = reference(static_cast<uint16_t>(p));
+        if (bits_of(got[p]) != want) {
+            testFail(__FILE__, __LINE__, std::string(kernel) + " " + what + " " + hex(p) + ": " +
+                                             hex(bits_of(got[p])) + ", want " + hex(want));
+            return;
+        }
+    }
+}
+
+void check_narrowing(const char* kernel, const char* what, const Narrowing& c, const std::vector<uint16_t>& got,
+                     bool (*is_nan)(uint16_t), uint16_t quiet) {
+    for (size_t k = 0; k < c.in.size(); ++k) {
+        bool ok;
+        if (c.nan[k]) {
+            bool negative = bits_of(c.in[k]) >> 31;
+            ok = is_nan(got[k]) && (got[k] & quiet) && static_cast<bool>(got[k] & 0x8000) == negative;
+        } else {
+            ok = got[k] == c.want[k];
+        }
+        if (!ok) {
+            testFail(__FILE__, __LINE__, std::string(kernel) + " " + what + " " + hex(bits_of(c.in[k])) + ": " +
+                                             hex(got[k]) + ", want " + hex(c.want[k]));
+            return;
+        }
+    }
+}
+
+template <typename T>
+void check_same(const char* kernel, const char* what, const std::vector<T>& got, const std::vector<T>& scalar) {
+    if (got.size() != scalar.size() || std::memcmp(got.data(), scalar.data(), got.size() * sizeof(T)) != 0) {
+        testFail(__FILE__, __LINE__, std::string(kernel) + " " + what + ": differs from the scalar kernel");
+    }
+}
+
+uint32_t reference_bfloat16_to_float(uint16_t b) { return static_cast<uint32_t>(b) << 16; }
+
+} // namespace
+
+int main() {
+    std::vector<uint16_t> patterns(0x10000);
+    for (uint32_t p = 0; p < 0x10000; ++p) patterns[p] = static_cast<uint16_t>(p);
+    Narrowing half_cases = narrowing_cases(half_value, 0x7c00, 0x3ff);
+    Narrowing bfloat16_cases = narrowing_cases(bfloat16_value, 0x7f80, 0x7f);
+
+    // Scalar first: it is what the others must match exactly.
+    CHECK(useHalfConvertKernel("scalar"));
+    std::vector<float> scalar_half = widen(halfToFloat, patterns);
+    std::vector<float> scalar_bfloat16 = widen(bfloat16ToFloat, patterns);
+    std::vector<uint16_t> scalar_to_half = narrow(floatToHalf, half_cases.in);
+    std::vector<uint16_t> scalar_to_bfloat16 = narrow(floatToBFloat16, bfloat16_cases.in);
+
+    std::cout << "kernels:";
+    for (const char* kernel : {"scalar", "avx2", "avx512"}) {
+        if (!useHalfConvertKernel(kernel)) continue; // not on this CPU
+        std::cout << " " << kernel;
+        CHECK(std::string(halfConvertKernel()) == kernel);
+
+        std::vector<float> half = widen(halfToFloat, patterns);
+        check_widening(kernel, "halfToFloat", half, reference_half_to_float);
+        check_same(kernel, "halfToFloat", half, scalar_half);
+
+        std::vector<float> bfloat16 = widen(bfloat16ToFloat, patterns);
+        check_widening(kernel, "bfloat16ToFloat", bfloat16, reference_bfloat16_to_float);
+        check_same(kernel, "bfloat16ToFloat", bfloat16, scalar_bfloat16);
+
+        std::vector<uint16_t> to_half = narrow(floatToHalf, half_cases.in);
+        check_narrowing(kernel, "floatToHalf", half_cases, to_half, half_is_nan, 0x200);
+        check_same(kernel, "floatToHalf", to_half, scalar_to_half);
+
+        std::vector<uint16_t> to_bfloat16 = narrow(floatToBFloat16, bfloat16_cases.in);
+        check_narrowing(kernel, "floatToBFloat16", bfloat16_cases, to_bfloat16, bfloat16_is_nan, 0x40);
+        check_same(kernel, "floatToBFloat16", to_bfloat16, scalar_to_bfloat16);
+    }
+    std::cout << std::endl;
+    CHECK(!useHalfConvertKernel("sse9"));
+    return testExit();
+}
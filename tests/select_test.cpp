@@ -0,0 +1,138 @@
+// selectPaths() against a full parse: each selected path must lead to the
+// same subtree either way, even when that subtree GETs memo entries first
+// PUT inside a sibling the selection skipped (the select_* fixtures, whose
+// NAME.select lists the selections), and the skipped siblings must be left
+// out. Every other fixture with a dict root is also selected one root key
+// at a time.
+#include "pickle.hpp"
+#include "test_support.hpp"
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Follows a dotted path through dicts with string keys; null if it leads
+// nowhere.
+const PickleValue* at_path(const PickleValue* v, std::string_view path) {
+    while (v) {
+        size_t dot = path.find('.');
+        if (!v->isDict()) return nullptr;
+        v = v->get(path.substr(0, dot));
+        if (dot == std::string_view::npos) break;
+        path.remove_prefix(dot + 1);
+    }
+    return v;
+}
+
+bool selected(const std::vector<std::string>& paths, const std::string& path) {
+    for (const std::string& want : paths) {
+        if (path.size() >= want.size() && path.compare(0, want.size(), want) == 0 &&
+            (path.size() == want.size() || path[want.size()] == '.')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool leads_to_selected(const std::vector<std::string>& paths, const std::string& path) {
+    for (const std::string& want : paths) {
+        if (want.size() > path.size() && want.compare(0, path.size(), path) == 0 && want[path.size()] == '.') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Every entry of a filtered dict is selected or on the way to something
+// that is; the rest were skipped.
+void check_pruned(const PickleValue* v, const std::string& prefix, const std::vector<std::string>& paths,
+                  const std::string& what) {
+    for (uint32_t e = 0; e < v->dict.size; ++e) {
+        const PickleValue* key = v->dict.entries[e].key;
+        if (!key->isStr()) continue;
+        std::string path = prefix.empty() ? std::string(key->string()) : prefix + "." + std::string(key->string());
+        if (selected(paths, path)) continue;
+        if (!leads_to_selected(paths, path)) {
+            testFail(__FILE__, __LINE__, what + ": kept skipped entry " + path);
+        } else if (v->dict.entries[e].value->isDict()) {
+            check_pruned(v->dict.entries[e].value, path, paths, what);
+        }
+    }
+}
+
+std::string tree_at(const PickleValue* root, const std::string& path) {
+    const PickleValue* v = at_path(root, path);
+    return v ? dumpTree(v) : "(missing)";
+}
+
+// Parses `name` with `paths` selected and compares each path's subtree
+// with the full tree's.
+void check_selection(const std::string& name, const std::string& data, const std::vector<std::string_view>& buffers,
+                     const PickleValue* full, const std::vector<std::string>& paths, bool pruned) {
+    std::string what = name + " selecting";
+    for (const std::string& path : paths) what += " " + path;
+
+    PickleParser parser(data.data(), data.size());
+    parser.setDiagnostics(nullptr);
+    parser.setBuffers(buffers);
+    parser.selectPaths(paths);
+    parser.pickleOpener();
+    try {
+        parser.parsePickle();
+    } catch (const std::exception& e) {
+        testFail(__FILE__, __LINE__, what + ": " + e.what());
+        return;
+    }
+    for (const std::string& path : paths) {
+        std::string want = tree_at(full, path);
+        std::string got = tree_at(parser.root(), path);
+        if (got != want) testFail(__FILE__, __LINE__, what + ": " + path + " is\n" + got + "\nnot\n" + want);
+    }
+    if (pruned) check_pruned(parser.root(), std::string(), paths, what);
+}
+
+} // namespace
+
+int main() {
+    size_t selections = 0;
+    for (const std::string& name : fixtureNames()) {
+        std::string data = readFile(fixturePath(name + ".pkl"));
+        std::vector<std::string> owned = fixtureBuffers(name);
+        std::vector<std::string_view> buffers(owned.begin(), owned.end());
+        PickleParser full(data.data(), data.size());
+        full.setBuffers(buffers);
+        full.pickleOpener();
+        full.parsePickle();
+
+        if (std::filesystem::exists(fixturePath(name + ".select"))) {
+            // Protocol 0 fills dicts one SETITEM at a time, which selection
+            // decodes in full.
+            bool pruned = name.compare(name.size() - 3, 3, "_p0") != 0;
+            std::istringstream lines(readFile(fixturePath(name + ".select")));
+            std::string line;
+            while (std::getline(lines, line)) {
+                std::istringstream words(line);
+                std::vector<std::string> paths;
+                for (std::string path; words >> path;) paths.push_back(path);
+                check_selection(name, data, buffers, full.root(), paths, pruned);
+                ++selections;
+            }
+            continue;
+        }
+        const PickleValue* root = full.root();
+        if (!root->isDict()) continue;
+        std::vector<std::string> keys;
+        for (uint32_t e = 0; e < root->dict.size && keys.size() < 8; ++e) {
+            const PickleValue* key = root->dict.entries[e].key;
+            if (key->isStr() && key->string().find('.') == std::string_view::npos) {
+                keys.emplace_back(key->string());
+            }
+        }
+        for (const std::string& key : keys) check_selection(name, data, buffers, full.root(), {key}, false);
+    }
+    CHECK(selections >= 55); // the select_* fixtures were found
+    return testExit();
+}
@@ -0,0 +1,163 @@
+#include "test_support.hpp"
+#include "pickle.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+std::atomic<int> failures{0}; // checks may fail on any thread
+
+void dump_string(std::string& out, std::string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    for (unsigned char c : s) {
+        if (c == '\\' || c == '\'') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c >= 0x20 && c < 0x7f) {
+            out += static_cast<char>(c);
+        } else {
+            out += "\\x";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+}
+
+void dump_items(std::string& out, const PickleValue* v);
+
+void dump(std::string& out, const PickleValue* v) {
+    switch (v->type) {
+    case PickleType::None: out += "None"; break;
+    case PickleType::Bool: out += v->b ? "True" : "False"; break;
+    case PickleType::Int: out += std::to_string(v->i); break;
+    case PickleType::Float: out += pythonFloatRepr(v->f); break;
+    case PickleType::Str:
+        out += '\'';
+        dump_string(out, v->string());
+        out += '\'';
+        break;
+    case PickleType::Bytes:
+        out += "b'";
+        dump_string(out, v->string());
+        out += '\'';
+        break;
+    case PickleType::ByteArray:
+        out += "bytearray(b'";
+        dump_string(out, v->string());
+        out += "')";
+        break;
+    case PickleType::Buffer:
+        out += "buffer(b'";
+        dump_string(out, v->string());
+        out += "')";
+        break;
+    case PickleType::List:
+        out += '[';
+        dump_items(out, v);
+        out += ']';
+        break;
+    case PickleType::Tuple:
+        out += '(';
+        dump_items(out, v);
+        out += v->size() == 1 ? ",)" : ")";
+        break;
+    case PickleType::Set:
+        out += "set(";
+        dump_items(out, v);
+        out += ')';
+        break;
+    case PickleType::FrozenSet:
+        out += "frozenset(";
+        dump_items(out, v);
+        out += ')';
+        break;
+    case PickleType::Dict:
+        out += '{';
+        for (uint32_t e = 0; e < v->dict.size; ++e) {
+            if (e) out += ", ";
+            dump(out, v->dict.entries[e].key);
+            out += ": ";
+            dump(out, v->dict.entries[e].value);
+        }
+        out += '}';
+        break;
+    case PickleType::Global:
+        out += v->module();
+        out += '.';
+        out += v->name();
+        break;
+    case PickleType::Reduce:
+        out += "reduce(";
+        dump(out, v->reduce.callable);
+        out += ", ";
+        dump(out, v->reduce.args);
+        if (v->reduce.state) {
+            out += ", ";
+            dump(out, v->reduce.state);
+        }
+        out += ')';
+        break;
+    case PickleType::PersId:
+        out += "persid(";
+        dump(out, v->pid);
+        out += ')';
+        break;
+    }
+}
+
+void dump_items(std::string& out, const PickleValue* v) {
+    for (size_t k = 0; k < v->size(); ++k) {
+        if (k) out += ", ";
+        dump(out, (*v)[k]);
+    }
+}
+
+} // namespace
+
+void testFail(const char* file, int line, const std::string& what) {
+    ++failures;
+    std::cerr << file << ":" << line << ": " << what << std::endl;
+}
+
+int testExit() {
+    if (failures) std::cerr << failures.load() << " check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+std::string dumpTree(const PickleValue* v) {
+    std::string out;
+    dump(out, v);
+    return out;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+std::string fixturePath(const std::string& file) {
+    return std::string(PICKLE_TEST_FIXTURES) + "/" + file;
+}
+
+std::vector<std::string> fixtureNames() {
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(PICKLE_TEST_FIXTURES)) {
+        if (entry.path().extension() == ".pkl") names.push_back(entry.path().stem().string());
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::vector<std::string> fixtureBuffers(const std::string& name) {
+    std::vector<std::string> buffers;
+    for (size_t n = 0; std::filesystem::exists(fixturePath(name + ".buf" + std::to_string(n))); ++n) {
+        buffers.push_back(readFile(fixturePath(name + ".buf" + std::to_string(n))));
+    }
+    return buffers;
+}
@@ -0,0 +1,63 @@
+#ifndef PICKLE_TEST_SUPPORT_HPP
+#define PICKLE_TEST_SUPPORT_HPP
+
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct PickleValue;
+
+// Assertions for the programs under tests/. A failed check prints where it
+// is and what it saw, and the test carries on, so one run lists every
+// failure; main() ends with `return testExit();`.
+void testFail(const char* file, int line, const std::string& what);
+int testExit(); // 0 if nothing failed; prints the failure count otherwise
+
+#define CHECK(cond)                                                 \
+    do {                                                            \
+        if (!(cond)) testFail(__FILE__, __LINE__, "CHECK(" #cond ")"); \
+    } while (0)
+
+// Both sides are printed on failure, so they need an operator<<.
+#define CHECK_EQ(a, b)                                                              \
+    do {                                                                            \
+        const auto& checkLhs = (a);                                                 \
+        const auto& checkRhs = (b);                                                 \
+        if (!(checkLhs == checkRhs)) {                                              \
+            std::ostringstream checkMsg;                                            \
+            checkMsg << "CHECK_EQ(" #a ", " #b "): " << checkLhs << " != " << checkRhs; \
+            testFail(__FILE__, __LINE__, checkMsg.str());                           \
+        }                                                                           \
+    } while (0)
+
+// `expr` has to throw a std::exception whose what() contains `text`.
+#define CHECK_THROWS(expr, text)                                                          \
+    do {                                                                                  \
+        try {                                                                             \
+            expr;                                                                         \
+            testFail(__FILE__, __LINE__, "CHECK_THROWS(" #expr "): nothing thrown");      \
+        } catch (const std::exception& checkError) {                                      \
+            if (std::string(checkError.what()).find(text) == std::string::npos) {         \
+                testFail(__FILE__, __LINE__,                                              \
+                         std::string("CHECK_THROWS(" #expr "): threw '") + checkError.what() + "'"); \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+// The tree on one line, as tests/fixtures/make_fixtures.py renders the
+// reference decoder's result: Python-like, with 1-tuples as "(x,)", sets
+// as "set(...)" in stream order, Globals as module.name, Reduces as
+// reduce(callable, args[, state]), and strings as their UTF-8 bytes with
+// anything outside printable ASCII escaped as \xHH.
+std::string dumpTree(const PickleValue* v);
+
+std::string readFile(const std::string& path);
+// A file under tests/fixtures.
+std::string fixturePath(const std::string& file);
+// Every fixture's base name (NAME for NAME.pkl), sorted.
+std::vector<std::string> fixtureNames();
+// Contents of NAME.buf0, NAME.buf1, ...: the fixture's out-of-band buffers.
+std::vector<std::string> fixtureBuffers(const std::string& name);
+
+#endif // PICKLE_TEST_SUPPORT_HPP
@@ -0,0 +1,107 @@
+// ThreadPool under load: tasks that submit tasks from inside the pool,
+// wait() called while the work it waits for is still growing, and pools
+// destroyed with their queues full. Every task bumps a counter, so a lost
+// or doubly run task shows up as a wrong total. Best run under TSan too
+// (PICKLE_SANITIZE=thread).
+#include "test_support.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A full binary tree of tasks, each spawning its children from inside the
+// pool; 2^(depth+1) - 1 of them in all.
+void spawn_tree(ThreadPool& pool, std::atomic<size_t>& ran, int depth) {
+    ran.fetch_add(1);
+    if (pool.workerIndex() >= pool.size()) ran.fetch_add(1000000); // ran off the pool
+    if (depth == 0) return;
+    for (int child = 0; child < 2; ++child) {
+        pool.submit([&pool, &ran, depth] { spawn_tree(pool, ran, depth - 1); });
+    }
+}
+
+// A chain where each task submits the next: the amount of outstanding work
+// never drops to zero until the last one, so wait() must not return early.
+void spawn_chain(ThreadPool& pool, std::atomic<size_t>& ran, size_t left) {
+    ran.fetch_add(1);
+    if (left > 1) pool.submit([&pool, &ran, left] { spawn_chain(pool, ran, left - 1); });
+}
+
+void check_nested_submit(size_t threads) {
+    ThreadPool pool(threads);
+    CHECK_EQ(pool.size(), threads);
+    CHECK_EQ(pool.workerIndex(), threads);
+    for (int round = 0; round < 20; ++round) {
+        std::atomic<size_t> ran{0};
+        pool.submit([&pool, &ran] { spawn_tree(pool, ran, 9); });
+        pool.wait();
+        CHECK_EQ(ran.load(), size_t{1023});
+    }
+}
+
+void check_wait_while_submitting(size_t threads) {
+    ThreadPool pool(threads);
+    for (int round = 0; round < 20; ++round) {
+        std::atomic<size_t> ran{0};
+        for (int chain = 0; chain < 4; ++chain) {
+            pool.submit([&pool, &ran] { spawn_chain(pool, ran, 500); });
+        }
+        // Two outside waiters at once, racing the chains and each other.
+        std::thread other([&pool, &ran] {
+            pool.wait();
+            CHECK_EQ(ran.load(), size_t{2000});
+        });
+        pool.wait();
+        CHECK_EQ(ran.load(), size_t{2000});
+        other.join();
+    }
+}
+
+// The destructor runs everything still queued, including what those tasks
+// submit on their way out, before it joins. The first task holds its
+// worker so the queues are still full when destruction starts.
+void check_destroy_with_queued_work(size_t threads) {
+    for (int round = 0; round < 10; ++round) {
+        std::atomic<size_t> ran{0};
+        {
+            ThreadPool pool(threads);
+            pool.submit([&ran] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                ran.fetch_add(1);
+            });
+            for (int k = 0; k < 2000; ++k) {
+                pool.submit([&pool, &ran, k] {
+                    ran.fetch_add(1);
+                    if (k % 100 == 0) pool.submit([&ran] { ran.fetch_add(1); });
+                });
+            }
+        }
+        CHECK_EQ(ran.load(), size_t{2021});
+    }
+}
+
+// A throwing task is dropped, and the worker that ran it keeps going.
+void check_throwing_task() {
+    ThreadPool pool(1);
+    std::atomic<size_t> ran{0};
+    pool.submit([] { throw std::runtime_error("task failed"); });
+    pool.submit([&ran] { ran.fetch_add(1); });
+    pool.wait();
+    CHECK_EQ(ran.load(), size_t{1});
+}
+
+} // namespace
+
+int main() {
+    for (size_t threads : {1, 2, 4, 8}) {
+        check_nested_submit(threads);
+        check_wait_while_submitting(threads);
+        check_destroy_with_queued_work(threads);
+    }
+    check_throwing_task();
+    return testExit();
+}
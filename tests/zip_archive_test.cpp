@@ -0,0 +1,102 @@
+// ZipArchive on the small archives make_fixtures.py writes: stored and
+// deflated members read back intact, and each broken archive fails with
+// the error for what is wrong with it rather than reading out of bounds.
+#include "pickle.hpp"
+#include "test_support.hpp"
+#include "zip_archive.hpp"
+#include <string>
+#include <vector>
+
+namespace {
+
+// What make_fixtures.py puts in archive/data/0.
+std::string storage_bytes() {
+    std::string out;
+    for (int r = 0; r < 4; ++r) {
+        for (int b = 0; b < 256; ++b) out += static_cast<char>(b);
+    }
+    return out;
+}
+
+std::string streamed(const ZipArchive& zip, const ZipEntry& entry, size_t chunk) {
+    std::string out;
+    bool bounded = true;
+    zip.stream(entry, [&](const char* data, size_t len) {
+        bounded = bounded && len > 0 && len <= chunk;
+        out.append(data, len);
+    }, chunk);
+    CHECK(bounded);
+    return out;
+}
+
+void check_stored() {
+    ZipArchive zip(fixturePath("stored.zip"));
+    CHECK_EQ(zip.entries().size(), size_t{3});
+    CHECK(zip.find("archive/nope") == nullptr);
+    const ZipEntry* version = zip.find("archive/version");
+    const ZipEntry* storage = zip.find("archive/data/0");
+    const ZipEntry* pkl = zip.find("archive/data.pkl");
+    CHECK(version && storage && pkl);
+    if (!version || !storage || !pkl) return;
+    CHECK(version->stored() && storage->stored());
+    CHECK(zip.view(*version) == "3\n");
+    CHECK(zip.view(*storage) == storage_bytes());
+    std::vector<char> extracted = zip.extract(*storage);
+    CHECK(std::string(extracted.begin(), extracted.end()) == storage_bytes());
+    CHECK(streamed(zip, *storage, 100) == storage_bytes());
+
+    std::string_view data = zip.view(*pkl);
+    PickleParser parser(data.data(), data.size());
+    parser.pickleOpener();
+    parser.parsePickle();
+    CHECK_EQ(dumpTree(parser.root()), std::string("{'a': 1}"));
+}
+
+void check_deflated() {
+    ZipArchive zip(fixturePath("deflated.zip"));
+    CHECK_EQ(zip.entries().size(), size_t{3});
+    const ZipEntry* storage = zip.find("archive/data/0");
+    CHECK(storage && storage->method == 8);
+    if (!storage) return;
+    CHECK_THROWS(zip.view(*storage), "is compressed");
+#ifdef PICKLE_HAVE_ZLIB
+    std::vector<char> extracted = zip.extract(*storage);
+    CHECK(std::string(extracted.begin(), extracted.end()) == storage_bytes());
+    CHECK(streamed(zip, *storage, 7) == storage_bytes());
+#else
+    CHECK_THROWS(zip.extract(*storage), "this build has no zlib");
+#endif
+}
+
+void check_bad_crc() {
+    ZipArchive zip(fixturePath("bad_crc.zip"));
+    const ZipEntry* storage = zip.find("archive/data/0");
+    const ZipEntry* version = zip.find("archive/version");
+    CHECK(storage && version);
+    if (!storage || !version) return;
+#ifdef PICKLE_HAVE_ZLIB
+    CHECK_THROWS(zip.extract(*storage), "size or CRC mismatch in 'archive/data/0'");
+    std::vector<char> intact = zip.extract(*version);
+    CHECK(std::string(intact.begin(), intact.end()) == "3\n");
+#else
+    CHECK_THROWS(zip.extract(*storage), "this build has no zlib");
+#endif
+}
+
+void check_broken_directories() {
+    CHECK_THROWS(ZipArchive(fixturePath("truncated_dir.zip")), "truncated central directory");
+    CHECK_THROWS(ZipArchive(fixturePath("missing_entry.zip")), "truncated central directory");
+    // Shorter than the ZIP64 end record its locator points at.
+    CHECK_THROWS(ZipArchive(fixturePath("zip64_short.zip")), "bad ZIP64 end of central directory record");
+    CHECK_THROWS(ZipArchive(fixturePath("scalars_p2.pkl")), "no end of central directory record");
+}
+
+} // namespace
+
+int main() {
+    check_stored();
+    check_deflated();
+    check_bad_crc();
+    check_broken_directories();
+    return testExit();
+}
@@ -0,0 +1,85 @@
+#include "thread_pool.hpp"
+
+namespace {
+// Which pool (if any) the current thread works for, and its queue index.
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local size_t tls_index = 0;
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    workers.reserve(threads);
+    for (size_t w = 0; w < threads; ++w) workers.push_back(std::make_unique<Worker>());
+    this->threads.reserve(threads);
+    for (size_t w = 0; w < threads; ++w) this->threads.emplace_back([this, w] { run(w); });
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    stopping.store(true);
+    available.release(static_cast<std::ptrdiff_t>(workers.size()));
+    for (std::thread& t : threads) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t q = (tls_pool == this) ? tls_index : nextQueue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    outstanding.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> guard(workers[q]->lock);
+        workers[q]->tasks.push_back(std::move(task));
+    }
+    available.release();
+}
+
+size_t ThreadPool::workerIndex() const {
+    return tls_pool == this ? tls_index : workers.size();
+}
+
+void ThreadPool::wait() {
+    for (size_t left = outstanding.load(); left != 0; left = outstanding.load()) outstanding.wait(left);
+}
+
+bool ThreadPool::tryPop(size_t self, std::function<void()>& task) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < workers.size(); ++k) {
+        Worker& victim = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t self) {
+    tls_pool = this;
+    tls_index = self;
+    for (;;) {
+        available.acquire();
+        std::function<void()> task;
+        if (!tryPop(self, task)) {
+            if (stopping.load()) return; // the destructor's token; every queue is drained
+            // Each token stands for a queued task, but while we scanned, other
+            // holders took the ones ahead of us and new ones landed in queues
+            // already passed. Hand the token back rather than spin on it.
+            available.release();
+            continue;
+        }
+        try {
+            task();
+        } catch (...) {
+        }
+        if (outstanding.fetch_sub(1) == 1) outstanding.notify_all();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool with one deque per worker. A worker runs its own queue
+// newest-first and, when that is empty, steals the oldest task from a
+// peer, so a few huge jobs and many tiny ones still spread evenly.
+// Tasks submitted from a worker go to that worker's own queue. The only
+// locks are the per-worker queue locks; idle workers sleep on a semaphore
+// holding one token per queued task.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0); // 0: one per hardware thread
+    ~ThreadPool();                           // finishes queued tasks, then joins
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Tasks must not throw; an escaping exception is swallowed so the
+    // worker survives, and is otherwise lost.
+    void submit(std::function<void()> task);
+    // Blocks until every task submitted so far (and any they submitted)
+    // has finished.
+    void wait();
+    size_t size() const { return workers.size(); }
+    // Index in [0, size()) of the worker running the caller, or size() when
+    // called from outside the pool; lets tasks keep per-worker state.
+    size_t workerIndex() const;
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void run(size_t self);
+    bool tryPop(size_t self, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::counting_semaphore<> available{0}; // queued tasks, plus one per worker once stopping
+    std::atomic<size_t> outstanding{0};     // submitted, not yet finished
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<bool> stopping{false};
+};
+
+#endif // THREAD_POOL_HPP
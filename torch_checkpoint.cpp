@@ -0,0 +1,609 @@
+#include "torch_checkpoint.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+
+size_t dtypeSize(TorchDType dtype) {
+    switch (dtype) {
+    case TorchDType::Float16:
+    case TorchDType::BFloat16:
+    case TorchDType::Int16:
+        return 2;
+    case TorchDType::Float32:
+    case TorchDType::Int32:
+        return 4;
+    case TorchDType::Float64:
+    case TorchDType::Int64:
+        return 8;
+    case TorchDType::Int8:
+    case TorchDType::UInt8:
+    case TorchDType::Bool:
+        return 1;
+    }
+    return 0;
+}
+
+const char* dtypeName(TorchDType dtype) {
+    switch (dtype) {
+    case TorchDType::Float16: return "float16";
+    case TorchDType::BFloat16: return "bfloat16";
+    case TorchDType::Float32: return "float32";
+    case TorchDType::Float64: return "float64";
+    case TorchDType::Int8: return "int8";
+    case TorchDType::UInt8: return "uint8";
+    case TorchDType::Int16: return "int16";
+    case TorchDType::Int32: return "int32";
+    case TorchDType::Int64: return "int64";
+    case TorchDType::Bool: return "bool";
+    }
+    return "unknown";
+}
+
+TorchDType dtypeFromStorageClass(std::string_view storage_class) {
+    struct Entry {
+        std::string_view name;
+        TorchDType dtype;
+    };
+    static const Entry kStorages[] = {
+        {"HalfStorage", TorchDType::Float16},   {"BFloat16Storage", TorchDType::BFloat16},
+        {"FloatStorage", TorchDType::Float32},  {"DoubleStorage", TorchDType::Float64},
+        {"CharStorage", TorchDType::Int8},      {"ByteStorage", TorchDType::UInt8},
+        {"ShortStorage", TorchDType::Int16},    {"IntStorage", TorchDType::Int32},
+        {"LongStorage", TorchDType::Int64},     {"BoolStorage", TorchDType::Bool},
+    };
+    for (const Entry& e : kStorages) {
+        if (e.name == storage_class) return e.dtype;
+    }
+    throw std::runtime_error("Unsupported torch storage class: " + std::string(storage_class));
+}
+
+size_t TorchTensor::numel() const {
+    size_t n = 1;
+    for (int64_t d : shape) n *= static_cast<size_t>(d);
+    return n;
+}
+
+namespace {
+
+int64_t int_at(const PickleValue* tuple, size_t idx, const char* what) {
+    const PickleValue* v = (*tuple)[idx];
+    if (v->type != PickleType::Int) {
+        throw std::runtime_error(std::string("torch tensor: ") + what + " is not an int");
+    }
+    return v->i;
+}
+
+std::vector<int64_t> int_tuple(const PickleValue* v, const char* what) {
+    if (v->type != PickleType::Tuple) {
+        throw std::runtime_error(std::string("torch tensor: ") + what + " is not a tuple");
+    }
+    std::vector<int64_t> out(v->size());
+    for (size_t d = 0; d < out.size(); ++d) out[d] = int_at(v, d, what);
+    return out;
+}
+
+bool is_global(const PickleValue* v, uint32_t id) {
+    return v->type == PickleType::Global && v->interned == id;
+}
+
+// Highest element index the view touches must lie inside the storage.
+void check_view(const TorchTensor& t) {
+    if (t.numel() == 0) return;
+    int64_t last = t.storageOffset;
+    for (size_t d = 0; d < t.shape.size(); ++d) last += (t.shape[d] - 1) * t.stride[d];
+    if (t.storageOffset < 0 || last < 0 || static_cast<size_t>(last) >= t.storage->numel) {
+        throw std::runtime_error("torch tensor '" + t.name + "': view exceeds storage '" + t.storage->key + "'");
+    }
+}
+
+// Same rule as PickleParser::selectPaths: the path itself or anything below.
+bool path_selected(const std::vector<std::string>& paths, std::string_view name) {
+    if (paths.empty()) return true;
+    for (const std::string& want : paths) {
+        if (name.size() >= want.size() && name.compare(0, want.size(), want) == 0 &&
+            (name.size() == want.size() || name[want.size()] == '.')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sidecar index layout, all integers little-endian:
+//   magic "PTIDX\0v1", source size (u64), source mtime (i64)
+//   storage count (u32), then per storage:
+//     key length (u16), key, dtype (u8), numel (u64)
+//   tensor count (u32), then per tensor:
+//     name length (u32), name, storage index (u32), storage offset (i64),
+//     rank (u8), shape (rank x i64), stride (rank x i64)
+constexpr std::string_view kIndexMagic("PTIDX\0v1", 8);
+
+void put_le(std::string& out, uint64_t v, size_t n) {
+    for (size_t b = 0; b < n; ++b) out += static_cast<char>(v >> (8 * b));
+}
+
+// Bounds-checked cursor over a mapped index; throws on a short read.
+struct IndexReader {
+    const char* p;
+    const char* end;
+
+    size_t left() const { return static_cast<size_t>(end - p); }
+    std::string_view bytes(size_t n) {
+        if (left() < n) throw std::runtime_error("torch index: truncated");
+        std::string_view v(p, n);
+        p += n;
+        return v;
+    }
+    uint64_t le(size_t n) {
+        std::string_view raw = bytes(n);
+        uint64_t v = 0;
+        for (size_t b = 0; b < n; ++b) v |= static_cast<uint64_t>(static_cast<unsigned char>(raw[b])) << (8 * b);
+        return v;
+    }
+    // Element count that cannot possibly fit in the rest of the file is
+    // corruption, not a reason to allocate.
+    size_t count(size_t n, size_t min_record) {
+        size_t c = static_cast<size_t>(le(n));
+        if (c > left() / min_record) throw std::runtime_error("torch index: bad count");
+        return c;
+    }
+};
+
+} // namespace
+
+// Per-storage load state. Shared with pool tasks, which may outlive the
+// parse that created it.
+struct TorchCheckpoint::StorageSlot {
+    std::shared_ptr<TorchStorage> storage;
+    std::string path;                 // extracted archive
+    const ZipEntry* entry = nullptr;  // .pt file
+    bool exists = false;
+    std::promise<void> done;
+    std::atomic<size_t> chunksLeft{0};
+    std::mutex lock;
+    bool finished = false;
+    std::vector<const TorchTensor*> waiting; // resolved before the storage finished
+};
+
+namespace {
+// Faulting in happens in chunks of this size so one big storage still
+// spreads over the whole pool.
+constexpr size_t kPrefaultChunk = 4 * 1024 * 1024;
+} // namespace
+
+TorchCheckpoint::TorchCheckpoint(const std::string& path) {
+    if (std::filesystem::is_directory(path)) {
+        archiveDir = path;
+        sourcePath = path + "/data.pkl";
+        parser = std::make_unique<PickleParser>(sourcePath);
+        return;
+    }
+    sourcePath = path;
+    // torch.save() nests everything under one top-level folder named after
+    // the file it first wrote, which need not match the current file name.
+    zip = std::make_unique<ZipArchive>(path);
+    const ZipEntry* pkl = nullptr;
+    for (const ZipEntry& e : zip->entries()) {
+        std::string_view name(e.name);
+        size_t slash = name.find('/');
+        if (slash != std::string_view::npos && name.substr(slash + 1) == "data.pkl") {
+            pkl = &e;
+            zipPrefix = e.name.substr(0, slash + 1);
+            break;
+        }
+    }
+    if (!pkl) throw std::runtime_error("torch: no <name>/data.pkl member in " + path);
+    if (pkl->stored()) {
+        std::string_view bytes = zip->view(*pkl);
+        parser = std::make_unique<PickleParser>(bytes.data(), bytes.size());
+    } else {
+        pickleBytes = zip->extract(*pkl);
+        parser = std::make_unique<PickleParser>(pickleBytes.data(), pickleBytes.size());
+    }
+}
+
+TorchCheckpoint::~TorchCheckpoint() {
+    drain();
+}
+
+// `ready` fires before finishStorage() has run the callbacks, so waiting
+// on it alone would free what the pool thread is still using.
+void TorchCheckpoint::drain() {
+    for (auto& entry : storages) {
+        if (entry.second->storage->ready.valid()) entry.second->storage->ready.wait();
+    }
+    std::unique_lock<std::mutex> guard(finishLock);
+    finishDone.wait(guard, [this] { return finishing == 0; });
+}
+
+void TorchCheckpoint::reset() {
+    drain();
+    storages.clear();
+    slotByKey.clear();
+    tensorList.clear();
+    missing.clear();
+    onTensorReady = nullptr;
+    fromIndex = false;
+}
+
+void TorchCheckpoint::select(std::vector<std::string> paths) {
+    selected = paths;
+    parser->selectPaths(std::move(paths));
+}
+
+void TorchCheckpoint::useIndex(std::string path) {
+    indexPath = path.empty() ? sourcePath + ".idx" : std::move(path);
+}
+
+void TorchCheckpoint::load() {
+    reset();
+    fromIndex = readIndex();
+    if (!fromIndex) {
+        parser->setPersistentIdHook(nullptr);
+        parse();
+    }
+    for (auto& entry : storages) {
+        mapStorage(*entry.second);
+        finishStorage(*entry.second, nullptr);
+    }
+}
+
+void TorchCheckpoint::load(ThreadPool& pool, TensorCallback on_ready) {
+    reset();
+    onTensorReady = std::move(on_ready);
+    fromIndex = readIndex();
+    if (fromIndex) {
+        for (auto& entry : storages) startStorage(pool, *entry.second);
+    } else {
+        parser->setPersistentIdHook([this, &pool](const PickleValue* pid) { startStorage(pool, slotFor(pid)); });
+        try {
+            parse();
+        } catch (...) {
+            parser->setPersistentIdHook(nullptr);
+            throw;
+        }
+        parser->setPersistentIdHook(nullptr);
+    }
+
+    // tensorList is final now, so pool threads may be handed pointers into it.
+    for (const TorchTensor& t : tensorList) {
+        StorageSlot& slot = *storages.at(t.storage->key);
+        bool fire_now;
+        {
+            std::lock_guard<std::mutex> guard(slot.lock);
+            fire_now = slot.finished;
+            if (!slot.finished) slot.waiting.push_back(&t);
+        }
+        if (fire_now && onTensorReady) onTensorReady(t);
+    }
+}
+
+void TorchCheckpoint::parse() {
+    // Stamped before parsing, so a source replaced mid-parse leaves an
+    // index that is already stale.
+    SourceStamp stamp{};
+    bool indexing = !indexPath.empty() && selected.empty() && stampSource(stamp);
+    parser->pickleOpener(PickleParser::InputMode::Mmap);
+    parser->setInterning(true, &names);
+    parser->parsePickle();
+    std::string path;
+    collect(parser->root(), path);
+    if (indexing) writeIndex(stamp);
+}
+
+bool TorchCheckpoint::stampSource(SourceStamp& stamp) const {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(sourcePath, ec);
+    if (ec) return false;
+    auto mtime = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec) return false;
+    stamp.size = size;
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return true;
+}
+
+// Fills storages and tensorList from the index if it matches the source.
+// A missing, stale or corrupt index is not an error: the caller parses.
+bool TorchCheckpoint::readIndex() {
+    SourceStamp stamp;
+    std::error_code ec;
+    if (indexPath.empty() || !stampSource(stamp) || !std::filesystem::is_regular_file(indexPath, ec)) return false;
+    struct IndexedStorage {
+        std::string_view key;
+        TorchDType dtype;
+        size_t numel;
+        StorageSlot* slot;
+    };
+    try {
+        MappedFile index(indexPath);
+        IndexReader in{index.data(), index.data() + index.size()};
+        if (in.bytes(kIndexMagic.size()) != kIndexMagic || in.le(8) != stamp.size ||
+            static_cast<int64_t>(in.le(8)) != stamp.mtime) {
+            return false;
+        }
+        std::vector<IndexedStorage> indexed(in.count(4, 11));
+        for (IndexedStorage& s : indexed) {
+            s.key = in.bytes(static_cast<size_t>(in.le(2)));
+            uint64_t dtype = in.le(1);
+            if (dtype > static_cast<uint64_t>(TorchDType::Bool)) throw std::runtime_error("torch index: bad dtype");
+            s.dtype = static_cast<TorchDType>(dtype);
+            s.numel = static_cast<size_t>(in.le(8));
+            s.slot = nullptr;
+        }
+        size_t count = in.count(4, 17);
+        tensorList.reserve(count);
+        for (size_t n = 0; n < count; ++n) {
+            TorchTensor t;
+            t.name = in.bytes(static_cast<size_t>(in.le(4)));
+            uint64_t which = in.le(4);
+            if (which >= indexed.size()) throw std::runtime_error("torch index: bad storage index");
+            t.storageOffset = static_cast<int64_t>(in.le(8));
+            size_t rank = in.count(1, 16);
+            t.shape.resize(rank);
+            t.stride.resize(rank);
+            for (int64_t& d : t.shape) d = static_cast<int64_t>(in.le(8));
+            for (int64_t& d : t.stride) d = static_cast<int64_t>(in.le(8));
+            if (!path_selected(selected, t.name)) continue; // its storage is never mapped
+            IndexedStorage& s = indexed[which];
+            if (!s.slot) s.slot = &makeSlot(std::string(s.key), s.dtype, s.numel);
+            t.storage = s.slot->storage;
+            t.dtype = s.dtype;
+            check_view(t);
+            tensorList.push_back(std::move(t));
+        }
+        if (in.left() != 0) throw std::runtime_error("torch index: trailing bytes");
+    } catch (const std::exception&) {
+        storages.clear();
+        tensorList.clear();
+        missing.clear();
+        return false;
+    }
+    return true;
+}
+
+// Written to a temporary name and renamed into place, so concurrent
+// readers and writers only ever see a whole index.
+void TorchCheckpoint::writeIndex(const SourceStamp& stamp) const {
+    std::unordered_map<const TorchStorage*, uint32_t> numbering;
+    std::string out(kIndexMagic);
+    put_le(out, stamp.size, 8);
+    put_le(out, static_cast<uint64_t>(stamp.mtime), 8);
+    put_le(out, storages.size(), 4);
+    for (const auto& entry : storages) {
+        const TorchStorage& storage = *entry.second->storage;
+        numbering.emplace(&storage, static_cast<uint32_t>(numbering.size()));
+        put_le(out, storage.key.size(), 2);
+        out += storage.key;
+        put_le(out, static_cast<uint64_t>(storage.dtype), 1);
+        put_le(out, storage.numel, 8);
+    }
+    put_le(out, tensorList.size(), 4);
+    for (const TorchTensor& t : tensorList) {
+        put_le(out, t.name.size(), 4);
+        out += t.name;
+        put_le(out, numbering.at(t.storage.get()), 4);
+        put_le(out, static_cast<uint64_t>(t.storageOffset), 8);
+        put_le(out, t.shape.size(), 1);
+        for (int64_t d : t.shape) put_le(out, static_cast<uint64_t>(d), 8);
+        for (int64_t d : t.stride) put_le(out, static_cast<uint64_t>(d), 8);
+    }
+
+    std::string tmp = indexPath + ".tmp" + std::to_string(getpid());
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    std::error_code ec;
+    if (file) std::filesystem::rename(tmp, indexPath, ec);
+    if (!file || ec) std::filesystem::remove(tmp, ec);
+}
+
+void TorchCheckpoint::wait() const {
+    for (const auto& entry : storages) {
+        if (entry.second->storage->ready.valid()) entry.second->storage->ready.get();
+    }
+}
+
+const TorchTensor* TorchCheckpoint::find(std::string_view name) const {
+    const TorchTensor* match = nullptr;
+    for (const TorchTensor& t : tensorList) {
+        if (t.name == name) return &t;
+        std::string_view full(t.name);
+        if (full.size() > name.size() && full.substr(full.size() - name.size()) == name &&
+            full[full.size() - name.size() - 1] == '.') {
+            if (match) return nullptr; // ambiguous suffix
+            match = &t;
+        }
+    }
+    return match;
+}
+
+void TorchCheckpoint::collect(const PickleValue* value, std::string& path) {
+    if (resolveTensor(value, path)) return;
+    size_t base = path.size();
+    if (value->type == PickleType::Dict) {
+        for (uint32_t e = 0; e < value->dict.size; ++e) {
+            const PickleDictEntry& entry = value->dict.entries[e];
+            if (base) path += '.';
+            if (entry.key->type == PickleType::Str) {
+                path += entry.key->string();
+            } else if (entry.key->type == PickleType::Int) {
+                path += std::to_string(entry.key->i);
+            } else {
+                path.resize(base);
+                continue;
+            }
+            collect(entry.value, path);
+            path.resize(base);
+        }
+    } else if (value->type == PickleType::List || value->type == PickleType::Tuple) {
+        for (uint32_t k = 0; k < value->seq.size; ++k) {
+            if (base) path += '.';
+            path += std::to_string(k);
+            collect(value->seq.items[k], path);
+            path.resize(base);
+        }
+    }
+}
+
+// Recognises torch._utils._rebuild_tensor_v2(storage, offset, size, stride,
+// requires_grad, backward_hooks[, metadata]), optionally wrapped in
+// _rebuild_parameter(tensor, requires_grad, backward_hooks).
+bool TorchCheckpoint::resolveTensor(const PickleValue* value, const std::string& path) {
+    if (value->type != PickleType::Reduce) return false;
+    const PickleValue* callable = value->reduce.callable;
+    const PickleValue* args = value->reduce.args;
+    if (args->type != PickleType::Tuple) return false;
+    if (is_global(callable, rebuildParameter) && args->size() >= 1) {
+        return resolveTensor((*args)[0], path);
+    }
+    if (!is_global(callable, rebuildTensorV2)) return false;
+    if (args->size() < 4 || (*args)[0]->type != PickleType::PersId) {
+        throw std::runtime_error("torch tensor '" + path + "': malformed _rebuild_tensor_v2 arguments");
+    }
+
+    TorchTensor t;
+    t.name = path;
+    t.storage = slotFor((*args)[0]->pid).storage;
+    t.dtype = t.storage->dtype;
+    t.storageOffset = int_at(args, 1, "storage offset");
+    t.shape = int_tuple((*args)[2], "size");
+    t.stride = int_tuple((*args)[3], "stride");
+    if (t.shape.size() != t.stride.size()) {
+        throw std::runtime_error("torch tensor '" + path + "': size and stride ranks differ");
+    }
+    check_view(t);
+    tensorList.push_back(std::move(t));
+    return true;
+}
+
+// pid is ('storage', <module>.<Dtype>Storage, key, location, numel).
+TorchCheckpoint::StorageSlot& TorchCheckpoint::slotFor(const PickleValue* pid) {
+    if (pid->type != PickleType::Tuple || pid->size() < 5 || (*pid)[0]->type != PickleType::Str ||
+        (*pid)[0]->interned != storageTag || (*pid)[1]->type != PickleType::Global ||
+        (*pid)[2]->type != PickleType::Str) {
+        throw std::runtime_error("torch: unsupported persistent id");
+    }
+    // Tensors sharing a storage repeat its key; once seen, it is found by id.
+    uint32_t id = (*pid)[2]->interned;
+    if (id != PickleInternTable::kNone && id < slotByKey.size() && slotByKey[id]) return *slotByKey[id];
+    std::string key((*pid)[2]->string());
+    auto it = storages.find(key);
+    StorageSlot& slot = it != storages.end()
+                            ? *it->second
+                            : makeSlot(key, dtypeFromStorageClass((*pid)[1]->name()),
+                                       static_cast<size_t>(int_at(pid, 4, "storage numel")));
+    if (id != PickleInternTable::kNone) {
+        if (id >= slotByKey.size()) slotByKey.resize(id + 1, nullptr);
+        slotByKey[id] = &slot;
+    }
+    return slot;
+}
+
+TorchCheckpoint::StorageSlot& TorchCheckpoint::makeSlot(const std::string& key, TorchDType dtype, size_t numel) {
+    auto slot = std::make_shared<StorageSlot>();
+    slot->storage = std::make_shared<TorchStorage>();
+    slot->storage->key = key;
+    slot->storage->dtype = dtype;
+    slot->storage->numel = numel;
+    if (zip) {
+        slot->entry = zip->find(zipPrefix + "data/" + key);
+        slot->exists = slot->entry != nullptr;
+    } else {
+        slot->path = archiveDir + "/data/" + key;
+        slot->exists = std::filesystem::exists(slot->path);
+    }
+    if (!slot->exists) {
+        // Partial archives (e.g. with the embedding stripped) still load;
+        // the affected tensors just have no data.
+        missing.push_back(key);
+    }
+    return *storages.emplace(key, std::move(slot)).first->second;
+}
+
+void TorchCheckpoint::startStorage(ThreadPool& pool, StorageSlot& slot) {
+    if (slot.storage->ready.valid()) return;
+    slot.storage->ready = slot.done.get_future().share();
+    std::shared_ptr<StorageSlot> shared = storages.at(slot.storage->key);
+    pool.submit([this, &pool, shared] { loadStorage(pool, shared); });
+}
+
+void TorchCheckpoint::mapStorage(StorageSlot& slot) {
+    if (!slot.exists) return;
+    TorchStorage& storage = *slot.storage;
+    if (!zip) {
+        storage.file = MappedFile(slot.path);
+        storage.bytes = std::string_view(storage.file.data(), storage.file.size());
+        storage.path = slot.path;
+    } else if (slot.entry->stored()) {
+        storage.bytes = zip->view(*slot.entry); // zero-copy slice of the .pt mapping
+        storage.path = zip->fileName();
+        storage.fileOffset = static_cast<uint64_t>(storage.bytes.data() - zip->file().data());
+    } else {
+        storage.inflated = zip->extract(*slot.entry);
+        storage.bytes = std::string_view(storage.inflated.data(), storage.inflated.size());
+    }
+    if (storage.bytes.size() < storage.numel * dtypeSize(storage.dtype)) {
+        throw std::runtime_error("torch storage '" + storage.key + "': file is smaller than its declared numel");
+    }
+}
+
+// Runs on the pool: maps the storage, then faults it in as a set of chunk
+// tasks that other workers can steal. Inflated storages are resident as
+// soon as they are extracted.
+void TorchCheckpoint::loadStorage(ThreadPool& pool, const std::shared_ptr<StorageSlot>& slot) {
+    try {
+        mapStorage(*slot);
+    } catch (...) {
+        finishStorage(*slot, std::current_exception());
+        return;
+    }
+    const TorchStorage& storage = *slot->storage;
+    const MappedFile& file = zip ? zip->file() : storage.file;
+    size_t len = storage.bytes.size();
+    size_t chunks = (len + kPrefaultChunk - 1) / kPrefaultChunk;
+    if (chunks == 0 || !storage.inflated.empty()) {
+        finishStorage(*slot, nullptr);
+        return;
+    }
+    size_t base = static_cast<size_t>(storage.bytes.data() - file.data());
+    file.advise(MappedFile::AdviseWillNeed, base, len);
+    slot->chunksLeft.store(chunks);
+    for (size_t c = 1; c < chunks; ++c) {
+        pool.submit([this, slot, &file, base, len, c] {
+            size_t off = c * kPrefaultChunk;
+            file.prefault(base + off, std::min(kPrefaultChunk, len - off));
+            if (slot->chunksLeft.fetch_sub(1) == 1) finishStorage(*slot, nullptr);
+        });
+    }
+    file.prefault(base, std::min(kPrefaultChunk, len));
+    if (slot->chunksLeft.fetch_sub(1) == 1) finishStorage(*slot, nullptr);
+}
+
+void TorchCheckpoint::finishStorage(StorageSlot& slot, std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> guard(finishLock);
+        ++finishing;
+    }
+    if (!slot.storage->ready.valid()) slot.storage->ready = slot.done.get_future().share();
+    if (error) {
+        slot.done.set_exception(error);
+    } else {
+        slot.done.set_value();
+    }
+    std::vector<const TorchTensor*> waiting;
+    {
+        std::lock_guard<std::mutex> guard(slot.lock);
+        slot.finished = true;
+        waiting.swap(slot.waiting);
+    }
+    if (onTensorReady) {
+        for (const TorchTensor* t : waiting) onTensorReady(*t);
+    }
+    std::lock_guard<std::mutex> guard(finishLock);
+    --finishing;
+    finishDone.notify_all();
+}
@@ -0,0 +1,178 @@
+#ifndef TORCH_CHECKPOINT_HPP
+#define TORCH_CHECKPOINT_HPP
+
+#include "mapped_file.hpp"
+#include "pickle.hpp"
+#include "zip_archive.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+enum class TorchDType : uint8_t {
+    Float16,
+    BFloat16,
+    Float32,
+    Float64,
+    Int8,
+    UInt8,
+    Int16,
+    Int32,
+    Int64,
+    Bool,
+};
+
+size_t dtypeSize(TorchDType dtype);
+const char* dtypeName(TorchDType dtype);
+// Maps a legacy storage class name ("HalfStorage", "FloatStorage", ...) to
+// its element type; throws for anything else.
+TorchDType dtypeFromStorageClass(std::string_view storage_class);
+
+// One archive/data/<key> member, loaded once and shared by every tensor
+// that views it.
+struct TorchStorage {
+    std::string key;
+    TorchDType dtype;
+    size_t numel;
+    // The storage contents: a view of `file` for an extracted archive, of
+    // the zip mapping for a stored member, or of `inflated` for a deflated
+    // one. Empty if the member is missing.
+    std::string_view bytes;
+    MappedFile file;
+    std::vector<char> inflated;
+    // Where `bytes` sit on disk, for copies that bypass the mapping: the
+    // file and the offset of bytes[0] in it. Empty for inflated storages.
+    std::string path;
+    uint64_t fileOffset = 0;
+    // Becomes ready once `bytes` is set and resident (or known to be
+    // missing); rethrows the load error otherwise. Do not touch `bytes`
+    // before then.
+    std::shared_future<void> ready;
+};
+
+struct TorchTensor {
+    std::string name; // dict keys from the root, joined with '.'
+    TorchDType dtype;
+    std::vector<int64_t> shape;
+    std::vector<int64_t> stride;
+    int64_t storageOffset; // in elements
+    std::shared_ptr<const TorchStorage> storage;
+
+    size_t numel() const;
+    size_t nbytes() const { return numel() * dtypeSize(dtype); }
+    // First element of the tensor inside the storage bytes, or nullptr if
+    // the storage is missing from the archive.
+    const void* data() const {
+        if (storage->bytes.empty()) return nullptr;
+        return storage->bytes.data() + static_cast<size_t>(storageOffset) * dtypeSize(dtype);
+    }
+    const std::shared_future<void>& ready() const { return storage->ready; }
+};
+
+// A torch.save() checkpoint: data.pkl plus the data/<key> storages it
+// references through BINPERSID. Either the .pt zip itself, read in place,
+// or a directory it was extracted to.
+class TorchCheckpoint {
+public:
+    using TensorCallback = std::function<void(const TorchTensor&)>;
+
+    // `path` is a .pt file or an extracted archive directory.
+    explicit TorchCheckpoint(const std::string& path);
+    ~TorchCheckpoint(); // waits for storage loads still running on a pool
+
+    // Parses data.pkl, maps every referenced storage and resolves tensors.
+    void load();
+    // Same, but each storage is mapped and faulted in on `pool` as soon as
+    // BINPERSID names it, while the parse carries on. Returns once tensors
+    // are resolved; their bytes may still be loading. on_ready fires once
+    // per tensor when its storage has finished loading, on a pool thread
+    // (or on the caller, for storages that beat the parse); the tensor's
+    // ready() then rethrows the failure if the load failed.
+    void load(ThreadPool& pool, TensorCallback on_ready = nullptr);
+    // Restricts the next load to these dotted paths and whatever lies below
+    // them (see PickleParser::selectPaths); storages that only skipped
+    // tensors use are never mapped. An empty list loads everything.
+    void select(std::vector<std::string> paths);
+    // Keeps a sidecar index of the resolved tensors at `path`; by default
+    // next to the source (data.pkl, or the .pt file) with ".idx" appended.
+    // load() then takes storages and tensors from the index, without
+    // parsing data.pkl, as long as the source's size and mtime match what
+    // the index recorded. Otherwise it parses and rewrites the index. The
+    // index is only written by unselected loads, and writing is best
+    // effort: an unwritable location just means every load parses.
+    void useIndex(std::string path = std::string());
+    // Whether the last load() came from the index. If so, root() is not
+    // updated by it.
+    bool loadedFromIndex() const { return fromIndex; }
+    // Blocks until every storage has loaded; rethrows the first failure.
+    void wait() const;
+
+    const std::vector<TorchTensor>& tensors() const { return tensorList; }
+    // Exact name, or the unique tensor whose name ends in "." + name, so
+    // "encoder.conv1.weight" finds "model_state_dict.encoder.conv1.weight".
+    const TorchTensor* find(std::string_view name) const;
+    // Storage keys referenced by data.pkl whose data/<key> member is absent.
+    const std::vector<std::string>& missingStorages() const { return missing; }
+    // The decoded pickle; valid as long as this checkpoint. Null until a
+    // load() has parsed data.pkl.
+    const PickleValue* root() const { return parser->root(); }
+
+private:
+    struct StorageSlot;
+
+    struct SourceStamp {
+        uint64_t size;
+        int64_t mtime;
+    };
+
+    void drain();
+    void reset();
+    void parse();
+    bool readIndex();
+    void writeIndex(const SourceStamp& stamp) const;
+    bool stampSource(SourceStamp& stamp) const;
+    void collect(const PickleValue* value, std::string& path);
+    bool resolveTensor(const PickleValue* value, const std::string& path);
+    StorageSlot& slotFor(const PickleValue* pid);
+    StorageSlot& makeSlot(const std::string& key, TorchDType dtype, size_t numel);
+    void startStorage(ThreadPool& pool, StorageSlot& slot);
+    void mapStorage(StorageSlot& slot);
+    void loadStorage(ThreadPool& pool, const std::shared_ptr<StorageSlot>& slot);
+    void finishStorage(StorageSlot& slot, std::exception_ptr error);
+
+    std::string archiveDir;            // extracted archive; empty for a zip
+    std::unique_ptr<ZipArchive> zip;   // .pt file; null for a directory
+    std::string zipPrefix;             // "<name>/" that data.pkl sits under in the zip
+    std::vector<char> pickleBytes;     // data.pkl, if it had to be inflated
+    std::unique_ptr<PickleParser> parser;
+    std::string sourcePath;            // data.pkl or the .pt file; what the index is stamped with
+    std::string indexPath;             // empty: no index
+    std::vector<std::string> selected;
+    bool fromIndex = false;
+    std::unordered_map<std::string, std::shared_ptr<StorageSlot>> storages;
+    // What the tensor walk dispatches on, resolved once: the parser interns
+    // into `names`, so recognising a node is an id compare.
+    PickleInternTable names;
+    uint32_t rebuildTensorV2 = names.internGlobal("torch._utils", "_rebuild_tensor_v2");
+    uint32_t rebuildParameter = names.internGlobal("torch._utils", "_rebuild_parameter");
+    uint32_t storageTag = names.intern("storage");
+    std::vector<StorageSlot*> slotByKey; // by storage key string id, during a parse
+    TensorCallback onTensorReady;
+    // finishStorage() calls still running on the pool; drain() waits for
+    // them as well as for every storage's `ready`.
+    std::mutex finishLock;
+    std::condition_variable finishDone;
+    size_t finishing = 0;
+    std::vector<TorchTensor> tensorList;
+    std::vector<std::string> missing;
+};
+
+#endif // TORCH_CHECKPOINT_HPP
@@ -0,0 +1,100 @@
+#include "torch_loader.hpp"
+#include "thread_pool.hpp"
+#include <stdexcept>
+
+bool TorchTensorAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    return loader.enqueue({this, handle});
+}
+
+const TorchTensor& TorchTensorAwaiter::await_resume() {
+    if (error) std::rethrow_exception(error);
+    tensor->ready().get(); // the storage's own failure, if any
+    return *tensor;
+}
+
+TorchLoader::TorchLoader(TorchCheckpoint& checkpoint, ThreadPool& pool) : checkpoint(checkpoint) {
+    pool.submit([this, &pool] { run(pool); });
+}
+
+TorchLoader::~TorchLoader() {
+    // The parse may still be resuming coroutines, and storages still
+    // finishing call back into this object; both must be over first.
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] {
+        return finished && (parseError || callbacksDone == checkpoint.tensors().size());
+    });
+}
+
+void TorchLoader::waitParsed() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return parsed; });
+    if (parseError) std::rethrow_exception(parseError);
+}
+
+// Runs on the pool. Storages that finish during the parse are only
+// reported once it returns (see TorchCheckpoint::load), so `settled` and
+// `pending` start filling after the tensors exist.
+void TorchLoader::run(ThreadPool& pool) {
+    std::exception_ptr error;
+    try {
+        checkpoint.load(pool, [this](const TorchTensor& t) { tensorReady(t); });
+    } catch (...) {
+        error = std::current_exception();
+    }
+    std::vector<Waiter> wake;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        parsed = true;
+        parseError = error;
+        for (const Waiter& w : unnamed) {
+            if (resolve(w)) wake.push_back(w);
+        }
+        unnamed.clear();
+    }
+    for (const Waiter& w : wake) w.handle.resume();
+    std::lock_guard<std::mutex> guard(lock);
+    finished = true;
+    changed.notify_all();
+}
+
+void TorchLoader::tensorReady(const TorchTensor& t) {
+    std::vector<Waiter> wake;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        settled.insert(&t);
+        auto range = pending.equal_range(&t);
+        for (auto it = range.first; it != range.second; ++it) wake.push_back(it->second);
+        pending.erase(range.first, range.second);
+    }
+    for (const Waiter& w : wake) w.handle.resume();
+    std::lock_guard<std::mutex> guard(lock);
+    ++callbacksDone;
+    changed.notify_all();
+}
+
+bool TorchLoader::resolve(const Waiter& waiter) {
+    TorchTensorAwaiter& a = *waiter.awaiter;
+    if (parseError) {
+        a.error = parseError;
+        return true;
+    }
+    const TorchTensor* t = checkpoint.find(a.name);
+    if (!t) {
+        a.error = std::make_exception_ptr(std::runtime_error("torch: no tensor named '" + a.name + "'"));
+        return true;
+    }
+    a.tensor = t;
+    if (settled.count(t)) return true;
+    pending.emplace(t, waiter);
+    return false;
+}
+
+// Whether the awaiting coroutine has to suspend.
+bool TorchLoader::enqueue(const Waiter& waiter) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!parsed) {
+        unnamed.push_back(waiter);
+        return true;
+    }
+    return !resolve(waiter);
+}
@@ -0,0 +1,126 @@
+#ifndef TORCH_LOADER_HPP
+#define TORCH_LOADER_HPP
+
+#include "torch_checkpoint.hpp"
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class ThreadPool;
+class TorchLoader;
+
+// Coroutine return type for code that awaits TorchLoader tensors. Starts
+// eagerly: the body runs on the caller up to its first co_await that has
+// to wait, then carries on in whichever pool thread resumed it. get()
+// blocks until the body has returned and rethrows anything that escaped
+// it.
+class TorchTask {
+public:
+    struct promise_type {
+        std::promise<void> done;
+
+        TorchTask get_return_object() { return TorchTask(done.get_future()); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { done.set_value(); }
+        void unhandled_exception() { done.set_exception(std::current_exception()); }
+    };
+
+    void get() { finished.get(); }
+
+private:
+    explicit TorchTask(std::future<void> f) : finished(std::move(f)) {}
+
+    std::future<void> finished;
+};
+
+// What TorchLoader::tensor() returns. co_await yields the tensor once its
+// storage is resident; it throws if the parse failed, if no tensor has
+// that name, or if the storage failed to load.
+class TorchTensorAwaiter {
+public:
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    const TorchTensor& await_resume();
+
+private:
+    friend class TorchLoader;
+    TorchTensorAwaiter(TorchLoader& loader, std::string name) : loader(loader), name(std::move(name)) {}
+
+    TorchLoader& loader;
+    std::string name;
+    const TorchTensor* tensor = nullptr;
+    std::exception_ptr error;
+};
+
+// Loads a checkpoint on a pool and lets coroutines wait for single
+// tensors:
+//
+//     TorchTask use(TorchLoader& loader) {
+//         const TorchTensor& w = co_await loader.tensor("encoder.conv1.weight");
+//         ...
+//     }
+//
+// The constructor queues TorchCheckpoint::load(pool) as a pool task and
+// returns at once. That parse starts each storage's read as soon as
+// BINPERSID names it, so reads overlap the rest of data.pkl, and a
+// coroutine resumes, on the pool thread that finished its storage, as
+// soon as the parse has mapped its name to a tensor and those bytes are
+// in. Keep the work done there short or hand it off: it holds a worker.
+// With a one-thread pool the parse runs first and the reads after it.
+//
+// Configure the checkpoint (select(), useIndex()) before constructing
+// the loader, and leave it alone until the loader is destroyed.
+class TorchLoader {
+public:
+    TorchLoader(TorchCheckpoint& checkpoint, ThreadPool& pool);
+    // Waits for the parse and for every tensor's storage to settle. Must
+    // not run on a pool thread.
+    ~TorchLoader();
+
+    TorchLoader(const TorchLoader&) = delete;
+    TorchLoader& operator=(const TorchLoader&) = delete;
+
+    // Same names as TorchCheckpoint::find(): exact, or a unique suffix
+    // after a '.'.
+    TorchTensorAwaiter tensor(std::string name) { return TorchTensorAwaiter(*this, std::move(name)); }
+
+    // Blocks until data.pkl is parsed and every tensor is resolved (their
+    // bytes may still be loading); rethrows a failed parse.
+    void waitParsed();
+
+private:
+    friend class TorchTensorAwaiter;
+
+    struct Waiter {
+        TorchTensorAwaiter* awaiter;
+        std::coroutine_handle<> handle;
+    };
+
+    void run(ThreadPool& pool);
+    void tensorReady(const TorchTensor& t);
+    // Looks the waiter's name up. True if it can resume now (with a tensor
+    // or an error); false if it was queued for its storage. Caller holds
+    // `lock`, after the parse.
+    bool resolve(const Waiter& waiter);
+    bool enqueue(const Waiter& waiter);
+
+    TorchCheckpoint& checkpoint;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool parsed = false;   // tensors resolved, or the parse failed
+    bool finished = false; // run() is done, including the coroutines it resumed
+    std::exception_ptr parseError;
+    std::unordered_set<const TorchTensor*> settled;              // storage finished
+    size_t callbacksDone = 0;                                    // tensorReady() calls that have returned
+    std::vector<Waiter> unnamed;                                 // arrived before the parse finished
+    std::unordered_multimap<const TorchTensor*, Waiter> pending; // storage still loading
+};
+
+#endif // TORCH_LOADER_HPP
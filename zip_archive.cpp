@@ -0,0 +1,220 @@
+#include "zip_archive.hpp"
+#include <algorithm>
+#include <stdexcept>
+#ifdef PICKLE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSig = 0x06054b50;
+constexpr uint32_t kZip64EndSig = 0x06064b50;
+constexpr uint32_t kZip64LocatorSig = 0x07064b50;
+constexpr uint16_t kZip64ExtraId = 0x0001;
+
+constexpr size_t kEndOfCentralDirSize = 22;
+constexpr size_t kZip64LocatorSize = 20;
+constexpr size_t kZip64EndSize = 56;
+constexpr size_t kCentralHeaderSize = 46;
+constexpr size_t kLocalHeaderSize = 30;
+
+uint16_t le16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(u[0] | (u[1] << 8));
+}
+
+uint32_t le32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+uint64_t le64(const char* p) {
+    return static_cast<uint64_t>(le32(p)) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+}
+
+} // namespace
+
+ZipArchive::ZipArchive(const std::string& path, unsigned advice) : path(path), mapped(path, advice) {
+    readCentralDirectory();
+}
+
+void ZipArchive::readCentralDirectory() {
+    const char* base = mapped.data();
+    size_t size = mapped.size();
+    auto fail = [this](const std::string& what) {
+        return std::runtime_error("zip: " + what + " in " + path);
+    };
+    if (size < kEndOfCentralDirSize) throw fail("file too small for an end of central directory record");
+
+    // The end record sits in the last 22 bytes plus up to 64 KiB of comment.
+    size_t eocd = size - kEndOfCentralDirSize;
+    size_t lowest = size > kEndOfCentralDirSize + 0xffff ? size - kEndOfCentralDirSize - 0xffff : 0;
+    while (le32(base + eocd) != kEndOfCentralDirSig) {
+        if (eocd == lowest) throw fail("no end of central directory record");
+        --eocd;
+    }
+    uint64_t count = le16(base + eocd + 10);
+    uint64_t dirSize = le32(base + eocd + 12);
+    uint64_t dirOffset = le32(base + eocd + 16);
+    if (le16(base + eocd + 4) != 0 || le16(base + eocd + 6) != 0) throw fail("multi-disk archives are not supported");
+
+    if (eocd >= kZip64LocatorSize && le32(base + eocd - kZip64LocatorSize) == kZip64LocatorSig) {
+        uint64_t end64 = le64(base + eocd - kZip64LocatorSize + 8);
+        if (size < kZip64EndSize || end64 > size - kZip64EndSize || le32(base + end64) != kZip64EndSig) {
+            throw fail("bad ZIP64 end of central directory record");
+        }
+        count = le64(base + end64 + 32);
+        dirSize = le64(base + end64 + 40);
+        dirOffset = le64(base + end64 + 48);
+    }
+    if (dirOffset > size || dirSize > size - dirOffset) throw fail("central directory out of range");
+
+    entryList.reserve(static_cast<size_t>(std::min<uint64_t>(count, dirSize / kCentralHeaderSize)));
+    size_t pos = static_cast<size_t>(dirOffset);
+    size_t dirEnd = static_cast<size_t>(dirOffset + dirSize);
+    for (uint64_t n = 0; n < count; ++n) {
+        if (dirEnd - pos < kCentralHeaderSize || le32(base + pos) != kCentralHeaderSig) {
+            throw fail("truncated central directory");
+        }
+        const char* h = base + pos;
+        uint16_t flags = le16(h + 8);
+        size_t nameLen = le16(h + 28);
+        size_t extraLen = le16(h + 30);
+        size_t commentLen = le16(h + 32);
+        if (dirEnd - pos - kCentralHeaderSize < nameLen + extraLen + commentLen) throw fail("truncated central directory");
+
+        ZipEntry e;
+        e.name.assign(h + kCentralHeaderSize, nameLen);
+        e.method = le16(h + 10);
+        e.crc32 = le32(h + 16);
+        e.compressedSize = le32(h + 20);
+        e.size = le32(h + 24);
+        e.localHeaderOffset = le32(h + 42);
+        if (flags & 1) throw fail("encrypted member '" + e.name + "'");
+
+        // ZIP64 extended information: 64-bit values, present only for the
+        // fields whose 32-bit slot is saturated, in this order.
+        const char* extra = h + kCentralHeaderSize + nameLen;
+        const char* extraEnd = extra + extraLen;
+        while (extraEnd - extra >= 4) {
+            uint16_t id = le16(extra);
+            uint16_t len = le16(extra + 2);
+            const char* field = extra + 4;
+            if (static_cast<size_t>(extraEnd - field) < len) break;
+            if (id == kZip64ExtraId) {
+                const char* p = field;
+                auto take = [&](uint64_t& value) {
+                    if (value != 0xffffffff) return;
+                    if (field + len - p < 8) throw fail("short ZIP64 extra field for '" + e.name + "'");
+                    value = le64(p);
+                    p += 8;
+                };
+                take(e.size);
+                take(e.compressedSize);
+                take(e.localHeaderOffset);
+            }
+            extra = field + len;
+        }
+        entryList.push_back(std::move(e));
+        pos += kCentralHeaderSize + nameLen + extraLen + commentLen;
+    }
+    byName.reserve(entryList.size());
+    for (size_t k = 0; k < entryList.size(); ++k) byName.emplace(entryList[k].name, k);
+}
+
+const ZipEntry* ZipArchive::find(std::string_view name) const {
+    auto it = byName.find(name);
+    return it == byName.end() ? nullptr : &entryList[it->second];
+}
+
+std::string_view ZipArchive::raw(const ZipEntry& entry) const {
+    const char* base = mapped.data();
+    size_t size = mapped.size();
+    uint64_t local = entry.localHeaderOffset;
+    if (local > size || size - local < kLocalHeaderSize || le32(base + local) != kLocalHeaderSig) {
+        throw std::runtime_error("zip: bad local header for '" + entry.name + "' in " + path);
+    }
+    // The local name/extra lengths may differ from the central copy; torch
+    // pads the local extra field to align member data.
+    uint64_t data = local + kLocalHeaderSize + le16(base + local + 26) + le16(base + local + 28);
+    if (data > size || entry.compressedSize > size - data) {
+        throw std::runtime_error("zip: member '" + entry.name + "' runs past the end of " + path);
+    }
+    return std::string_view(base + data, static_cast<size_t>(entry.compressedSize));
+}
+
+std::string_view ZipArchive::view(const ZipEntry& entry) const {
+    if (!entry.stored()) {
+        throw std::runtime_error("zip: member '" + entry.name + "' is compressed; use extract() or stream()");
+    }
+    return raw(entry);
+}
+
+std::vector<char> ZipArchive::extract(const ZipEntry& entry) const {
+    std::vector<char> out;
+    out.reserve(static_cast<size_t>(entry.size));
+    stream(entry, [&out](const char* data, size_t len) { out.insert(out.end(), data, data + len); },
+           entry.stored() ? entry.size : 1 << 20);
+    return out;
+}
+
+void ZipArchive::stream(const ZipEntry& entry, const std::function<void(const char*, size_t)>& sink,
+                        size_t chunk_size) const {
+    std::string_view in = raw(entry);
+    if (chunk_size == 0) chunk_size = 1 << 20;
+    if (entry.stored()) {
+        for (size_t off = 0; off < in.size(); off += chunk_size) {
+            sink(in.data() + off, std::min(chunk_size, in.size() - off));
+        }
+        return;
+    }
+    if (entry.method != 8) {
+        throw std::runtime_error("zip: member '" + entry.name + "' uses unsupported compression method " +
+                                 std::to_string(entry.method));
+    }
+#ifdef PICKLE_HAVE_ZLIB
+    z_stream zs{};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) throw std::runtime_error("zip: inflateInit2 failed");
+    std::vector<unsigned char> chunk(std::min<size_t>(chunk_size, 1u << 30));
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t produced = 0;
+    size_t consumed = 0;
+    int status = Z_OK;
+    try {
+        while (status != Z_STREAM_END) {
+            if (zs.avail_in == 0 && consumed < in.size()) {
+                size_t take = std::min<size_t>(in.size() - consumed, 1u << 30); // avail_in is 32-bit
+                zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data() + consumed));
+                zs.avail_in = static_cast<uInt>(take);
+                consumed += take;
+            }
+            zs.next_out = chunk.data();
+            zs.avail_out = static_cast<uInt>(chunk.size());
+            status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                throw std::runtime_error("zip: corrupt deflate data in '" + entry.name + "'");
+            }
+            size_t have = chunk.size() - zs.avail_out;
+            if (status == Z_OK && have == 0 && zs.avail_in == 0 && consumed == in.size()) {
+                throw std::runtime_error("zip: deflate data of '" + entry.name + "' ends early");
+            }
+            crc = crc32(crc, chunk.data(), static_cast<uInt>(have));
+            produced += have;
+            if (have) sink(reinterpret_cast<const char*>(chunk.data()), have);
+        }
+    } catch (...) {
+        inflateEnd(&zs);
+        throw;
+    }
+    inflateEnd(&zs);
+    if (produced != entry.size || crc != entry.crc32) {
+        throw std::runtime_error("zip: size or CRC mismatch in '" + entry.name + "'");
+    }
+#else
+    (void)sink;
+    throw std::runtime_error("zip: member '" + entry.name + "' is deflated and this build has no zlib");
+#endif
+}
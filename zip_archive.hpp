@@ -0,0 +1,63 @@
+#ifndef ZIP_ARCHIVE_HPP
+#define ZIP_ARCHIVE_HPP
+
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One member of a zip archive, as listed by its central directory.
+struct ZipEntry {
+    std::string name;
+    uint16_t method;             // 0 stored, 8 deflated
+    uint32_t crc32;
+    uint64_t compressedSize;
+    uint64_t size;               // uncompressed
+    uint64_t localHeaderOffset;
+
+    bool stored() const { return method == 0; }
+};
+
+// Read-only view of a zip file (ZIP64 included), mapped once. torch.save()
+// writes checkpoints as zips of uncompressed, 64-byte aligned members, so
+// those are handed out as slices of the mapping; deflated members are
+// inflated on request. Single-disk archives only; no encryption.
+class ZipArchive {
+public:
+    explicit ZipArchive(const std::string& path, unsigned advice = MappedFile::AdviseNone);
+
+    const std::vector<ZipEntry>& entries() const { return entryList; }
+    // Exact member name, or nullptr.
+    const ZipEntry* find(std::string_view name) const;
+
+    // The member's bytes as they sit in the file (raw deflate data for
+    // compressed members).
+    std::string_view raw(const ZipEntry& entry) const;
+    // Contents of a stored member without copying; throws for compressed ones.
+    std::string_view view(const ZipEntry& entry) const;
+    // Contents of any member, inflated into a new buffer if compressed.
+    std::vector<char> extract(const ZipEntry& entry) const;
+    // Hands the contents to sink in pieces of at most chunk_size bytes,
+    // inflating as it goes, so a compressed member never has to fit in
+    // memory whole. Stored members are passed as slices of the mapping.
+    void stream(const ZipEntry& entry, const std::function<void(const char*, size_t)>& sink,
+                size_t chunk_size = 1 << 20) const;
+
+    // The whole mapped file, for madvise()/prefault() on member ranges.
+    const MappedFile& file() const { return mapped; }
+    const std::string& fileName() const { return path; }
+
+private:
+    void readCentralDirectory();
+
+    std::string path;
+    MappedFile mapped;
+    std::vector<ZipEntry> entryList;
+    std::unordered_map<std::string_view, size_t> byName; // views into entryList names
+};
+
+#endif // ZIP_ARCHIVE_HPP